@@ -28,12 +28,13 @@ public:
 	virtual double Payoff(double S) const override { return PAYOFF::VanillaOption(optType, strike, S); }
 	virtual const Date &GetExpiry() const override { return expiryDate; }
 	virtual double ValueAtNode(double S, double t, double continuation) const override { return std::max(Payoff(S), continuation); }
+	virtual TreeTerms GetTreeTerms() const override { return TreeTerms{true, optType, strike}; }
 
 	virtual double Pv(const Market &mkt) const override
 	{
-		// Use CRR binomial tree model, 50 steps
-		CRRBinomialTreePricer pricer(50);
-		return pricer.Price(mkt, std::make_shared<AmericanOption>(*this));
+		// tree model from DefaultTreeOptions(), CRR with 50 steps unless SetDefaultTreeOptions changed it
+		auto pricer = MakeTreePricer(DefaultTreeOptions());
+		return pricer->PriceTree(mkt, *this) * notional; // no copy of the trade per call
 	}
 
 private:
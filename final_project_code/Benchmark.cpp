@@ -0,0 +1,1751 @@
+#include <vector>
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <queue>
+#include <sstream>
+#include <charconv>
+#include <cstring>
+#include "Benchmark.h"
+#include "Date.h"
+#include "Market.h"
+#include "Swap.h"
+#include "Bond.h"
+#include "EuropeanTrade.h"
+#include "AmericanTrade.h"
+#include "BlackScholes.h"
+#include "thread_pool.h"
+#include "RiskEngine.h"
+#include "PortfolioCache.h"
+#include "ScenarioEngine.h"
+#include "Bootstrapper.h"
+#include "ImpliedVol.h"
+#include "TradeLoader.h"
+#include "PortfolioSnapshot.h"
+#include "TradeBook.h"
+#include "CashflowLedger.h"
+#include "ResultWriter.h"
+
+namespace legacy
+{
+	// the loop based serial date, kept as the baseline of the date benchmark
+	long serialDate(int year, int month, int day)
+	{
+		int daysSinceEpoch = 0;
+		for (int y = 1900; y < year; ++y)
+			daysSinceEpoch += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
+
+		int daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+		if (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+			daysInMonth[1] = 29;
+		for (int m = 0; m < month - 1; ++m)
+			daysSinceEpoch += daysInMonth[m];
+		daysSinceEpoch += day;
+		if (year > 1900)
+			daysSinceEpoch += 1;
+		return daysSinceEpoch;
+	}
+
+	struct LegacyDate
+	{
+		int year;
+		int month;
+		int day;
+		long getSerialDate() const { return serialDate(year, month, day); }
+	};
+	inline bool operator<(const LegacyDate &lhs, const LegacyDate &rhs) { return lhs.getSerialDate() < rhs.getSerialDate(); }
+	inline double operator-(const LegacyDate &d1, const LegacyDate &d2) { return d1.getSerialDate() - d2.getSerialDate(); }
+
+	LegacyDate addMonths(LegacyDate dt, int n)
+	{
+		dt.month += n;
+		while (dt.month > 12)
+		{
+			dt.month -= 12;
+			dt.year += 1;
+		}
+		return dt;
+	}
+
+	// one date at a time lookup as RateCurve::getDf did before the day table and batch api
+	double scalarDf(const RateCurve &rc, Date date)
+	{
+		const auto &tenors = rc.getTenors();
+		const auto &rates = rc.getPillarRates();
+		double r;
+		auto it = std::lower_bound(tenors.begin(), tenors.end(), date);
+		if (it == tenors.end())
+			r = rates.back();
+		else if (it == tenors.begin() || *it == date)
+			r = rates[it - tenors.begin()];
+		else
+		{
+			size_t i = it - tenors.begin();
+			double x0 = tenors[i - 1].getSerialDate(), x1 = tenors[i].getSerialDate();
+			r = rates[i - 1] + (date.getSerialDate() - x0) * (rates[i] - rates[i - 1]) / (x1 - x0);
+		}
+		return exp(-r * ((date - rc._asOf) / 365.0));
+	}
+
+	// the binomial tree as it was: virtual spot/probabilities, pow and exp per node
+	class TreePricer
+	{
+	public:
+		TreePricer(int N) : nTimeSteps(N), states(N + 1) {}
+		virtual ~TreePricer() {}
+		double PriceTree(const Market &mkt, const TreeProduct &trade)
+		{
+			double T = (trade.GetExpiry() - mkt.asOf) / 365.0;
+			double dt = T / nTimeSteps;
+			double s0 = mkt.getStockPrice(trade.getUnderlying());
+			double vol = mkt.getVolCurve("LOGVOL")->getVol(trade.GetExpiry());
+			double rate = mkt.getCurve("USD-SOFR")->getRate(trade.GetExpiry());
+			ModelSetup(s0, vol, rate, dt);
+			for (int i = 0; i <= nTimeSteps; i++)
+				states[i] = trade.Payoff(GetSpot(nTimeSteps, i));
+			for (int k = nTimeSteps - 1; k >= 0; k--)
+				for (int i = 0; i <= k; i++)
+				{
+					double df = exp(-rate * dt);
+					double continuation = df * (states[i] * GetProbUp() + states[i + 1] * GetProbDown());
+					states[i] = trade.ValueAtNode(GetSpot(k, i), dt * k, continuation);
+				}
+			return states[0];
+		}
+
+	protected:
+		virtual void ModelSetup(double S0, double sigma, double rate, double dt) = 0;
+		virtual double GetSpot(int ti, int si) const = 0;
+		virtual double GetProbUp() const = 0;
+		virtual double GetProbDown() const = 0;
+
+	private:
+		int nTimeSteps;
+		vector<double> states;
+	};
+
+	class CRRTreePricer : public TreePricer
+	{
+	public:
+		CRRTreePricer(int N) : TreePricer(N) {}
+
+	protected:
+		void ModelSetup(double S0, double sigma, double rate, double dt)
+		{
+			double b = std::exp((2 * rate + sigma * sigma) * dt) + 1;
+			u = (b + std::sqrt(b * b - 4 * std::exp(2 * rate * dt))) / 2 / std::exp(rate * dt);
+			p = (std::exp(rate * dt) - 1 / u) / (u - 1 / u);
+			currentSpot = S0;
+		}
+		double GetSpot(int ti, int si) const { return currentSpot * std::pow(u, ti - 2 * si); }
+		double GetProbUp() const { return p; }
+		double GetProbDown() const { return 1 - p; }
+
+	private:
+		double u, p, currentSpot;
+	};
+
+	// the pool as it was: one std::queue of std::function behind one mutex and condition variable
+	class ThreadPool
+	{
+	public:
+		ThreadPool(size_t num_threads)
+		{
+			for (size_t i = 0; i < num_threads; ++i)
+			{
+				threads_.emplace_back([this]
+									  {
+					while (true)
+					{
+						function<void()> task;
+						{
+							unique_lock<mutex> lock(queue_mutex_);
+							cv_.wait(lock, [this]
+									 { return !tasks_.empty() || stop_; });
+							if (stop_ && tasks_.empty())
+								return;
+							task = std::move(tasks_.front());
+							tasks_.pop();
+						}
+						task();
+					} });
+			}
+		}
+		~ThreadPool()
+		{
+			{
+				unique_lock<mutex> lock(queue_mutex_);
+				stop_ = true;
+			}
+			cv_.notify_all();
+			for (auto &thread : threads_)
+				thread.join();
+		}
+		void enqueue(function<void()> task)
+		{
+			{
+				unique_lock<std::mutex> lock(queue_mutex_);
+				tasks_.push(std::move(task));
+			}
+			cv_.notify_one();
+		}
+
+	private:
+		vector<thread> threads_;
+		queue<function<void()>> tasks_;
+		mutex queue_mutex_;
+		condition_variable cv_;
+		bool stop_ = false;
+	};
+}
+
+namespace
+{
+	// compile time tenor date, folded by the compiler
+	constexpr Date kTenYears = dateAddTenor(Date(2025, 1, 3), 10, 'Y');
+	static_assert(kTenYears == Date(2035, 1, 3), "constexpr tenor arithmetic");
+	static_assert(Date(1900, 1, 1).getSerialDate() == 1, "excel serial epoch");
+	static_assert(Date(2025, 1, 1).getSerialDate() == 45658, "excel serial of 2025-01-01");
+
+	int benchDate()
+	{
+		const size_t n = 2000000;
+		std::mt19937 gen(42);
+		std::uniform_int_distribution<int> yDist(1990, 2060), mDist(1, 12), dDist(1, 28);
+		vector<Date> dates;
+		vector<legacy::LegacyDate> oldDates;
+		for (size_t i = 0; i < n; i++)
+		{
+			int y = yDist(gen), m = mDist(gen), d = dDist(gen);
+			dates.emplace_back(y, m, d);
+			oldDates.push_back({y, m, d});
+			if (dates.back().getSerialDate() != legacy::serialDate(y, m, d))
+			{
+				cerr << "serial mismatch at " << dates.back() << endl;
+				return 1;
+			}
+		}
+
+		size_t count = 0;
+		double t = bench::timeIt([&]
+								 { for (size_t i = 1; i < n; i++) count += oldDates[i - 1] < oldDates[i]; });
+		bench::doNotOptimize(count);
+		bench::report("compare   (before)", t, n);
+		t = bench::timeIt([&]
+						  { for (size_t i = 1; i < n; i++) count += dates[i - 1] < dates[i]; });
+		bench::doNotOptimize(count);
+		bench::report("compare   (after) ", t, n);
+
+		double sum = 0;
+		t = bench::timeIt([&]
+						  { for (size_t i = 1; i < n; i++) sum += oldDates[i] - oldDates[i - 1]; });
+		bench::doNotOptimize(sum);
+		bench::report("difference(before)", t, n);
+		t = bench::timeIt([&]
+						  { for (size_t i = 1; i < n; i++) sum += dates[i] - dates[i - 1]; });
+		bench::doNotOptimize(sum);
+		bench::report("difference(after) ", t, n);
+
+		long serials = 0;
+		t = bench::timeIt([&]
+						  { for (size_t i = 0; i < n; i++) serials += legacy::addMonths(oldDates[i], 6).getSerialDate(); });
+		bench::doNotOptimize(serials);
+		bench::report("addTenor  (before)", t, n);
+		t = bench::timeIt([&]
+						  { for (size_t i = 0; i < n; i++) serials += dateAddTenor(dates[i], "6M").getSerialDate(); });
+		bench::doNotOptimize(serials);
+		bench::report("addTenor  (after) ", t, n);
+		t = bench::timeIt([&]
+						  { for (size_t i = 0; i < n; i++) serials += dateAddTenor(dates[i], 6, 'M').getSerialDate(); });
+		bench::doNotOptimize(serials);
+		bench::report("addTenor  (after, parsed tenor)", t, n);
+		return 0;
+	}
+
+	// a usd-like curve with the tenors of usd_curve.txt
+	RateCurve sampleCurve(const Date &asOf)
+	{
+		RateCurve rc("USD-SOFR");
+		rc._asOf = asOf;
+		const char *tenors[] = {"ON", "3M", "6M", "9M", "1Y", "2Y", "3Y", "5Y", "7Y", "10Y", "15Y", "20Y", "30Y"};
+		double rate = 0.055;
+		for (auto t : tenors)
+		{
+			rc.addRate(dateAddTenor(asOf, t), rate);
+			rate -= 0.0015;
+		}
+		return rc;
+	}
+
+	// a 40 pillar curve from deposits and semi-annual par swaps, rebuilt per tick
+	int benchBootstrap()
+	{
+		Date asOf(2025, 1, 1);
+		vector<CurveQuote> instruments;
+		vector<double> quotes;
+		for (const char *t : {"ON", "1M", "2M", "3M", "6M", "9M"})
+			instruments.push_back({CurveQuote::Deposit, t});
+		for (int y = 1; y <= 30; y++)
+			instruments.push_back({CurveQuote::ParSwap, to_string(y) + "Y", 0.5});
+		for (int y : {35, 40, 45, 50})
+			instruments.push_back({CurveQuote::ParSwap, to_string(y) + "Y", 0.5});
+		for (size_t i = 0; i < instruments.size(); i++)
+			quotes.push_back(0.045 - 0.01 * std::exp(-0.15 * i) + 0.0001 * (i % 3));
+
+		CurveBootstrapper boot("USD-SOFR", asOf, instruments);
+		shared_ptr<RateCurve> curve;
+		const int nTicks = 2000;
+		std::mt19937_64 rng(3);
+		std::normal_distribution<double> tick(0.0, 0.00005);
+		vector<double> live = quotes;
+		double t = bench::timeIt([&]
+								 {
+			for (int k = 0; k < nTicks; k++)
+			{
+				live[k % live.size()] = quotes[k % live.size()] + tick(rng);
+				curve = boot.build(live);
+			} });
+		bench::report("bootstrap 40 pillars, " + to_string(nTicks) + " ticks", t, nTicks);
+		cout << "  " << t / nTicks * 1e6 << " us per build" << endl;
+		curve = boot.build(quotes);
+		cout << "  " << boot.iterations() << " newton iterations for 34 swap pillars" << endl;
+
+		// the built curve reprices every par swap through Swap::Pv
+		Market mkt(asOf);
+		mkt.addCurve("USD-SOFR", curve);
+		double worst = 0;
+		for (size_t i = 0; i < instruments.size(); i++)
+			if (instruments[i].kind == CurveQuote::ParSwap)
+			{
+				Swap par("USD-SOFR", asOf, dateAddTenor(asOf, instruments[i].tenor), 1e6, quotes[i], 0.5);
+				worst = std::max(worst, std::abs(par.Pv(mkt)));
+			}
+		cout << "  largest par swap pv, 1mm notional: " << worst << endl;
+
+		// par rate risk of an off pillar swap: Jacobian solve vs bump and rebuild
+		Swap trade("USD-SOFR", asOf, Date(2032, 7, 1), 1e7, 0.04, 0.5);
+		vector<double> zeroSens;
+		trade.PvAdjoint(mkt, zeroSens);
+		vector<double> parSens;
+		double tRisk = bench::timeIt([&]
+									 { parSens = boot.parRisk(zeroSens); });
+		const double h = 1e-6;
+		vector<double> bumpSens(quotes.size());
+		double tBump = bench::timeIt([&]
+									 {
+			for (size_t i = 0; i < quotes.size(); i++)
+			{
+				vector<double> up = quotes, down = quotes;
+				up[i] += h;
+				down[i] -= h;
+				Market mu = mkt, md = mkt;
+				mu.setCurve("USD-SOFR", boot.build(up));
+				md.setCurve("USD-SOFR", boot.build(down));
+				bumpSens[i] = (trade.Pv(mu) - trade.Pv(md)) / (2 * h);
+			} });
+		boot.build(quotes);
+		double diff = 0, scale = 0;
+		for (size_t i = 0; i < quotes.size(); i++)
+		{
+			diff = std::max(diff, std::abs(parSens[i] - bumpSens[i]));
+			scale = std::max(scale, std::abs(bumpSens[i]));
+		}
+		cout << "  par risk, jacobian " << tRisk * 1e6 << " us vs bump and rebuild " << tBump * 1e6 << " us, largest difference "
+			 << diff / scale << " of the largest bucket" << endl;
+		return 0;
+	}
+
+	int benchCurve()
+	{
+		Date asOf(2025, 1, 1);
+		std::mt19937 gen(7);
+		std::uniform_int_distribution<int> dayDist(0, 365 * 30);
+
+		for (size_t n : {size_t(10000), size_t(100000), size_t(1000000), size_t(10000000)})
+		{
+			vector<Date> dates(n);
+			for (auto &d : dates)
+				d = Date::fromSerial(asOf.getSerialDate() + dayDist(gen));
+			vector<Date> sorted = dates;
+			std::sort(sorted.begin(), sorted.end());
+			vector<double> ref(n), out(n);
+
+			cout << "--- " << n << " lookups ---" << endl;
+			RateCurve rc = sampleCurve(asOf);
+			double t = bench::timeIt([&]
+									 { for (size_t i = 0; i < n; i++) ref[i] = legacy::scalarDf(rc, dates[i]); });
+			bench::report("scalar getDf loop        ", t, n);
+
+			// a fresh copy has no day table, so the batch call runs the interpolation + SIMD exp kernel
+			RateCurve batchCurve = rc;
+			t = bench::timeIt([&]
+							  { batchCurve.getDfs(dates, out); });
+			bench::report("getDfs, unsorted         ", t, n);
+			double maxErr = 0;
+			for (size_t i = 0; i < n; i++)
+				maxErr = std::max(maxErr, std::abs(out[i] / ref[i] - 1));
+
+			t = bench::timeIt([&]
+							  { batchCurve.getDfs(sorted, out); });
+			bench::report("getDfs, sorted (merge)   ", t, n);
+
+			RateCurve tableCurve = rc;
+			tableCurve.getDf(asOf); // builds the day table
+			t = bench::timeIt([&]
+							  { tableCurve.getDfs(dates, out); });
+			bench::report("getDfs, day table        ", t, n);
+			cout << "max relative error vs scalar: " << maxErr << endl;
+		}
+		return 0;
+	}
+
+	int benchMarket()
+	{
+		Date asOf(2025, 1, 1);
+		Market base(asOf);
+		base.addCurve("USD-SOFR", make_shared<RateCurve>(sampleCurve(asOf)));
+		base.addCurve("SGD-SORA", make_shared<RateCurve>(sampleCurve(asOf)));
+		base.addStockPrice("APPL", 652.0);
+		base.getCurve("USD-SOFR")->getDf(asOf); // day table built once on the base curve
+
+		const size_t n = 10000;
+		vector<Market> scenarios;
+		scenarios.reserve(n);
+		double t = bench::timeIt([&]
+								 {
+			for (size_t i = 0; i < n; i++)
+			{
+				scenarios.push_back(base);
+				if (i % 2)
+					scenarios.back().shockCurve("USD-SOFR", Date(), 0.0001);
+				else
+					scenarios.back().shockPrice("APPL", 1.0);
+			} });
+		bench::report("shocked market views", t, n);
+		// unshocked curves still point at the base curve and its day table
+		cout << "references to the one base SGD curve: " << base.getCurve("SGD-SORA").use_count() - 1 << endl;
+		return 0;
+	}
+
+	// adjoint curve sensitivities of swaps and bonds against central difference bumps
+	int benchAad()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt(asOf);
+		mkt.addCurve("USD-SOFR", make_shared<RateCurve>(sampleCurve(asOf)));
+		const double bump = 0.0001;
+		const auto &pillars = mkt.getCurve("USD-SOFR")->getTenors();
+
+		vector<Swap> swaps;
+		vector<Bond> bonds;
+		swaps.reserve(30);
+		bonds.reserve(30);
+		for (int y = 1; y <= 30; y++)
+		{
+			swaps.emplace_back("USD-SOFR", Date(2024, 7, 3), dateAddTenor(Date(2024, 7, 3), y, 'Y'), (y % 2 ? 1 : -1) * 1e7, 0.04, 0.25);
+			bonds.emplace_back("USD-GOV", Date(2024, 3, 1), dateAddTenor(Date(2024, 3, 1), y, 'Y'), 1e6, 0.035, 0.5);
+		}
+
+		// bumped markets, one up/down pair per pillar plus a parallel pair
+		vector<Market> up, down;
+		for (const auto &p : pillars)
+		{
+			up.push_back(mkt);
+			up.back().shockCurve("USD-SOFR", p, bump);
+			down.push_back(mkt);
+			down.back().shockCurve("USD-SOFR", p, -bump);
+		}
+		Market parUp = mkt, parDown = mkt;
+		parUp.shockCurve("USD-SOFR", Date(), bump);
+		parDown.shockCurve("USD-SOFR", Date(), -bump);
+
+		auto compare = [&](const string &name, auto &trades)
+		{
+			double maxDiff = 0, maxDv01 = 0;
+			vector<double> sens;
+			for (auto &trade : trades)
+			{
+				trade.PvAdjoint(mkt, sens);
+				double total = 0;
+				for (size_t j = 0; j < pillars.size(); j++)
+				{
+					double fd = (trade.Pv(up[j]) - trade.Pv(down[j])) / 2.0;
+					maxDiff = std::max(maxDiff, std::abs(fd - sens[j] * bump));
+					total += sens[j] * bump;
+				}
+				// same number as RiskEngine::computeRisk("dv01")
+				double dv01 = (trade.Pv(parUp) - trade.Pv(parDown)) / 2.0;
+				maxDiff = std::max(maxDiff, std::abs(dv01 - total));
+				maxDv01 = std::max(maxDv01, std::abs(dv01));
+			}
+			cout << name << ": max |adjoint - central difference| = " << maxDiff << " (largest dv01 " << maxDv01 << ")" << endl;
+
+			const int reps = 200;
+			double pvSum = 0;
+			double tBump = bench::timeIt([&]
+										 {
+				for (int r = 0; r < reps; r++)
+					for (auto &trade : trades)
+						for (size_t j = 0; j < pillars.size(); j++)
+							pvSum += trade.Pv(up[j]) - trade.Pv(down[j]); });
+			double tAdj = bench::timeIt([&]
+										{
+				for (int r = 0; r < reps; r++)
+					for (auto &trade : trades)
+						pvSum += trade.PvAdjoint(mkt, sens); });
+			bench::doNotOptimize(pvSum);
+			bench::report(name + " bump and reval, all pillars", tBump, reps * trades.size());
+			bench::report(name + " adjoint, all pillars       ", tAdj, reps * trades.size());
+		};
+		compare("swap", swaps);
+		compare("bond", bonds);
+		return 0;
+	}
+
+	// a market with APPL, a flat-ish vol curve and the usd curve, for option benchmarks
+	Market sampleEquityMarket(const Date &asOf)
+	{
+		Market mkt(asOf);
+		mkt.addCurve("USD-SOFR", make_shared<RateCurve>(sampleCurve(asOf)));
+		auto vol = make_shared<VolCurve>("LOGVOL");
+		vol->_asOf = asOf;
+		vol->addVol(dateAddTenor(asOf, "1M"), 0.25);
+		vol->addVol(dateAddTenor(asOf, "1Y"), 0.22);
+		vol->addVol(dateAddTenor(asOf, "5Y"), 0.20);
+		mkt.addVolCurve("LOGVOL", vol);
+		mkt.addStockPrice("APPL", 652.0);
+		return mkt;
+	}
+
+	// a mixed book in turn swap, bond, european, american, 1 to 20 years, starts spread over
+	// half a year. an eighth of the swaps and bonds are in sgd, SGD-SORA is added to mkt. the
+	// options cycle through stocks (priced in mkt), strikes 0.8 to 1.19 of spot
+	vector<shared_ptr<Trade>> sampleMixedBook(Market &mkt, size_t nTrades, const vector<string> &stocks)
+	{
+		const Date asOf = mkt.asOf;
+		mkt.addCurve("SGD-SORA", make_shared<RateCurve>(sampleCurve(asOf)));
+		vector<shared_ptr<Trade>> book;
+		book.reserve(nTrades);
+		for (size_t i = 0; i < nTrades; i++)
+		{
+			int y = 1 + i % 20;
+			Date start = dateAddTenor(Date(2024, 7, 3), (int)(i % 180), 'D');
+			const string &stock = stocks[i / 4 % stocks.size()];
+			double strike = mkt.getStockPrice(stock) * (0.8 + 0.01 * (i % 40));
+			switch (i % 4)
+			{
+			case 0:
+				book.push_back(make_shared<Swap>(i % 8 ? "USD-SOFR" : "SGD-SORA", start, dateAddTenor(start, y, 'Y'), 1e7, 0.04, 0.25));
+				break;
+			case 1:
+				book.push_back(make_shared<Bond>(i % 8 == 1 ? "SGD-GOV" : "USD-GOV", start, dateAddTenor(start, y, 'Y'), 1e6, 0.035, 0.5));
+				break;
+			case 2:
+				book.push_back(make_shared<EuropeanOption>(i % 8 == 2 ? Call : Put, 100, strike, asOf, dateAddTenor(asOf, 1 + y % 4, 'Y'), stock));
+				break;
+			default:
+				book.push_back(make_shared<AmericanOption>(i % 8 == 3 ? Call : Put, 100, strike, asOf, dateAddTenor(asOf, 1 + y % 4, 'Y'), stock));
+			}
+		}
+		return book;
+	}
+
+	int benchTree()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		EuropeanOption euro(Call, 1, 625, asOf, Date(2026, 1, 1), "APPL");
+		AmericanOption amer(Put, 1, 680, asOf, Date(2026, 1, 1), "APPL");
+
+		for (int N : {50, 500, 5000})
+		{
+			cout << "--- N = " << N << " ---" << endl;
+			int reps = 5000000 / (N * N / 10 + 100) + 1;
+			for (const TreeProduct *trade : {(const TreeProduct *)&euro, (const TreeProduct *)&amer})
+			{
+				string name = trade == &euro ? "european call" : "american put ";
+				legacy::CRRTreePricer before(N);
+				CRRBinomialTreePricer after(N);
+				double pvBefore = 0, pvAfter = 0;
+				double tBefore = bench::timeIt([&]
+											   { for (int r = 0; r < reps; r++) pvBefore = before.PriceTree(mkt, *trade); });
+				double tAfter = bench::timeIt([&]
+											  { for (int r = 0; r < reps; r++) pvAfter = after.PriceTree(mkt, *trade); });
+				double nodes = reps * (N + 1.0) * (N + 2.0) / 2.0;
+				bench::report(name + " before", tBefore, nodes);
+				bench::report(name + " after ", tAfter, nodes);
+				cout << "  trees/s before " << reps / tBefore << ", after " << reps / tAfter
+					 << ", pv " << pvBefore << " vs " << pvAfter << endl;
+			}
+		}
+		return 0;
+	}
+
+	// relative error versus BlackPv against cpu time, per tree method
+	int benchTreeAccuracy()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		EuropeanOption call(Call, 1, 625, asOf, Date(2026, 1, 1), "APPL");
+		EuropeanOption put(Put, 1, 680, asOf, Date(2026, 1, 1), "APPL");
+
+		auto measure = [&](const string &name, BinomialTreePricer &pricer)
+		{
+			double worst = 0, pv = 0;
+			int reps = 0;
+			try
+			{
+				pricer.PriceTree(mkt, call);
+			}
+			catch (const runtime_error &e)
+			{
+				cout << name << ": " << e.what() << endl;
+				return;
+			}
+			double t = bench::timeIt([&]
+									 {
+				// repeat for at least ~50ms worth of prices
+				auto t0 = std::chrono::steady_clock::now();
+				do
+				{
+					for (const EuropeanOption *opt : {&call, &put})
+					{
+						pv = pricer.PriceTree(mkt, *opt);
+						worst = std::max(worst, std::abs(pv / opt->BlackPv(mkt) - 1));
+					}
+					reps++;
+				} while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50)); });
+			cout << name << ": max rel error " << worst << ", " << t / (2 * reps) * 1e6 << " us per price" << endl;
+		};
+
+		for (int N : {25, 50, 101, 201, 401, 801, 1601})
+		{
+			cout << "--- N = " << N << " ---" << endl;
+			CRRBinomialTreePricer crr(N);
+			LeisenReimerTreePricer lr(N);
+			BBSRTreePricer bbsr(N);
+			measure("CRR          ", crr);
+			measure("Leisen-Reimer", lr);
+			measure("BBSR         ", bbsr);
+		}
+		cout << "--- automatic steps, tolerance 1e-5 ---" << endl;
+		CRRBinomialTreePricer crr(50);
+		LeisenReimerTreePricer lr(50);
+		BBSRTreePricer bbsr(50);
+		for (BinomialTreePricer *pricer : {(BinomialTreePricer *)&crr, (BinomialTreePricer *)&lr, (BinomialTreePricer *)&bbsr})
+			pricer->SetTolerance(1e-5);
+		measure("CRR          ", crr);
+		measure("Leisen-Reimer", lr);
+		measure("BBSR         ", bbsr);
+		return 0;
+	}
+
+	// american put, time to a given accuracy of the trees against the crank-nicolson grid
+	int benchFiniteDifference()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		AmericanOption put(Put, 1, 680, asOf, Date(2026, 1, 1), "APPL");
+		const double reference = BBSRTreePricer(20001).PriceTree(mkt, put);
+		cout << "reference (BBSR, 20001 steps) " << reference << endl;
+
+		auto measure = [&](const string &name, BinomialTreePricer &pricer)
+		{
+			double pv = 0;
+			int reps = 0;
+			double t = bench::timeIt([&]
+									 {
+				auto t0 = std::chrono::steady_clock::now();
+				do
+				{
+					pv = pricer.PriceTree(mkt, put);
+					reps++;
+				} while (std::chrono::steady_clock::now() - t0 < std::chrono::milliseconds(50)); });
+			cout << name << ": rel error " << std::abs(pv / reference - 1) << ", " << t / reps * 1e6 << " us per price" << endl;
+		};
+
+		for (int N : {25, 50, 101, 201, 401, 801, 1601})
+		{
+			cout << "--- N = " << N << " ---" << endl;
+			CRRBinomialTreePricer crr(N);
+			LeisenReimerTreePricer lr(N);
+			BBSRTreePricer bbsr(N);
+			FiniteDifferencePricer fd(N);
+			measure("CRR          ", crr);
+			measure("Leisen-Reimer", lr);
+			measure("BBSR         ", bbsr);
+			if (N <= 201) // past the accuracy of the reference already
+				measure("CN grid      ", fd);
+		}
+
+		// greeks read off one solve vs bumping the tree
+		cout << "--- greeks, european put ---" << endl;
+		EuropeanOption euro(Put, 1, 680, asOf, Date(2026, 1, 1), "APPL");
+		OptionGreeks black = euro.BlackGreeks(mkt);
+		FiniteDifferencePricer fd(50);
+		OptionGreeks grid;
+		double tGrid = bench::timeIt([&]
+									 { grid = fd.PriceGreeks(mkt, euro); });
+		LeisenReimerTreePricer lr(401);
+		double bumped[3];
+		const double h = 0.01 * mkt.getStockPrice("APPL");
+		double tBump = bench::timeIt([&]
+									 {
+			for (int k = 0; k < 3; k++)
+			{
+				Market shifted = mkt;
+				shifted.shockPrice("APPL", (k - 1) * h);
+				bumped[k] = lr.PriceTree(shifted, euro);
+			} });
+		cout << "black       delta " << black.delta << ", gamma " << black.gamma << ", theta " << black.theta << endl;
+		cout << "CN grid     delta " << grid.delta << ", gamma " << grid.gamma << ", theta " << grid.theta << ", " << tGrid * 1e6 << " us" << endl;
+		cout << "LR bumped   delta " << (bumped[2] - bumped[0]) / (2 * h) << ", gamma " << (bumped[2] - 2 * bumped[1] + bumped[0]) / (h * h) << ", " << tBump * 1e6 << " us" << endl;
+		return 0;
+	}
+
+	// a strike ladder on one underlying and expiry, one tree per trade vs one tree per ladder
+	int benchStrikes()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		const int nStrikes = 1000;
+		vector<shared_ptr<Trade>> euros, amers;
+		for (int k = 0; k < nStrikes; k++)
+		{
+			double strike = 400 + 0.5 * k;
+			OptionType type = k % 2 ? Put : Call;
+			euros.push_back(make_shared<EuropeanOption>(type, 1, strike, asOf, Date(2026, 1, 1), "APPL"));
+			amers.push_back(make_shared<AmericanOption>(type, 1, strike, asOf, Date(2026, 1, 1), "APPL"));
+		}
+
+		for (int N : {50, 200, 1000})
+		{
+			cout << "--- N = " << N << ", " << nStrikes << " strikes ---" << endl;
+			for (auto *book : {&euros, &amers})
+			{
+				string name = book == &euros ? "european" : "american";
+				CRRBinomialTreePricer pricer(N);
+				vector<double> single(nStrikes), batched;
+				double tSingle = bench::timeIt([&]
+											   { for (int k = 0; k < nStrikes; k++) single[k] = pricer.Price(mkt, (*book)[k]); });
+				double tBatch = bench::timeIt([&]
+											  { pricer.PricePortfolio(mkt, *book, batched); });
+				double maxDiff = 0;
+				for (int k = 0; k < nStrikes; k++)
+					maxDiff = std::max(maxDiff, std::abs(single[k] - batched[k]));
+				double nodes = nStrikes * (N + 1.0) * (N + 2.0) / 2.0;
+				bench::report(name + " tree per trade", tSingle, nodes);
+				bench::report(name + " one tree      ", tBatch, nodes);
+				cout << "  speedup " << tSingle / tBatch << "x, max |pv diff| " << maxDiff << endl;
+			}
+		}
+		return 0;
+	}
+
+	// closed form greeks: scalar bs::greeks vs bs::greeksBatch vs the 50 step tree
+	int benchBlackScholes()
+	{
+		const size_t n = 200000;
+		std::mt19937_64 rng(7);
+		std::uniform_real_distribution<double> strike(400, 900), expiry(0.02, 3), rate(0, 0.06), vol(0.1, 0.6);
+		const OptionType kinds[] = {Call, Put, BinaryCall, BinaryPut};
+		vector<OptionType> types(n);
+		vector<double> S(n, 652.0), K(n), T(n), r(n), sigma(n);
+		for (size_t i = 0; i < n; i++)
+		{
+			types[i] = kinds[i % 4];
+			K[i] = strike(rng);
+			T[i] = i % 97 == 0 ? 0.0 : expiry(rng); // a few expired ones
+			r[i] = rate(rng);
+			sigma[i] = vol(rng);
+		}
+
+		vector<OptionGreeks> ref(n);
+		vector<double> pv(n), delta(n), gamma(n), vega(n), theta(n);
+		double tScalar = bench::timeIt([&]
+									   { for (size_t i = 0; i < n; i++) ref[i] = bs::greeks(types[i], S[i], K[i], T[i], r[i], sigma[i]); });
+		double tPv = bench::timeIt([&]
+								   { bs::greeksBatch(n, types.data(), S.data(), K.data(), T.data(), r.data(), sigma.data(), pv.data()); });
+		double tAll = bench::timeIt([&]
+									{ bs::greeksBatch(n, types.data(), S.data(), K.data(), T.data(), r.data(), sigma.data(),
+													  pv.data(), delta.data(), gamma.data(), vega.data(), theta.data()); });
+		bench::report("scalar greeks        ", tScalar, n);
+		bench::report("batch, pv only       ", tPv, n);
+		bench::report("batch, pv and greeks ", tAll, n);
+
+		// batch vs scalar, relative to the size of each greek so deep otm options do not dominate
+		double err[5] = {0, 0, 0, 0, 0}, scale[5] = {0, 0, 0, 0, 0};
+		for (size_t i = 0; i < n; i++)
+		{
+			double a[5] = {pv[i], delta[i], gamma[i], vega[i], theta[i]};
+			double b[5] = {ref[i].pv, ref[i].delta, ref[i].gamma, ref[i].vega, ref[i].theta};
+			for (int g = 0; g < 5; g++)
+			{
+				err[g] = std::max(err[g], std::abs(a[g] - b[g]));
+				scale[g] = std::max(scale[g], std::abs(b[g]));
+			}
+		}
+		const char *names[] = {"pv", "delta", "gamma", "vega", "theta"};
+		cout << "batch vs scalar, max abs diff / max abs value:";
+		for (int g = 0; g < 5; g++)
+			cout << " " << names[g] << " " << err[g] / scale[g];
+		cout << endl;
+
+		// analytic greeks vs central differences of bs::price
+		double fdErr[4] = {0, 0, 0, 0};
+		for (size_t i = 0; i < 2000; i++)
+		{
+			if (T[i] <= 0)
+				continue;
+			auto px = [&](double s, double t, double v)
+			{ return bs::price(types[i], s, K[i], t, r[i], v); };
+			double hS = 1e-4 * S[i], hV = 1e-5, hT = 1e-6;
+			double fd[4] = {(px(S[i] + hS, T[i], sigma[i]) - px(S[i] - hS, T[i], sigma[i])) / (2 * hS),
+							(px(S[i] + hS, T[i], sigma[i]) - 2 * px(S[i], T[i], sigma[i]) + px(S[i] - hS, T[i], sigma[i])) / (hS * hS),
+							(px(S[i], T[i], sigma[i] + hV) - px(S[i], T[i], sigma[i] - hV)) / (2 * hV),
+							-(px(S[i], T[i] + hT, sigma[i]) - px(S[i], T[i] - hT, sigma[i])) / (2 * hT)};
+			double an[4] = {ref[i].delta, ref[i].gamma, ref[i].vega, ref[i].theta};
+			for (int g = 0; g < 4; g++)
+				fdErr[g] = std::max(fdErr[g], std::abs(fd[g] - an[g]) / std::max(std::abs(an[g]), 1e-3));
+		}
+		cout << "analytic vs central difference, max rel diff: delta " << fdErr[0] << " gamma " << fdErr[1]
+			 << " vega " << fdErr[2] << " theta " << fdErr[3] << endl;
+
+		// what the analytic mode replaces: a 50 step tree per european
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		vector<shared_ptr<Trade>> book;
+		for (size_t i = 0; i < 10000; i++)
+			book.push_back(make_shared<EuropeanOption>(types[i], 1, K[i], asOf, dateAddTenor(asOf, 1 + (int)(T[i] * 365), 'D'), "APPL"));
+		CRRBinomialTreePricer tree(50), analytic(50);
+		analytic.SetAnalyticEuropean(true);
+		vector<double> treePvs, analyticPvs;
+		double tTree = bench::timeIt([&]
+									 { tree.PricePortfolio(mkt, book, treePvs); });
+		double tAnalytic = bench::timeIt([&]
+										 { analytic.PricePortfolio(mkt, book, analyticPvs); });
+		bench::report("book of 10000 europeans, tree    ", tTree, book.size());
+		bench::report("book of 10000 europeans, analytic", tAnalytic, book.size());
+		return 0;
+	}
+
+	// implied vols of a smile chain priced with bs::price: a generic bisection one quote at a
+	// time vs the scalar solver vs the batch, then the atm curve built on the pool
+	int benchImpliedVol()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		const double S = mkt.getStockPrice("APPL");
+		auto curve = mkt.getCurve("USD-SOFR");
+		const size_t n = 200000;
+		OptionQuotes quotes;
+		for (const char *t : {"1M", "3M", "6M", "9M", "1Y", "2Y", "5Y", "10Y"})
+			quotes.expiries.push_back(dateAddTenor(asOf, t));
+		const size_t m = quotes.expiries.size();
+		vector<double> atm(m), T(m), r(m), fwd(m);
+		for (size_t e = 0; e < m; e++)
+		{
+			T[e] = (quotes.expiries[e] - asOf) / 365.0;
+			r[e] = curve->getRate(quotes.expiries[e]);
+			fwd[e] = S * std::exp(r[e] * T[e]);
+			atm[e] = 0.15 + 0.1 * std::exp(-2 * T[e]);
+		}
+		// skew and curvature in log moneyness, strikes out to 4 atm deviations on both sides, every
+		// other quote in the money
+		auto smile = [&](size_t e, double k)
+		{ return atm[e] * (1 - 0.2 * k + 0.3 * k * k); };
+		vector<double> trueVol(n), Sv(n, S), Tv(n), rv(n);
+		std::mt19937_64 rng(11);
+		std::uniform_real_distribution<double> dev(-4, 4);
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t e = (uint32_t)(i % m);
+			double k = dev(rng) * atm[e] * std::sqrt(T[e]);
+			double K = fwd[e] * std::exp(k);
+			OptionType type = (k > 0) == (i / m % 2 == 0) ? Call : Put;
+			trueVol[i] = smile(e, k);
+			Tv[i] = T[e];
+			rv[i] = r[e];
+			quotes.add(e, type, K, bs::price(type, S, K, T[e], r[e], trueVol[i]));
+		}
+
+		const size_t nGeneric = 10000;
+		vector<double> generic(nGeneric), scalar(n), batch(n), pooled;
+		double tGeneric = bench::timeIt([&]
+										{
+			for (size_t i = 0; i < nGeneric; i++)
+			{
+				double lo = 1e-4, hi = 5;
+				for (int k = 0; k < 60; k++)
+				{
+					double mid = 0.5 * (lo + hi);
+					(bs::price(quotes.type[i], S, quotes.strike[i], Tv[i], rv[i], mid) > quotes.price[i] ? hi : lo) = mid;
+				}
+				generic[i] = 0.5 * (lo + hi);
+			} });
+		double tScalar = bench::timeIt([&]
+									   { for (size_t i = 0; i < n; i++) scalar[i] = bs::impliedVol(quotes.type[i], quotes.price[i], S, quotes.strike[i], Tv[i], rv[i]); });
+		double tBatch = bench::timeIt([&]
+									  { bs::impliedVolBatch(n, quotes.type.data(), quotes.price.data(), Sv.data(), quotes.strike.data(), Tv.data(), rv.data(), batch.data()); });
+		ThreadPool &pool = defaultThreadPool();
+		double tPool = bench::timeIt([&]
+									 { impliedVols(mkt, "APPL", "USD-SOFR", quotes, pooled, pool); });
+		bench::report("bisection on bs::price, one at a time ", tGeneric, nGeneric);
+		bench::report("scalar impliedVol                     ", tScalar, n);
+		bench::report("impliedVolBatch, 1 thread             ", tBatch, n);
+		bench::report("impliedVols, " + to_string(pool.size()) + " threads                ", tPool, n);
+
+		// out of the money quotes carry the whole price in time value, in the money ones lose
+		// digits to the intrinsic value before any solver sees them
+		double err[2][3] = {}, bisectErr = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			bool itm = (quotes.type[i] == Call) == (quotes.strike[i] < fwd[quotes.expiry[i]]);
+			double v[3] = {scalar[i], batch[i], pooled[i]};
+			for (int s = 0; s < 3; s++)
+				err[itm][s] = std::max(err[itm][s], std::abs(v[s] / trueVol[i] - 1));
+			if (i < nGeneric)
+				bisectErr = std::max(bisectErr, std::abs(generic[i] / trueVol[i] - 1));
+		}
+		cout << "max relative vol error, otm: scalar " << err[0][0] << " batch " << err[0][1] << " pool " << err[0][2]
+			 << ", itm: scalar " << err[1][0] << " batch " << err[1][1] << " pool " << err[1][2]
+			 << ", bisection " << bisectErr << endl;
+
+		shared_ptr<VolCurve> vc;
+		double tCurve = bench::timeIt([&]
+									  { vc = buildAtmVolCurve("LOGVOL", mkt, "APPL", "USD-SOFR", quotes, pool); });
+		double atmErr = 0;
+		for (size_t e = 0; e < m; e++)
+			atmErr = std::max(atmErr, std::abs(vc->getVol(quotes.expiries[e]) - atm[e]));
+		bench::report("buildAtmVolCurve                      ", tCurve, n);
+		cout << "atm curve vs the smile at the forward, max abs diff " << atmErr << " over " << m << " expiries" << endl;
+		return 0;
+	}
+
+	// many tiny tasks, 1 to 64 workers, old single queue pool vs the work stealing pool.
+	// flat: the main thread enqueues everything. nested: 64 tasks each enqueue their children
+	// from a worker, which the old pool funnels through the same lock
+	int benchPool()
+	{
+		const size_t nTasks = 200000;
+		const size_t nParents = 64;
+		atomic<size_t> done{0};
+		double sink[4] = {1, 2, 3, 4}; // captured by every task so the closure is 40 bytes
+		auto work = [&done, &sink](size_t i)
+		{
+			bench::doNotOptimize(sink[i & 3] * i);
+			done.fetch_add(1, memory_order_relaxed);
+		};
+		auto waitAll = [&done](size_t n)
+		{
+			while (done.load() < n)
+				this_thread::yield();
+		};
+
+		for (size_t nThreads : {1, 2, 4, 8, 16, 32, 64})
+		{
+			cout << "--- " << nThreads << " threads ---" << endl;
+			double tOldFlat, tNewFlat, tOldNested, tNewNested, tParallelFor;
+			{
+				legacy::ThreadPool pool(nThreads);
+				done = 0;
+				tOldFlat = bench::timeIt([&]
+										 {
+					for (size_t i = 0; i < nTasks; i++)
+						pool.enqueue([&work, &sink, &done, i] { work(i); bench::doNotOptimize(sink[0]); bench::doNotOptimize(done.load(memory_order_relaxed)); });
+					waitAll(nTasks); });
+				done = 0;
+				tOldNested = bench::timeIt([&]
+										   {
+					for (size_t p = 0; p < nParents; p++)
+						pool.enqueue([&, p]
+									 {
+							for (size_t i = p; i < nTasks; i += nParents)
+								pool.enqueue([&work, i] { work(i); }); });
+					waitAll(nTasks); });
+			}
+			{
+				ThreadPool pool(nThreads);
+				done = 0;
+				tNewFlat = bench::timeIt([&]
+										 {
+					for (size_t i = 0; i < nTasks; i++)
+						pool.enqueue([&work, &sink, &done, i] { work(i); bench::doNotOptimize(sink[0]); bench::doNotOptimize(done.load(memory_order_relaxed)); });
+					waitAll(nTasks); });
+				done = 0;
+				tNewNested = bench::timeIt([&]
+										   {
+					for (size_t p = 0; p < nParents; p++)
+						pool.enqueue([&, p]
+									 {
+							for (size_t i = p; i < nTasks; i += nParents)
+								pool.enqueue([&work, i] { work(i); }); });
+					waitAll(nTasks); });
+				done = 0;
+				tParallelFor = bench::timeIt([&]
+											 { pool.parallel_for(0, nTasks, work, 1); });
+			}
+			bench::report("flat   enqueue, old pool ", tOldFlat, nTasks);
+			bench::report("flat   enqueue, new pool ", tNewFlat, nTasks);
+			bench::report("nested enqueue, old pool ", tOldNested, nTasks);
+			bench::report("nested enqueue, new pool ", tNewNested, nTasks);
+			bench::report("parallel_for, grain 1    ", tParallelFor, nTasks);
+		}
+		return 0;
+	}
+
+	// dv01 and vega of a mixed book: the old per trade RiskEngine loop vs computePortfolioRisk
+	int benchPortfolioRisk()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		const size_t nTrades = 20000;
+		vector<shared_ptr<Trade>> book = sampleMixedBook(mkt, nTrades, {"APPL"});
+
+		// the old loop prints from every decorator, keep that out of the report
+		const size_t nOld = 400;
+		std::ostringstream sink;
+		auto *coutBuf = cout.rdbuf(sink.rdbuf());
+		double tOld = bench::timeIt([&]
+									{
+			for (size_t i = 0; i < nOld; i++)
+			{
+				RiskEngine risk(mkt, 0.0001, 0.01, 1.0);
+				risk.computeRisk("dv01", book[i], true);
+				risk.computeRisk("vega", book[i], true);
+			} });
+		cout.rdbuf(coutBuf);
+		bench::report("per trade RiskEngine, first 400 trades", tOld, nOld);
+
+		std::ostringstream quiet;
+		coutBuf = cout.rdbuf(quiet.rdbuf());
+		RiskEngine engine(mkt, 0.0001, 0.01, 1.0);
+		cout.rdbuf(coutBuf);
+		for (size_t nThreads : {1, 2, 4, 8})
+		{
+			ThreadPool pool(nThreads);
+			PortfolioRisk risk;
+			double t = bench::timeIt([&]
+									 { risk = engine.computePortfolioRisk(book, pool); });
+			bench::report("computePortfolioRisk, " + to_string(nThreads) + " threads, " + to_string(risk.scenarios.size()) + " scenarios", t, nTrades);
+		}
+		{
+			ThreadPool pool(4);
+			double tSingle = bench::timeIt([&]
+										   {
+				for (size_t i = 0; i < nOld; i++)
+				{
+					engine.computeRisk("dv01", book[i], false);
+					engine.computeRisk("vega", book[i], false);
+				} });
+			double tBatch = bench::timeIt([&]
+										  {
+				engine.computeRiskBatch("dv01", book, pool);
+				engine.computeRiskBatch("vega", book, pool); });
+			bench::report("computeRisk per trade, pooled, first 400", tSingle, nOld);
+			bench::report("computeRiskBatch, 4 threads            ", tBatch, nTrades);
+		}
+		cout << "(" << std::thread::hardware_concurrency() << " hardware threads)" << endl;
+		return 0;
+	}
+	// spot risk of options: a tree per bumped market vs delta and gamma from one extended tree
+	int benchLatticeGreeks()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		mkt.addCurve("SGD-SORA", make_shared<RateCurve>(sampleCurve(asOf))); // the engine shocks it too
+		const size_t nTrades = 2000;
+		const double h = 1.0;
+		vector<shared_ptr<Trade>> book;
+		for (size_t i = 0; i < nTrades; i++)
+		{
+			OptionType type = i % 2 ? Put : Call;
+			Date expiry = dateAddTenor(asOf, 1 + (int)(i % 3), 'Y');
+			if (i % 4 < 2)
+				book.push_back(make_shared<EuropeanOption>(type, 1, 500 + i % 300, asOf, expiry, "APPL"));
+			else
+				book.push_back(make_shared<AmericanOption>(type, 1, 500 + i % 300, asOf, expiry, "APPL"));
+		}
+
+		std::ostringstream quiet;
+		auto *coutBuf = cout.rdbuf(quiet.rdbuf());
+		RiskEngine engine(mkt, 0.0001, 0.01, h);
+		cout.rdbuf(coutBuf);
+
+		ThreadPool one(1);
+		Market up = mkt, down = mkt;
+		up.shockPrice("APPL", h);
+		down.shockPrice("APPL", -h);
+		vector<double> bumpUp(nTrades), bumpDelta(nTrades), bumpGamma(nTrades);
+		double tBump = bench::timeIt([&]
+									 {
+			for (size_t i = 0; i < nTrades; i++)
+			{
+				double base = book[i]->Pv(mkt), pu = book[i]->Pv(up), pd = book[i]->Pv(down);
+				bumpUp[i] = pu - base;
+				bumpDelta[i] = (pu - pd) / (2 * h);
+				bumpGamma[i] = (pu - 2 * base + pd) / (h * h);
+			} });
+		vector<map<string, double>> risk;
+		double tTree = bench::timeIt([&]
+									 { risk = engine.computeRiskBatch("price", book, one); });
+		bench::report("bumped, three trees per option", tBump, nTrades);
+		bench::report("extended tree greeks, one tree ", tTree, nTrades);
+
+		double worst = 0;
+		for (size_t i = 0; i < nTrades; i++)
+			worst = std::max(worst, std::abs(risk[i].at("APPL") - bumpUp[i]));
+		cout << "largest |pv(S + h) - pv(S)| difference " << worst << endl;
+
+		// european deltas against black-scholes, tree greeks vs bumped trees
+		double deltaTree = 0, deltaBump = 0, gammaTree = 0, gammaBump = 0;
+		auto pricer = MakeTreePricer(DefaultTreeOptions());
+		for (size_t i = 0; i < nTrades; i += 4)
+		{
+			auto &opt = static_cast<const EuropeanOption &>(*book[i]);
+			OptionGreeks exact = opt.BlackGreeks(mkt), tree = pricer->PriceGreeks(mkt, opt);
+			deltaTree = std::max(deltaTree, std::abs(tree.delta - exact.delta));
+			deltaBump = std::max(deltaBump, std::abs(bumpDelta[i] - exact.delta));
+			gammaTree = std::max(gammaTree, std::abs(tree.gamma - exact.gamma));
+			gammaBump = std::max(gammaBump, std::abs(bumpGamma[i] - exact.gamma));
+		}
+		cout << "european calls, max error vs black-scholes: delta " << deltaTree << " (bumped " << deltaBump << "), gamma "
+			 << gammaTree << " (bumped " << gammaBump << ")" << endl;
+		return 0;
+	}
+
+	int benchTick()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		const int nStocks = 20;
+		vector<string> stocks;
+		for (int k = 0; k < nStocks; k++)
+		{
+			stocks.push_back("STK" + to_string(k));
+			mkt.addStockPrice(stocks.back(), 100.0 + 10 * k);
+		}
+		// half linear trades, the options spread over the stocks
+		const size_t nTrades = 100000;
+		vector<shared_ptr<Trade>> book = sampleMixedBook(mkt, nTrades, stocks);
+
+		ThreadPool pool(4);
+		PortfolioCache cache(mkt, book, pool);
+		double tFull = bench::timeIt([&]
+									 { cache.refresh(); });
+		bench::report("full reprice, 100000 trades", tFull, nTrades);
+
+		// one stock ticks: only its options are repriced
+		const int nTicks = 20;
+		size_t repriced = 0;
+		double tTicks = bench::timeIt([&]
+									  {
+			for (int k = 0; k < nTicks; k++)
+			{
+				cache.updateStockPrice("STK" + to_string(k % nStocks), 101.0 + 10 * k);
+				repriced += cache.refresh();
+			} });
+		cout << "stock tick reprices " << repriced / nTicks << " trades, tick to pv " << tTicks / nTicks * 1e6 << " us" << endl;
+
+		// the sgd curve moves: its swaps and bonds
+		auto bumped = make_shared<RateCurve>(sampleCurve(asOf));
+		size_t curveRepriced = 0;
+		double tCurve = bench::timeIt([&]
+									  {
+			cache.updateCurve("SGD-SORA", bumped);
+			curveRepriced = cache.refresh(); });
+		cout << "curve tick reprices " << curveRepriced << " trades, tick to pv " << tCurve * 1e6 << " us" << endl;
+		cout << "full reprice per tick would be " << tFull * 1e6 << " us" << endl;
+		return 0;
+	}
+	int benchVar()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		mkt.addStockPrice("MSFT", 420.0);
+		const size_t nTrades = 2000;
+		vector<shared_ptr<Trade>> book = sampleMixedBook(mkt, nTrades, {"APPL", "MSFT", "APPL"});
+
+		// synthetic daily moves in the scenario file format
+		const size_t nScen = 1000;
+		std::mt19937_64 rng(42);
+		std::normal_distribution<double> z(0.0, 1.0);
+		std::ostringstream file;
+		file << "date;curve:USD-SOFR;curve:SGD-SORA;vol:LOGVOL;spot:APPL;spot:MSFT\n";
+		for (size_t s = 0; s < nScen; s++)
+			file << "d" << s << ";" << 0.0005 * z(rng) << ";" << 0.0006 * z(rng) << ";" << 0.01 * z(rng) << ";" << 0.02 * z(rng) << ";" << 0.018 * z(rng) << "\n";
+		const string text = file.str();
+
+		ScenarioEngine engine(mkt, book, defaultThreadPool());
+		{
+			// baseline: every scenario market kept, each trade priced on its own
+			const size_t nNaive = 100;
+			std::istringstream in(text);
+			ScenarioReader reader(in);
+			vector<Scenario> rows;
+			reader.next(nNaive, rows);
+			double t = bench::timeIt([&]
+									 {
+				vector<Market> markets;
+				for (auto &row : rows)
+					markets.push_back(engine.scenarioMarket(reader.factors(), row));
+				vector<double> pnl(markets.size(), 0.0);
+				for (size_t s = 0; s < markets.size(); s++)
+					for (auto &trade : book)
+						pnl[s] += trade->Pv(markets[s]) - trade->Pv(mkt);
+				bench::doNotOptimize(pnl[0]); });
+			bench::report("per trade pv, first " + to_string(nNaive) + " scenarios", t, double(nTrades) * nNaive);
+		}
+		for (size_t budget : {size_t(4) << 20, size_t(256) << 20, size_t(32) << 20})
+		{
+			std::istringstream in(text);
+			ScenarioReader reader(in);
+			VarConfig config;
+			config.memoryBudget = budget;
+			VarResult res;
+			double t = bench::timeIt([&]
+									 { res = engine.run(reader, config); });
+			bench::report("historical var, " + to_string(nTrades) + " trades x " + to_string(nScen) + " scenarios, budget " + to_string(budget >> 20) + " MB, batch " + to_string(res.batchSize), t, double(nTrades) * nScen);
+			cout << "  99% var " << res.var << ", es " << res.es << endl;
+		}
+		return 0;
+	}
+	const char *tradeFileHeader = "id;type;trade_dt;start_dt;end_dt;notional;instrument;rate;strike;freq;option;direction\n";
+
+	// row i of a synthetic trade.txt, every 1000000th one malformed
+	void syntheticTradeLine(size_t i, char *line, size_t size)
+	{
+		const char *types[] = {"swap", "bond", "european", "american"};
+		const char *names[] = {"USD-SOFR", "USD-GOV", "APPL", "APPL"};
+		int k = i % 4, y = 2025 + i % 20, m = 1 + i % 12, d = 1 + i % 28;
+		if (i % 1000000 == 999999)
+			snprintf(line, size, "%zu;swap;2025-01-01;2025-13-03;2030-01-03;1e7;USD-SOFR;0.04;0;0.5;na\n", i + 1);
+		else
+			snprintf(line, size, "%zu;%s;2025-01-01;2025-%02d-%02d;%d-%02d-%02d;%.2f;%s;%.5f;%.3f;%.2f;%s;%s\n",
+					 i + 1, types[k], m, d, y + 1, m, d, 1e6 + 37.5 * (i % 1000), names[k], 0.01 + 1e-5 * (i % 500),
+					 k < 2 ? 0.0 : 500 + 0.125 * (i % 800), k == 1 ? 0.5 : 0.25, k < 2 ? "na" : i % 8 < 4 ? "call" : "put", i % 3 ? "pay" : "receive");
+	}
+
+	int benchLoader()
+	{
+		const size_t nRows = 10000000;
+		const string fileName = "/tmp/bench_trades.txt";
+		{
+			FILE *out = fopen(fileName.c_str(), "wb");
+			if (!out)
+			{
+				cerr << "Error: Could not create '" << fileName << "'" << endl;
+				return 1;
+			}
+			fputs(tradeFileHeader, out);
+			char line[256];
+			for (size_t i = 0; i < nRows; i++)
+			{
+				syntheticTradeLine(i, line, sizeof(line));
+				fputs(line, out);
+			}
+			fclose(out);
+		}
+
+		{
+			// baseline: getline, split, stod on every field
+			double sum = 0;
+			size_t rows = 0;
+			double t = bench::timeIt([&]
+									 {
+				string header;
+				vector<string> lines;
+				readFromFile(fileName, header, lines);
+				for (auto &text : lines)
+				{
+					vector<string> f = split(text, ";");
+					try
+					{
+						Date start(f[3]), end(f[4]);
+						sum += stoi(f[0]) + stod(f[5]) + stod(f[7]) + stod(f[8]) + stod(f[9]) + (end - start);
+						rows++;
+					}
+					catch (...)
+					{
+					}
+				} });
+			bench::doNotOptimize(sum);
+			bench::report("getline / split / stod, " + to_string(rows) + " rows", t, double(nRows));
+		}
+		ThreadPool one(1);
+		for (ThreadPool *pool : {&one, &defaultThreadPool()})
+		{
+			vector<TradeRow> rows;
+			vector<TradeLoadError> errors;
+			double t = bench::timeIt([&]
+									 {
+				MappedFile file(fileName);
+				parseTradeRows(file.data(), file.size(), rows, errors, *pool); });
+			bench::report("mmap / from_chars, " + to_string(pool->size()) + " threads, " + to_string(rows.size()) + " rows", t, double(nRows));
+			cout << "  " << errors.size() << " malformed, first: line " << errors[0].line << ": " << errors[0].message << endl;
+		}
+		{
+			// materialized trades are ~200 bytes each, a 10M row book does not fit next to the
+			// rows here, so creation is timed on the first 1M
+			const size_t nTrades = 1000000;
+			MappedFile file(fileName);
+			vector<TradeRow> rows;
+			vector<TradeLoadError> errors;
+			parseTradeRows(file.data(), file.size(), rows, errors);
+			rows.resize(nTrades);
+			vector<shared_ptr<Trade>> trades;
+			double t = bench::timeIt([&]
+									 { trades = createTrades(rows); });
+			bench::report("create trades, " + to_string(nTrades), t, double(nTrades));
+		}
+		remove(fileName.c_str());
+		return 0;
+	}
+	// text load against the binary snapshot of the same book, and a full round trip check:
+	// every column against the parsed rows, every rebuilt trade against the text built one
+	int benchSnapshot()
+	{
+		const size_t nRows = 1000000;
+		const string snapName = "/tmp/bench_trades.snap";
+		string text = tradeFileHeader;
+		char line[256];
+		for (size_t i = 0; i < nRows; i++)
+		{
+			syntheticTradeLine(i, line, sizeof(line));
+			text += line;
+		}
+
+		vector<TradeRow> rows;
+		vector<TradeLoadError> errors;
+		vector<shared_ptr<Trade>> fromText;
+		double t = bench::timeIt([&]
+								 {
+			parseTradeRows(text.data(), text.size(), rows, errors);
+			fromText = createTrades(rows); });
+		bench::report("text: parse + create trades, " + to_string(rows.size()), t, double(rows.size()));
+		t = bench::timeIt([&]
+						  { PortfolioSnapshot::write(snapName, rows); });
+		bench::report("write snapshot", t, double(rows.size()));
+
+		unique_ptr<PortfolioSnapshot> snap;
+		t = bench::timeIt([&]
+						  { snap.reset(new PortfolioSnapshot(snapName)); });
+		bench::report("open snapshot", t, double(snap->size()));
+		double notional = 0;
+		size_t nDates = 0;
+		t = bench::timeIt([&]
+						  {
+			for (int kind = 0; kind < 4; kind++)
+			{
+				const auto &c = snap->columns((TradeRow::Kind)kind);
+				for (size_t i = 0; i < c.count; i++)
+					notional += c.notional[i];
+				if (c.scheduleBegin)
+					nDates += c.scheduleBegin[c.count];
+			} });
+		bench::doNotOptimize(notional);
+		bench::report("column scan, " + to_string(nDates) + " schedule dates", t, double(snap->size()));
+		vector<shared_ptr<Trade>> fromSnap;
+		t = bench::timeIt([&]
+						  { fromSnap = snap->trades(); });
+		bench::report("snapshot: create trades", t, double(fromSnap.size()));
+
+		size_t mismatches = fromSnap.size() == rows.size() ? 0 : 1;
+		for (int kind = 0; kind < 4; kind++)
+		{
+			const auto &c = snap->columns((TradeRow::Kind)kind);
+			for (size_t i = 0; i < c.count; i++)
+			{
+				const TradeRow &r = rows[c.order[i]];
+				bool same = r.kind == kind && r.id == c.id[i] && r.underlying == snap->names()[c.name[i]] &&
+							r.tradeDate.getSerialDate() == c.tradeDate[i] && r.startDate.getSerialDate() == c.startDate[i] &&
+							r.endDate.getSerialDate() == c.endDate[i] && r.notional == c.notional[i] &&
+							(c.rate ? r.rate == c.rate[i] && r.freq == c.freq[i] : r.strike == c.strike[i] && r.optionType == c.optionType[i]);
+				mismatches += !same;
+			}
+		}
+		for (size_t i = 0; i < fromSnap.size() && i < fromText.size(); i++)
+		{
+			const Trade &a = *fromText[i], &b = *fromSnap[i];
+			bool same = a.getType() == b.getType() && a.getUnderlying() == b.getUnderlying() && a.getNotional() == b.getNotional();
+			if (auto sa = dynamic_cast<const Swap *>(&a))
+				same = same && dynamic_cast<const Swap *>(&b) && sa->getSchedule() == dynamic_cast<const Swap &>(b).getSchedule();
+			else if (auto ba = dynamic_cast<const Bond *>(&a))
+				same = same && dynamic_cast<const Bond *>(&b) && ba->getSchedule() == dynamic_cast<const Bond &>(b).getSchedule();
+			else if (auto oa = dynamic_cast<const TreeProduct *>(&a))
+			{
+				auto ob = dynamic_cast<const TreeProduct *>(&b);
+				TreeTerms ta = oa->GetTreeTerms(), tb = ob ? ob->GetTreeTerms() : TreeTerms();
+				same = same && ob && oa->GetExpiry() == ob->GetExpiry() && ta.american == tb.american && ta.optType == tb.optType && ta.strike == tb.strike;
+			}
+			mismatches += !same;
+		}
+		cout << "round trip: " << (mismatches ? to_string(mismatches) + " MISMATCHES" : "identical") << endl;
+		remove(snapName.c_str());
+		return mismatches ? 1 : 0;
+	}
+	// the same synthetic book as trade objects and as typed column books
+	int benchBooks()
+	{
+		const size_t nRows = 1000000;
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		mkt.addCurve("SGD-SORA", make_shared<RateCurve>(sampleCurve(asOf)));
+		string text = tradeFileHeader;
+		char line[256];
+		for (size_t i = 0; i < nRows; i++)
+		{
+			syntheticTradeLine(i, line, sizeof(line));
+			text += line;
+		}
+		vector<TradeRow> rows;
+		vector<TradeLoadError> errors;
+		parseTradeRows(text.data(), text.size(), rows, errors);
+		vector<shared_ptr<Trade>> trades = createTrades(rows);
+		TradeBooks books;
+		for (const auto &row : rows)
+			books.add(row);
+		vector<shared_ptr<Trade>> flows, options;
+		for (size_t i = 0; i < rows.size(); i++)
+			(rows[i].kind == TradeRow::Swap || rows[i].kind == TradeRow::Bond ? flows : options).push_back(trades[i]);
+
+		ThreadPool one(1);
+		vector<double> ref(flows.size()), pv(flows.size());
+		double t = bench::timeIt([&]
+								 { for (size_t i = 0; i < flows.size(); i++) ref[i] = flows[i]->Pv(mkt); });
+		bench::report("swaps + bonds, virtual Pv per trade     ", t, double(flows.size()));
+		t = bench::timeIt([&]
+						  {
+			books.swaps.PvAll(mkt, pv.data(), one);
+			books.bonds.PvAll(mkt, pv.data() + books.swaps.size(), one); });
+		bench::report("swaps + bonds, book PvAll, 1 thread     ", t, double(flows.size()));
+		// flows holds the swaps and bonds interleaved, the books hold them by kind
+		vector<double> bookPv(rows.size());
+		books.PvAll(mkt, bookPv.data());
+		double maxErr = 0;
+		for (size_t i = 0, f = 0; i < rows.size(); i++)
+			if (rows[i].kind == TradeRow::Swap || rows[i].kind == TradeRow::Bond)
+			{
+				maxErr = std::max(maxErr, std::abs(bookPv[i] - ref[f]) / std::max(1.0, std::abs(ref[f])));
+				f++;
+			}
+		cout << "  max relative difference " << maxErr << endl;
+
+		vector<double> optRef, optPv(options.size());
+		CRRBinomialTreePricer pricer(50);
+		t = bench::timeIt([&]
+						  { pricer.PricePortfolio(mkt, options, optRef); });
+		bench::report("options, PricePortfolio on trade objects", t, double(options.size()));
+		t = bench::timeIt([&]
+						  {
+			books.europeans.PvAll(mkt, optPv.data(), one);
+			books.americans.PvAll(mkt, optPv.data() + books.europeans.size(), one); });
+		bench::report("options, book PvAll, 1 thread           ", t, double(options.size()));
+		maxErr = 0;
+		for (size_t i = 0, o = 0; i < rows.size(); i++)
+			if (rows[i].kind == TradeRow::European || rows[i].kind == TradeRow::American)
+			{
+				maxErr = std::max(maxErr, std::abs(bookPv[i] - optRef[o]) / std::max(1.0, std::abs(optRef[o])));
+				o++;
+			}
+		cout << "  max relative difference " << maxErr << endl;
+
+		t = bench::timeIt([&]
+						  { books.PvAll(mkt, bookPv.data()); });
+		bench::report("whole book PvAll, " + to_string(defaultThreadPool().size()) + " threads", t, double(rows.size()));
+
+		// views go through the Trade interface, one row at a time
+		vector<shared_ptr<Trade>> views = books.views();
+		maxErr = 0;
+		for (size_t i = 0; i < views.size(); i += 997)
+			maxErr = std::max(maxErr, std::abs(views[i]->Pv(mkt) - bookPv[i]) / std::max(1.0, std::abs(bookPv[i])));
+		cout << "views against PvAll, every 997th row: max relative difference " << maxErr << endl;
+		return 0;
+	}
+	// historical style revaluation of swaps and bonds: every trade walking its schedule per
+	// scenario against one discounting pass per curve over the flat ledger
+	int benchLedger()
+	{
+		const size_t nRows = 400000, nScen = 20;
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		string text = tradeFileHeader;
+		char line[256];
+		for (size_t i = 0; i < nRows; i++)
+		{
+			syntheticTradeLine(i, line, sizeof(line));
+			text += line;
+		}
+		vector<TradeRow> rows;
+		vector<TradeLoadError> errors;
+		parseTradeRows(text.data(), text.size(), rows, errors);
+		rows.erase(std::remove_if(rows.begin(), rows.end(), [](const TradeRow &r)
+								  { return r.kind != TradeRow::Swap && r.kind != TradeRow::Bond; }),
+				   rows.end());
+		vector<shared_ptr<Trade>> trades = createTrades(rows);
+
+		// the ledger is filled in two steps to exercise the merge of new flows
+		CashflowLedger ledger;
+		vector<double> pv, ref(trades.size());
+		for (size_t i = 0; i < trades.size() / 2; i++)
+			ledger.add(*trades[i]);
+		ledger.value(mkt, pv);
+		double t = bench::timeIt([&]
+								 {
+			for (size_t i = trades.size() / 2; i < trades.size(); i++)
+				ledger.add(*trades[i]);
+			ledger.value(mkt, pv); });
+		bench::report("add " + to_string(trades.size() - trades.size() / 2) + " trades to the ledger and merge", t, double(trades.size() / 2));
+		cout << "  " << ledger.size() << " trades, " << ledger.flowCount() << " flows" << endl;
+
+		vector<Market> scenarios;
+		std::mt19937_64 rng(7);
+		std::normal_distribution<double> z(0.0, 0.001);
+		for (size_t s = 0; s < nScen; s++)
+		{
+			scenarios.push_back(mkt);
+			scenarios.back().shockCurve("USD-SOFR", Date(), z(rng));
+		}
+		size_t mismatches = 0;
+		double tTrades = 0, tLedger = 0;
+		for (const Market &scen : scenarios)
+		{
+			tTrades += bench::timeIt([&]
+									 { for (size_t i = 0; i < trades.size(); i++) ref[i] = trades[i]->Pv(scen); });
+			tLedger += bench::timeIt([&]
+									 { ledger.value(scen, pv); });
+			for (size_t i = 0; i < trades.size(); i++)
+				mismatches += pv[i] != ref[i];
+		}
+		bench::report("per trade Pv, " + to_string(nScen) + " scenarios", tTrades, double(trades.size()) * nScen);
+		bench::report("ledger value, " + to_string(nScen) + " scenarios", tLedger, double(trades.size()) * nScen);
+		cout << "ledger against per trade pv: " << (mismatches ? to_string(mismatches) + " DIFFERENT" : "identical") << endl;
+		return mismatches ? 1 : 0;
+	}
+	// result rows: the old output.txt path (to_string concatenations, a vector of rows, endl per
+	// line) against ResultWriter in each format. the text rows must match the old ones byte for
+	// byte, csv and binary must read back to the same doubles
+	int benchResults()
+	{
+		const size_t nRows = 10000000, nLegacy = 1000000;
+		const string infos[] = {"Swap USD-SOFR", "Bond SGD-SORA", "TreeProduct APPL", "Bond \"a, b\""};
+		std::mt19937_64 rng(11);
+		std::uniform_real_distribution<double> u(-1.0, 1.0);
+		vector<double> values(3 * 4096);
+		for (auto &v : values)
+			v = u(rng) * std::pow(10.0, double(int(8 * u(rng))));
+		auto rowAt = [&](size_t i, size_t &id, const string *&info, const double *&v)
+		{
+			id = i + 1;
+			info = &infos[i % 4];
+			v = &values[(3 * i) % values.size()];
+		};
+		size_t id;
+		const string *info;
+		const double *v;
+
+		const string legacyName = "/tmp/bench_results_legacy.txt";
+		double t = bench::timeIt([&]
+								 {
+			vector<string> output;
+			for (size_t i = 0; i < nLegacy; i++)
+			{
+				rowAt(i, id, info, v);
+				output.push_back(to_string(id) + "; " + *info + "; PV:" + to_string(v[0]) + "; Delta:" + to_string(v[1]) + "; Vega:" + to_string(v[2]));
+			}
+			outputToFile(legacyName, output); });
+		bench::report("to_string rows + endl, " + to_string(nLegacy) + " rows", t, double(nLegacy));
+
+		const string names[] = {"/tmp/bench_results.txt", "/tmp/bench_results.csv", "/tmp/bench_results.bin"};
+		const ResultFormat formats[] = {ResultFormat::Text, ResultFormat::Csv, ResultFormat::Binary};
+		const char *labels[] = {"text", "csv", "binary"};
+		for (int f = 0; f < 3; f++)
+		{
+			double tWrite = 0;
+			t = bench::timeIt([&]
+							  {
+				ResultWriter writer(names[f], formats[f]);
+				tWrite = bench::timeIt([&]
+									   {
+					for (size_t i = 0; i < nRows; i++)
+					{
+						rowAt(i, id, info, v);
+						writer.write(id, *info, v[0], v[1], v[2]);
+					} });
+				writer.close(); });
+			bench::report(string("ResultWriter ") + labels[f] + ", " + to_string(nRows) + " rows", t, double(nRows));
+			cout << "  " << tWrite * 1e3 << " ms of it in write(), the rest waiting for the last blocks" << endl;
+		}
+
+		size_t mismatches = 0;
+		{
+			MappedFile legacy(legacyName), text(names[0]);
+			mismatches += text.size() < legacy.size() || memcmp(text.data(), legacy.data(), legacy.size()) != 0;
+		}
+		{
+			MappedFile csv(names[1]);
+			const char *p = (const char *)memchr(csv.data(), '\n', csv.size()) + 1, *end = csv.data() + csv.size();
+			size_t i = 0;
+			for (; p < end; i++)
+			{
+				const char *eol = (const char *)memchr(p, '\n', end - p);
+				rowAt(i, id, info, v);
+				double back[3];
+				const char *q = eol;
+				for (int k = 2; k >= 0; k--)
+				{
+					const char *comma = q;
+					while (comma[-1] != ',')
+						comma--;
+					back[k] = 0;
+					from_chars(comma, q, back[k]);
+					q = comma - 1;
+				}
+				mismatches += back[0] != v[0] || back[1] != v[1] || back[2] != v[2];
+				p = eol + 1;
+			}
+			mismatches += i != nRows;
+		}
+		{
+			vector<TradeResult> back = ResultWriter::readBinary(names[2]);
+			mismatches += back.size() != nRows;
+			for (size_t i = 0; i < back.size(); i++)
+			{
+				rowAt(i, id, info, v);
+				mismatches += back[i].id != id || back[i].tradeInfo != *info || back[i].PV != v[0] || back[i].DV01 != v[1] || back[i].Vega != v[2];
+			}
+		}
+		cout << "text against to_string rows, csv and binary read back: " << (mismatches ? to_string(mismatches) + " MISMATCHES" : "identical") << endl;
+		remove(legacyName.c_str());
+		for (const string &name : names)
+			remove(name.c_str());
+		return mismatches ? 1 : 0;
+	}
+	// arithmetic average price call, the kind of path dependent payoff MonteCarloPricer is for
+	class AsianCall : public EuropeanOption
+	{
+	public:
+		AsianCall(double _strike, const Date &_start, const Date &_expiry, const string &name)
+			: EuropeanOption(Call, 1, _strike, _start, _expiry, name) {}
+		TreeTerms GetTreeTerms() const override { return TreeTerms(); }
+		double PathPayoff(const double *path, int nSteps) const override
+		{
+			double avg = 0;
+			for (int k = 0; k < nSteps; k++)
+				avg += path[k];
+			avg /= nSteps;
+			return avg > strike ? avg - strike : 0.0;
+		}
+	};
+
+	int benchMonteCarlo()
+	{
+		Date asOf(2025, 1, 1);
+		Market mkt = sampleEquityMarket(asOf);
+		EuropeanOption call(Call, 1, 680, asOf, Date(2026, 1, 1), "APPL");
+		EuroCallSpread spread(600, 700, Date(2026, 1, 1), "APPL");
+		AsianCall asian(650, asOf, Date(2026, 1, 1), "APPL");
+		cout << "black-scholes call " << call.BlackPv(mkt) << endl;
+
+		struct Setup
+		{
+			const char *name;
+			bool antithetic, control, sobol;
+		};
+		const Setup setups[] = {{"plain              ", false, false, false},
+								{"antithetic         ", true, false, false},
+								{"antithetic, control", true, true, false},
+								{"sobol              ", false, false, true},
+								{"sobol, control     ", false, true, true}};
+		struct Product
+		{
+			const char *name;
+			const TreeProduct *trade;
+			int steps;
+		};
+		const Product products[] = {{"call  ", &call, 1}, {"spread", &spread, 1}, {"asian ", &asian, 12}};
+
+		ThreadPool one(1);
+		for (const Product &product : products)
+		{
+			for (const Setup &setup : setups)
+			{
+				MonteCarloOptions options;
+				options.paths = 1 << 20;
+				options.steps = product.steps;
+				options.antithetic = setup.antithetic;
+				options.controlVariate = setup.control;
+				options.sobol = setup.sobol;
+				MonteCarloPricer pricer(options, one);
+				MonteCarloResult res;
+				double t = bench::timeIt([&]
+										 { res = pricer.Simulate(mkt, *product.trade); });
+				bench::report(string(product.name) + " " + setup.name + ", 1 thread, pv " + to_string(res.pv) + " +- " + to_string(res.stdError),
+							  t, (double)res.paths * product.steps);
+			}
+		}
+
+		// the same bits on any number of threads
+		MonteCarloOptions options;
+		options.paths = 1 << 20;
+		options.steps = 12;
+		ThreadPool four(4);
+		MonteCarloResult a = MonteCarloPricer(options, one).Simulate(mkt, asian);
+		MonteCarloResult b = MonteCarloPricer(options, four).Simulate(mkt, asian);
+		cout << "asian on 1 and 4 threads: " << (a.pv == b.pv && a.stdError == b.stdError ? "identical" : "DIFFERENT") << endl;
+		cout << "(Mops/s counts path steps)" << endl;
+		return 0;
+	}
+}
+
+int runBenchmark(const string &name)
+{
+	if (name == "date")
+		return benchDate();
+	if (name == "bootstrap")
+		return benchBootstrap();
+	if (name == "curve")
+		return benchCurve();
+	if (name == "market")
+		return benchMarket();
+	if (name == "aad")
+		return benchAad();
+	if (name == "tree")
+		return benchTree();
+	if (name == "treeaccuracy")
+		return benchTreeAccuracy();
+	if (name == "fd")
+		return benchFiniteDifference();
+	if (name == "strikes")
+		return benchStrikes();
+	if (name == "bs")
+		return benchBlackScholes();
+	if (name == "impliedvol")
+		return benchImpliedVol();
+	if (name == "pool")
+		return benchPool();
+	if (name == "risk")
+		return benchPortfolioRisk();
+	if (name == "greeks")
+		return benchLatticeGreeks();
+	if (name == "tick")
+		return benchTick();
+	if (name == "var")
+		return benchVar();
+	if (name == "mc")
+		return benchMonteCarlo();
+	if (name == "loader")
+		return benchLoader();
+	if (name == "snapshot")
+		return benchSnapshot();
+	if (name == "books")
+		return benchBooks();
+	if (name == "ledger")
+		return benchLedger();
+	if (name == "results")
+		return benchResults();
+	cerr << "Error: unknown benchmark '" << name << "'" << endl;
+	return 1;
+}
@@ -0,0 +1,38 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <chrono>
+#include <string>
+#include <iostream>
+
+using namespace std;
+
+namespace bench
+{
+	// wall clock seconds of one call of fn
+	template <class Fn>
+	double timeIt(Fn &&fn)
+	{
+		auto t0 = std::chrono::steady_clock::now();
+		fn();
+		auto t1 = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(t1 - t0).count();
+	}
+
+	// keep the optimizer from dropping a result
+	template <class T>
+	inline void doNotOptimize(const T &value)
+	{
+		asm volatile("" : : "r,m"(value) : "memory");
+	}
+
+	inline void report(const string &name, double seconds, double ops)
+	{
+		cout << name << ": " << seconds * 1e3 << " ms, " << ops / seconds / 1e6 << " Mops/s" << endl;
+	}
+}
+
+// run a named benchmark, eg. ./main --bench date. returns process exit code
+int runBenchmark(const string &name);
+
+#endif
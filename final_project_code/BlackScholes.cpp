@@ -0,0 +1,505 @@
+#include <algorithm>
+#include "BlackScholes.h"
+#include "MathKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BS_X86_DISPATCH 1
+#endif
+
+#ifdef __GNUC__
+#pragma GCC diagnostic ignored "-Wpsabi" // see MathKernels.h
+#endif
+
+namespace bs
+{
+	namespace
+	{
+		const size_t L = imp::lanes;
+
+		// one SIMD group of options, copied in so the tail and the option types need no
+		// special case in the kernel. phi is +1 for calls, -1 for puts
+		struct Group
+		{
+			double S[L], K[L], T[L], sqrtT[L], r[L], vol[L], phi[L], binary[L];
+		};
+		struct GroupOut
+		{
+			double pv[L], delta[L], gamma[L], vega[L], theta[L];
+		};
+
+#ifdef __GNUC__
+		using imp::Lanes;
+		using imp::LanesI;
+		using imp::loadLanes;
+		using imp::storeLanes;
+		using imp::splat;
+
+		// greeks() lane by lane, both the vanilla and the binary formulas are evaluated and blended
+		__attribute__((always_inline)) inline void greeksKernel(const Group &in, GroupOut &out)
+		{
+			const double invSqrt2Pi = 0.3989422804014327;
+			const Lanes zero = {}, one = splat(1.0);
+			Lanes S = loadLanes(in.S), K = loadLanes(in.K), r = loadLanes(in.r), phi = loadLanes(in.phi);
+			Lanes T = loadLanes(in.T), sqrtT = loadLanes(in.sqrtT), vol = loadLanes(in.vol);
+			LanesI live = (T > 0.0) & (vol > 0.0);
+			LanesI binary = loadLanes(in.binary) > 0.0;
+			T = live ? T : one; // expired lanes take the payoff, keep their math finite
+			sqrtT = live ? sqrtT : one;
+			vol = live ? vol : one;
+
+			// divisions are the expensive part, take each reciprocal once
+			Lanes volT = vol * sqrtT;
+			Lanes invVolT = 1.0 / volT;
+			Lanes invS = 1.0 / S;
+			Lanes d1 = (imp::logLanes(S / K) + (r + 0.5 * vol * vol) * T) * invVolT;
+			Lanes d2 = d1 - volT;
+			Lanes df = imp::expLanes(-r * T);
+			Lanes e1 = imp::expLanes(-0.5 * d1 * d1);
+			Lanes e2 = imp::expLanes(-0.5 * d2 * d2);
+			Lanes Nd1 = imp::normCdfLanes(phi * d1, e1);
+			Lanes Nd2 = imp::normCdfLanes(phi * d2, e2);
+
+			// vanilla
+			Lanes nd1 = invSqrt2Pi * e1;
+			Lanes Kdf = K * df * Nd2;
+			Lanes pv = phi * (S * Nd1 - Kdf);
+			Lanes delta = phi * Nd1;
+			Lanes gamma = nd1 * invS * invVolT;
+			Lanes vega = S * nd1 * sqrtT;
+			Lanes theta = -0.5 * S * nd1 * vol * vol * invVolT - phi * r * Kdf; // vol / sqrtT = vol^2 / volT
+
+			// cash-or-nothing
+			Lanes nd2 = df * invSqrt2Pi * e2;
+			Lanes dd2dT = (r - 0.5 * vol * vol) * invVolT - 0.5 * d2 * vol * vol * invVolT * invVolT; // d2 / 2T
+			Lanes bpv = df * Nd2;
+			Lanes bdelta = phi * nd2 * invS * invVolT;
+			pv = binary ? bpv : pv;
+			delta = binary ? bdelta : delta;
+			gamma = binary ? -bdelta * d1 * invS * invVolT : gamma;
+			vega = binary ? -bdelta * d1 * S * sqrtT : vega; // nd2 d1 / vol
+			theta = binary ? r * bpv - phi * nd2 * dd2dT : theta;
+
+			// at or after expiry, PAYOFF::VanillaOption and no greeks
+			Lanes x = phi * (S - K);
+			Lanes payoff = binary ? (x >= 0.0 ? one : zero) : (x > 0.0 ? x : zero);
+			storeLanes(out.pv, live ? pv : payoff);
+			storeLanes(out.delta, live ? delta : zero);
+			storeLanes(out.gamma, live ? gamma : zero);
+			storeLanes(out.vega, live ? vega : zero);
+			storeLanes(out.theta, live ? theta : zero);
+		}
+#else
+		inline void greeksKernel(const Group &in, GroupOut &out)
+		{
+			for (size_t l = 0; l < L; l++)
+			{
+				OptionType type = in.binary[l] > 0 ? (in.phi[l] > 0 ? BinaryCall : BinaryPut) : (in.phi[l] > 0 ? Call : Put);
+				OptionGreeks g = greeks(type, in.S[l], in.K[l], in.T[l], in.r[l], in.vol[l]);
+				out.pv[l] = g.pv;
+				out.delta[l] = g.delta;
+				out.gamma[l] = g.gamma;
+				out.vega[l] = g.vega;
+				out.theta[l] = g.theta;
+			}
+		}
+#endif
+
+		void greeksGroupsScalar(const Group *in, GroupOut *out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				greeksKernel(in[i], out[i]);
+		}
+
+#ifdef BS_X86_DISPATCH
+		__attribute__((target("avx2")))
+		void greeksGroupsAvx2(const Group *in, GroupOut *out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				greeksKernel(in[i], out[i]);
+		}
+
+		__attribute__((target("avx512f")))
+		void greeksGroupsAvx512(const Group *in, GroupOut *out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				greeksKernel(in[i], out[i]);
+		}
+#endif
+
+		using GreeksGroupsFn = void (*)(const Group *, GroupOut *, size_t);
+		GreeksGroupsFn selectGreeksGroups()
+		{
+#ifdef BS_X86_DISPATCH
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+				return greeksGroupsAvx512;
+			if (__builtin_cpu_supports("avx2"))
+				return greeksGroupsAvx2;
+#endif
+			return greeksGroupsScalar;
+		}
+
+		// implied vol works on the normalized out-of-the-money price (Jaeckel, "let's be rational"):
+		// with F the forward, x = log(F / K) and s = vol sqrt(T), an undiscounted call over
+		// sqrt(F K) is b(x, s) = e^{x/2} N(x/s + s/2) - e^{-x/2} N(x/s - s/2). puts and in the
+		// money calls map onto it by parity and x -> -x, so only x <= 0 is solved. b is convex
+		// in s below sc = sqrt(-2x) and concave above: below, Halley runs on log b from the
+		// small s asymptote log b ~ -x^2 / 2s^2 + log(s^3 / sqrt(2 pi) x^2), above, on b from
+		// the large s one b ~ e^{x/2} - (e^{x/2} + e^{-x/2}) N(-s/2). each guess is checked
+		// against the other candidate of its region and the closer one kept
+		const double ivTolerance = 1e-6; // on the last Halley step relative to s, the error left is ~its cube
+		const int ivMaxIterations = 16;
+
+		// -N^{-1}(q) for q in (0, 0.5], abramowitz & stegun 26.2.23 (4.5e-4), only a guess
+		inline double normTail(double q)
+		{
+			double t = std::sqrt(-2 * std::log(q));
+			return t - (2.515517 + t * (0.802853 + t * 0.010328)) / (1 + t * (1.432788 + t * (0.189269 + t * 0.001308)));
+		}
+
+		// b(x, s) and db/ds
+		inline double otmPrice(double x, double s, double &dbds)
+		{
+			double d1 = x / s + 0.5 * s;
+			double eh = std::exp(0.5 * x);
+			dbds = 0.3989422804014327 * eh * std::exp(-0.5 * d1 * d1);
+			return eh * normCdf(d1) - normCdf(d1 - s) / eh;
+		}
+
+		struct VolGroup
+		{
+			double price[L], S[L], K[L], T[L], sqrtT[L], r[L], phi[L];
+		};
+		struct VolGroupOut
+		{
+			double vol[L];
+		};
+
+#ifdef __GNUC__
+		__attribute__((always_inline)) inline Lanes absLanes(Lanes x) { return (Lanes)((LanesI)x & 0x7fffffffffffffffLL); }
+
+		// sqrt of x > 0 from the bit trick guess of 1 / sqrt(x) and four newton steps, a libm call
+		// per lane would not vectorize. 0 gives nan
+		__attribute__((always_inline)) inline Lanes sqrtLanes(Lanes x)
+		{
+			Lanes y = (Lanes)(0x5fe6eb50c7b537a9LL - ((LanesI)x >> 1));
+			for (int k = 0; k < 4; k++)
+				y = y * (1.5 - 0.5 * x * y * y);
+			return x * y;
+		}
+
+		__attribute__((always_inline)) inline bool anyLane(LanesI m)
+		{
+			int64_t any = 0;
+			for (size_t l = 0; l < L; l++)
+				any |= m[l];
+			return any != 0;
+		}
+
+		__attribute__((always_inline)) inline Lanes normTailLanes(Lanes q)
+		{
+			Lanes t = sqrtLanes(-2.0 * imp::logLanes(q));
+			return t - (2.515517 + t * (0.802853 + t * 0.010328)) / (1.0 + t * (1.432788 + t * (0.189269 + t * 0.001308)));
+		}
+
+		// otmPrice lane by lane. is = 1 / s, eh = e^{x/2}, ieh = 1 / eh and ex = e^x, the second
+		// density is the first times e^x
+		__attribute__((always_inline)) inline Lanes otmPriceLanes(Lanes x, Lanes s, Lanes is, Lanes eh, Lanes ieh, Lanes ex, Lanes &dbds)
+		{
+			Lanes d1 = x * is + 0.5 * s;
+			Lanes e1 = imp::expLanes(-0.5 * d1 * d1);
+			dbds = 0.3989422804014327 * eh * e1;
+			return eh * imp::normCdfPreciseLanes(d1, e1) - imp::normCdfPreciseLanes(d1 - s, e1 * ex) * ieh;
+		}
+
+		// impliedVol() lane by lane, lanes stop moving once their own step is below tolerance so a
+		// quote's vol does not depend on its neighbours
+		__attribute__((always_inline)) inline void impliedVolKernel(const VolGroup &in, VolGroupOut &out)
+		{
+			const Lanes zero = {}, one = splat(1.0);
+			Lanes P = loadLanes(in.price), S = loadLanes(in.S), K = loadLanes(in.K), r = loadLanes(in.r), phi = loadLanes(in.phi);
+			Lanes T = loadLanes(in.T), sqrtT = loadLanes(in.sqrtT);
+			LanesI live = T > 0.0;
+			T = live ? T : one;
+			sqrtT = live ? sqrtT : one;
+
+			// normalized price less the intrinsic value, then the out of the money side
+			Lanes x = imp::logLanes(S / K) + r * T;
+			Lanes eh = imp::expLanes(0.5 * x), ieh = 1.0 / eh;
+			Lanes intrinsic = phi * (eh - ieh);
+			Lanes b = P * imp::expLanes(r * T) * ieh / K - (intrinsic > 0.0 ? intrinsic : zero);
+			LanesI itm = x > 0.0;
+			Lanes ehOtm = itm ? ieh : eh;
+			ieh = itm ? eh : ieh;
+			eh = ehOtm;
+			x = itm ? -x : x;
+			Lanes ex = eh * eh;
+			LanesI atIntrinsic = live & (b == 0.0);
+			LanesI valid = live & (b > 0.0) & (b < eh);
+			b = valid ? b : 0.5 * eh; // keeps the math finite
+			Lanes invB = 1.0 / b;
+
+			Lanes dbds;
+			Lanes sc = sqrtLanes(-2.0 * x);
+			sc = sc > 1e-300 ? sc : splat(1e-300);
+			Lanes bc = otmPriceLanes(x, sc, 1.0 / sc, eh, ieh, ex, dbds);
+			LanesI lower = b < bc;
+			Lanes su = 2.0 * normTailLanes((eh - b) / (eh + ieh));
+			Lanes s1 = sc, b1 = bc;
+			if (anyLane(lower))
+			{
+				Lanes logB = imp::logLanes(b), c = imp::logLanes(2.5066282746310002 * x * x), sl = 0.5 * sc;
+				for (int k = 0; k < 3; k++)
+				{
+					Lanes den = 3.0 * imp::logLanes(sl) - c - logB;
+					sl = den > 0.0 ? -x / sqrtLanes(den > 0.0 ? 2.0 * den : one) : sl;
+				}
+				s1 = lower ? (sl < sc ? sl : sc) : sc;
+				b1 = lower ? otmPriceLanes(x, s1, 1.0 / s1, eh, ieh, ex, dbds) : bc;
+			}
+			Lanes s2 = lower ? (su < sc ? su : sc) : (su > sc ? su : sc);
+			Lanes b2 = otmPriceLanes(x, s2, 1.0 / s2, eh, ieh, ex, dbds);
+			Lanes r1 = absLanes(lower ? imp::logLanes(b1 * invB) : b1 - b);
+			Lanes r2 = absLanes(lower ? imp::logLanes(b2 * invB) : b2 - b);
+			Lanes s = r1 <= r2 ? s1 : s2;
+
+			LanesI done = ~valid;
+			for (int k = 0; k < ivMaxIterations && anyLane(~done); k++)
+			{
+				Lanes is = 1.0 / s;
+				Lanes bs = otmPriceLanes(x, s, is, eh, ieh, ex, dbds);
+				Lanes d2bds2 = dbds * (x * x * is * is * is - 0.25 * s);
+				// halley h = -g g' / (g'^2 - g g'' / 2), newton where the correction is over 2x. on
+				// log b the terms are scaled by b^2 to save the divisions
+				Lanes g = bs - b, g1 = dbds, g1g1 = dbds * dbds, gg2 = g * d2bds2;
+				if (anyLane(lower))
+				{
+					Lanes gl = imp::logLanes(bs * invB);
+					g = lower ? gl : g;
+					g1 = lower ? dbds * bs : g1;
+					gg2 = lower ? gl * (d2bds2 * bs - g1g1) : gg2;
+				}
+				Lanes den = g1g1 - 0.5 * gg2;
+				Lanes h = -g * g1 / (absLanes(den) > 0.5 * g1g1 ? den : g1g1);
+				Lanes next = s + h;
+				next = next > 0.0 ? next : 0.5 * s;
+				LanesI converged = absLanes(h) <= ivTolerance * next;
+				s = done ? s : next;
+				done |= converged;
+			}
+
+			Lanes vol = s / sqrtT;
+			storeLanes(out.vol, valid ? vol : (atIntrinsic ? zero : splat(__builtin_nan(""))));
+		}
+#else
+		inline void impliedVolKernel(const VolGroup &in, VolGroupOut &out)
+		{
+			for (size_t l = 0; l < L; l++)
+				out.vol[l] = impliedVol(in.phi[l] > 0 ? Call : Put, in.price[l], in.S[l], in.K[l], in.T[l], in.r[l]);
+		}
+#endif
+
+		void impliedVolGroupsScalar(const VolGroup *in, VolGroupOut *out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				impliedVolKernel(in[i], out[i]);
+		}
+
+#ifdef BS_X86_DISPATCH
+		__attribute__((target("avx2")))
+		void impliedVolGroupsAvx2(const VolGroup *in, VolGroupOut *out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				impliedVolKernel(in[i], out[i]);
+		}
+
+		__attribute__((target("avx512f")))
+		void impliedVolGroupsAvx512(const VolGroup *in, VolGroupOut *out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				impliedVolKernel(in[i], out[i]);
+		}
+#endif
+
+		using ImpliedVolGroupsFn = void (*)(const VolGroup *, VolGroupOut *, size_t);
+		ImpliedVolGroupsFn selectImpliedVolGroups()
+		{
+#ifdef BS_X86_DISPATCH
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+				return impliedVolGroupsAvx512;
+			if (__builtin_cpu_supports("avx2"))
+				return impliedVolGroupsAvx2;
+#endif
+			return impliedVolGroupsScalar;
+		}
+	}
+
+	void greeksBatch(size_t n, const OptionType *optType, const double *S, const double *K, const double *T,
+					 const double *r, const double *vol, double *pv, double *delta, double *gamma,
+					 double *vega, double *theta)
+	{
+		static const GreeksGroupsFn greeksGroups = selectGreeksGroups();
+
+		// a few kB of groups at a time, filled from the arrays and scattered back
+		const size_t chunkGroups = 32;
+		Group in[chunkGroups];
+		GroupOut out[chunkGroups];
+		for (size_t first = 0; first < n; first += chunkGroups * L)
+		{
+			size_t count = std::min(chunkGroups * L, n - first);
+			size_t groups = (count + L - 1) / L;
+			for (size_t k = 0; k < groups * L; k++)
+			{
+				Group &g = in[k / L];
+				size_t l = k % L;
+				if (k >= count) // padding, any finite option
+				{
+					g.S[l] = g.K[l] = g.T[l] = g.sqrtT[l] = g.phi[l] = 1;
+					g.r[l] = g.binary[l] = 0;
+					g.vol[l] = 0.2;
+					continue;
+				}
+				size_t i = first + k;
+				switch (optType[i])
+				{
+				case Call:
+				case Put:
+				case BinaryCall:
+				case BinaryPut:
+					break;
+				default:
+					throw "unsupported optionType";
+				}
+				g.S[l] = S[i];
+				g.K[l] = K[i];
+				g.T[l] = T[i];
+				g.sqrtT[l] = T[i] > 0 ? std::sqrt(T[i]) : 0.0;
+				g.r[l] = r[i];
+				g.vol[l] = vol[i];
+				g.phi[l] = (optType[i] == Call || optType[i] == BinaryCall) ? 1 : -1;
+				g.binary[l] = (optType[i] == BinaryCall || optType[i] == BinaryPut) ? 1 : 0;
+			}
+			greeksGroups(in, out, groups);
+			for (size_t k = 0; k < count; k++)
+			{
+				const GroupOut &o = out[k / L];
+				size_t l = k % L, i = first + k;
+				pv[i] = o.pv[l];
+				if (delta)
+					delta[i] = o.delta[l];
+				if (gamma)
+					gamma[i] = o.gamma[l];
+				if (vega)
+					vega[i] = o.vega[l];
+				if (theta)
+					theta[i] = o.theta[l];
+			}
+		}
+	}
+
+	double impliedVol(OptionType optType, double price, double S, double K, double T, double r)
+	{
+		if (optType != Call && optType != Put)
+			throw "unsupported optionType";
+		if (!(T > 0))
+			return std::nan("");
+
+		// normalized price less the intrinsic value, then the out of the money side
+		double x = std::log(S / K) + r * T;
+		double eh = std::exp(0.5 * x);
+		double phi = optType == Call ? 1 : -1;
+		double b = price * std::exp(r * T) / (K * eh) - std::max(phi * (eh - 1 / eh), 0.0);
+		x = -std::fabs(x);
+		eh = std::exp(0.5 * x);
+		if (b == 0)
+			return 0;
+		if (!(b > 0 && b < eh))
+			return std::nan("");
+
+		double dbds;
+		double sc = std::max(std::sqrt(-2 * x), 1e-300);
+		double bc = otmPrice(x, sc, dbds);
+		bool lower = b < bc;
+		double su = 2 * normTail((eh - b) / (eh + 1 / eh));
+		double s;
+		if (lower)
+		{
+			double logB = std::log(b), c = std::log(2.5066282746310002 * x * x), sl = 0.5 * sc;
+			for (int k = 0; k < 3; k++)
+			{
+				double den = 3 * std::log(sl) - c - logB;
+				sl = den > 0 ? -x / std::sqrt(2 * den) : sl;
+			}
+			double s1 = std::min(sl, sc), s2 = std::min(su, sc);
+			double r1 = std::fabs(std::log(otmPrice(x, s1, dbds) / b)), r2 = std::fabs(std::log(otmPrice(x, s2, dbds) / b));
+			s = r1 <= r2 ? s1 : s2;
+		}
+		else
+		{
+			double s2 = std::max(su, sc);
+			s = std::fabs(bc - b) <= std::fabs(otmPrice(x, s2, dbds) - b) ? sc : s2;
+		}
+
+		for (int k = 0; k < ivMaxIterations; k++)
+		{
+			double bs = otmPrice(x, s, dbds);
+			double d2bds2 = dbds * (x * x / (s * s * s) - 0.25 * s);
+			double g = bs - b, g1 = dbds, g2 = d2bds2;
+			if (lower)
+			{
+				g = std::log(bs / b);
+				g1 = dbds / bs;
+				g2 = d2bds2 / bs - g1 * g1;
+			}
+			double newton = -g / g1;
+			double den = 1 + 0.5 * newton * g2 / g1;
+			double h = std::fabs(den) > 0.5 ? newton / den : newton;
+			double next = s + h;
+			s = next > 0 ? next : 0.5 * s;
+			if (std::fabs(h) <= ivTolerance * s)
+				break;
+		}
+		return s / std::sqrt(T);
+	}
+
+	void impliedVolBatch(size_t n, const OptionType *optType, const double *price, const double *S, const double *K,
+						 const double *T, const double *r, double *vol)
+	{
+		static const ImpliedVolGroupsFn impliedVolGroups = selectImpliedVolGroups();
+
+		const size_t chunkGroups = 32;
+		VolGroup in[chunkGroups];
+		VolGroupOut out[chunkGroups];
+		for (size_t first = 0; first < n; first += chunkGroups * L)
+		{
+			size_t count = std::min(chunkGroups * L, n - first);
+			size_t groups = (count + L - 1) / L;
+			for (size_t k = 0; k < groups * L; k++)
+			{
+				VolGroup &g = in[k / L];
+				size_t l = k % L;
+				if (k >= count) // padding, an at the money call
+				{
+					g.S[l] = g.K[l] = g.T[l] = g.sqrtT[l] = g.phi[l] = 1;
+					g.r[l] = 0;
+					g.price[l] = 0.1;
+					continue;
+				}
+				size_t i = first + k;
+				if (optType[i] != Call && optType[i] != Put)
+					throw "unsupported optionType";
+				g.price[l] = price[i];
+				g.S[l] = S[i];
+				g.K[l] = K[i];
+				g.T[l] = T[i];
+				g.sqrtT[l] = T[i] > 0 ? std::sqrt(T[i]) : 0.0;
+				g.r[l] = r[i];
+				g.phi[l] = optType[i] == Call ? 1 : -1;
+			}
+			impliedVolGroups(in, out, groups);
+			for (size_t k = 0; k < count; k++)
+				vol[first + k] = out[k / L].vol[k % L];
+		}
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef _BLACK_SCHOLES_H
+#define _BLACK_SCHOLES_H
+
+#include <cmath>
+#include <cstddef>
+#include "Types.h"
+#include "Payoff.h"
+
+// price and greeks per unit notional. vega per 1.00 of vol, theta per year of calendar
+// time (T counted in days / 365 like the tree). at or after expiry the greeks are 0
+struct OptionGreeks
+{
+	double pv = 0;
+	double delta = 0;
+	double gamma = 0;
+	double vega = 0;
+	double theta = 0;
+};
+
+// closed form black-scholes for vanilla and binary (cash-or-nothing, pays 1) options
+namespace bs
+{
+	inline double normCdf(double x) { return 0.5 * std::erfc(-x / std::sqrt(2.0)); }
+
+	// T in years, r continuously compounded. at or after expiry the payoff is returned
+	inline double price(OptionType optType, double S, double K, double T, double r, double vol)
+	{
+		if (T <= 0 || vol <= 0)
+			return PAYOFF::VanillaOption(optType, K, S);
+
+		double sqrtT = std::sqrt(T);
+		double d1 = (std::log(S / K) + (r + 0.5 * vol * vol) * T) / (vol * sqrtT);
+		double d2 = d1 - vol * sqrtT;
+		double df = std::exp(-r * T);
+		switch (optType)
+		{
+		case Call:
+			return S * normCdf(d1) - K * df * normCdf(d2);
+		case Put:
+			return K * df * normCdf(-d2) - S * normCdf(-d1);
+		case BinaryCall:
+			return df * normCdf(d2);
+		case BinaryPut:
+			return df * normCdf(-d2);
+		default:
+			throw "unsupported optionType";
+		}
+	}
+
+	// price and analytic greeks together, the reference for greeksBatch
+	inline OptionGreeks greeks(OptionType optType, double S, double K, double T, double r, double vol)
+	{
+		OptionGreeks g;
+		if (T <= 0 || vol <= 0)
+		{
+			g.pv = PAYOFF::VanillaOption(optType, K, S);
+			return g;
+		}
+
+		const double invSqrt2Pi = 0.3989422804014327;
+		double phi = (optType == Call || optType == BinaryCall) ? 1 : -1;
+		double sqrtT = std::sqrt(T);
+		double volT = vol * sqrtT;
+		double d1 = (std::log(S / K) + (r + 0.5 * vol * vol) * T) / volT;
+		double d2 = d1 - volT;
+		double df = std::exp(-r * T);
+		switch (optType)
+		{
+		case Call:
+		case Put:
+		{
+			double nd1 = invSqrt2Pi * std::exp(-0.5 * d1 * d1);
+			double Kdf = K * df * normCdf(phi * d2);
+			g.pv = phi * (S * normCdf(phi * d1) - Kdf);
+			g.delta = phi * normCdf(phi * d1);
+			g.gamma = nd1 / (S * volT);
+			g.vega = S * nd1 * sqrtT;
+			g.theta = -S * nd1 * vol / (2 * sqrtT) - phi * r * Kdf;
+			return g;
+		}
+		case BinaryCall:
+		case BinaryPut:
+		{
+			double nd2 = df * invSqrt2Pi * std::exp(-0.5 * d2 * d2);
+			double dd2dT = (r - 0.5 * vol * vol) / volT - d2 / (2 * T);
+			g.pv = df * normCdf(phi * d2);
+			g.delta = phi * nd2 / (S * volT);
+			g.gamma = -phi * nd2 * d1 / (S * S * volT * volT);
+			g.vega = -phi * nd2 * d1 / vol;
+			g.theta = r * g.pv - phi * nd2 * dd2dT;
+			return g;
+		}
+		default:
+			throw "unsupported optionType";
+		}
+	}
+
+	// the same over arrays, SIMD across options with polynomial log / exp / normal cdf
+	// (~1e-14 relative to greeks()). any output pointer may be null
+	void greeksBatch(size_t n, const OptionType *optType, const double *S, const double *K, const double *T,
+					 const double *r, const double *vol, double *pv, double *delta = nullptr, double *gamma = nullptr,
+					 double *vega = nullptr, double *theta = nullptr);
+
+	// the vol at which price() of a call or put gives this price, the reference for
+	// impliedVolBatch. nan when the price is outside the no-arbitrage bounds (intrinsic, S)
+	// or T <= 0, 0 at exactly the intrinsic value
+	double impliedVol(OptionType optType, double price, double S, double K, double T, double r);
+
+	// the same over arrays, SIMD across quotes: a rational initial guess and ~3 Halley steps
+	// to ~1e-13 relative. calls and puts only
+	void impliedVolBatch(size_t n, const OptionType *optType, const double *price, const double *S, const double *K,
+						 const double *T, const double *r, double *vol);
+}
+
+#endif
@@ -1,30 +1,11 @@
 #include "Bond.h"
 #include "Market.h"
+#include "MathKernels.h"
 #include <cmath>
 
 void Bond::generateSchedule()
 {
-	// implement this
-	if (startDate == maturityDate || frequency <= 0 || frequency > 1)
-		throw std::runtime_error("Error: start date is later than end date, or invalid frequency!");
-
-	string tenorStr;
-	if (frequency == 0.25)
-		tenorStr = "3M";
-	else if (frequency == 0.5)
-		tenorStr = "6M";
-	else
-		tenorStr = "1Y";
-
-	Date seed = startDate;
-	while (seed < maturityDate)
-	{
-		bondSchedule.push_back(seed);
-		seed = dateAddTenor(seed, tenorStr);
-	}
-	bondSchedule.push_back(maturityDate);
-	if (bondSchedule.size() < 2)
-		throw std::runtime_error("Error: invalid schedule, check input!");
+	couponSchedule(startDate, maturityDate, frequency, bondSchedule);
 }
 double Bond::Payoff(double s) const
 {
@@ -43,29 +24,73 @@ double Bond::Pv(const Market &mkt) const
 	auto rc = mkt.getCurve(rateCurve);
 	Date valueDate = mkt.asOf;
 
+	// Interpolated discount factor for every remaining coupon date, in one batch
+	auto it = std::lower_bound(bondSchedule.begin() + 1, bondSchedule.end(), valueDate);
+	size_t first = it - bondSchedule.begin();
+	size_t nPay = bondSchedule.size() - first;
+	thread_local vector<double> dfs;
+	dfs.resize(nPay);
+	rc->getRates(bondSchedule.data() + first, nPay, dfs.data());
+	for (size_t k = 0; k < nPay; k++)
+		dfs[k] = -dfs[k] * ((bondSchedule[first + k] - valueDate) / 360.0);
+	imp::expBatch(dfs.data(), dfs.data(), nPay);
+
 	// Loop through all coupon payment dates
-	for (size_t i = 1; i < bondSchedule.size(); ++i)
+	for (size_t i = first; i < bondSchedule.size(); ++i)
 	{
-		Date dt = bondSchedule[i];
-		if (dt < valueDate)
-			continue;
 		// Year fraction between two coupon dates (e.g., 180/360 for semi-annual)
 		double tau = (bondSchedule[i] - bondSchedule[i - 1]) / 360.0;
-		// Interpolated discount factor for this coupon date
-		double zr = rc->getRate(dt);
-		double T = (dt - valueDate) / 360.0;
-		double df = exp(-zr * T);
 		// Coupon cashflow
-		pv += coupon * notional * tau * df;
+		pv += coupon * notional * tau * dfs[i - first];
 	}
-	// Add notional repayment at maturity (discounted)
-	Date dt = maturityDate;
-	if (dt >= valueDate)
+	// Add notional repayment at maturity (discounted), maturity is the last schedule date
+	if (maturityDate >= valueDate)
+		pv += notional * dfs.back();
+	return sign * pv;
+}
+
+double Bond::PvAdjoint(const Market &mkt, vector<double> &curveSens) const
+{
+	std::string dir = direction;
+	std::transform(dir.begin(), dir.end(), dir.begin(), ::tolower);
+	double sign = (dir == "short") ? -1.0 : 1.0;
+
+	auto rc = mkt.getCurve(rateCurve);
+	Date valueDate = mkt.asOf;
+	curveSens.assign(rc->getTenors().size(), 0.0);
+
+	// forward sweep, same numbers as Pv
+	auto it = std::lower_bound(bondSchedule.begin() + 1, bondSchedule.end(), valueDate);
+	size_t first = it - bondSchedule.begin();
+	size_t nPay = bondSchedule.size() - first;
+	thread_local vector<double> dfs;
+	dfs.resize(nPay);
+	rc->getRates(bondSchedule.data() + first, nPay, dfs.data());
+	for (size_t k = 0; k < nPay; k++)
+		dfs[k] = -dfs[k] * ((bondSchedule[first + k] - valueDate) / 360.0);
+	imp::expBatch(dfs.data(), dfs.data(), nPay);
+
+	double pv = 0.0;
+	for (size_t i = first; i < bondSchedule.size(); ++i)
 	{
-		double zr = rc->getRate(dt);
-		double T = (dt - valueDate) / 360.0;
-		double df = exp(-zr * T);
-		pv += notional * df;
+		double tau = (bondSchedule[i] - bondSchedule[i - 1]) / 360.0;
+		pv += coupon * notional * tau * dfs[i - first];
+	}
+	if (maturityDate >= valueDate)
+		pv += notional * dfs.back();
+
+	// backward sweep: each discounted cashflow c * exp(-r T) gives r_bar = -T * c * df
+	for (size_t i = bondSchedule.size(); i-- > first;)
+	{
+		double tau = (bondSchedule[i] - bondSchedule[i - 1]) / 360.0;
+		double dfBar = sign * coupon * notional * tau;
+		if (i + 1 == bondSchedule.size())
+			dfBar += sign * notional; // redemption
+		double T = (bondSchedule[i] - valueDate) / 360.0;
+		double rateBar = -T * dfs[i - first] * dfBar;
+		RateWeights w = rc->getRateWeights(bondSchedule[i]);
+		curveSens[w.i0] += w.w0 * rateBar;
+		curveSens[w.i1] += w.w1 * rateBar;
 	}
 	return sign * pv;
 }
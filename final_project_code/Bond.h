@@ -17,12 +17,32 @@ public:
         rateCurve = to_upper(name).substr(0, 3) == "SGD" ? "SGD-SORA" : "USD-SOFR";
         generateSchedule();
     }
+    // with a schedule generated before, eg. read from a PortfolioSnapshot
+    Bond(std::string name, Date start, Date end, double _notional, double rate, double freq, vector<Date> schedule)
+    {
+        tradeType = "Bond";
+        underlying = to_upper(name);
+        notional = _notional;
+        tradeDate = start;
+        startDate = start;
+        maturityDate = end;
+        frequency = freq;
+        coupon = rate;
+        rateCurve = to_upper(name).substr(0, 3) == "SGD" ? "SGD-SORA" : "USD-SOFR";
+        bondSchedule = std::move(schedule);
+    }
     inline string getType() const { return tradeType; };
     inline string getUnderlying() const { return underlying; };
     inline double getNotional() const { return notional; }
     void setTradePrice(double price) { tradePrice = price; }
     double Payoff(double s) const;      // implement this
     double Pv(const Market &mkt) const; // implement this
+    // pv plus d(pv)/d(pillar zero rate) of the discount curve, by one adjoint (reverse) sweep
+    double PvAdjoint(const Market &mkt, vector<double> &curveSens) const;
+    inline const string &getRateCurve() const { return rateCurve; }
+    inline double getCoupon() const { return coupon; }
+    inline const vector<Date> &getSchedule() const { return bondSchedule; } // start date, then the coupon dates
+    bool getMarketDependencies(vector<MarketDataId> &deps) const { deps.push_back({MarketDataId::Curve, rateCurve}); return true; }
     void generateSchedule();            // implement this
     std::string direction;
 
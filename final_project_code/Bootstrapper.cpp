@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include "Bootstrapper.h"
+#include "Swap.h"
+
+CurveBootstrapper::CurveBootstrapper(const string &curveName, const Date &asOf, const vector<CurveQuote> &quotes)
+	: name(curveName), curveDate(asOf)
+{
+	const size_t n = quotes.size();
+	vector<Date> maturities;
+	for (const auto &q : quotes)
+		maturities.push_back(dateAddTenor(asOf, q.tenor));
+	byMaturity.resize(n);
+	std::iota(byMaturity.begin(), byMaturity.end(), 0);
+	std::stable_sort(byMaturity.begin(), byMaturity.end(), [&](size_t a, size_t b)
+					 { return maturities[a] < maturities[b]; });
+	for (size_t k = 0; k < n; k++)
+	{
+		const Date &mat = maturities[byMaturity[k]];
+		if (!(asOf < mat) || (k > 0 && !(pillarDates.back() < mat)))
+			throw runtime_error("Error: curve " + curveName + " needs one instrument per maturity after the curve date, check " + quotes[byMaturity[k]].tenor);
+		pillarDates.push_back(mat);
+	}
+
+	// interpolation weights come from a curve with the pillars only, the rates do not matter
+	RateCurve grid(curveName);
+	grid._asOf = asOf;
+	for (const auto &d : pillarDates)
+		grid.addRate(d, 0.0);
+
+	for (size_t k = 0; k < n; k++)
+	{
+		const CurveQuote &q = quotes[byMaturity[k]];
+		Instrument ins;
+		ins.kind = q.kind;
+		ins.t = (pillarDates[k] - asOf) / 365.0;
+		ins.tau = ins.t;
+		if (q.kind == CurveQuote::ParSwap)
+		{
+			// the fixed leg of Swap::Pv: payments from the schedule, accrual and discounting /365
+			Swap swap(curveName, asOf, pillarDates[k], 1.0, 0.0, q.frequency);
+			const vector<Date> &schedule = swap.getSchedule();
+			for (size_t i = 1; i < schedule.size(); i++)
+			{
+				RateWeights w = grid.getRateWeights(schedule[i]);
+				ins.flows.push_back({(schedule[i] - schedule[i - 1]) / 365.0, (schedule[i] - asOf) / 365.0, w.i0, w.i1, w.w0, w.w1});
+			}
+		}
+		instruments.push_back(std::move(ins));
+	}
+}
+
+shared_ptr<RateCurve> CurveBootstrapper::build(const vector<double> &quotes)
+{
+	const size_t n = pillarDates.size();
+	if (quotes.size() != n)
+		throw runtime_error("Error: curve " + name + " has " + to_string(n) + " instruments, got " + to_string(quotes.size()) + " quotes");
+	zeros.assign(n, 0.0);
+	jac.assign(n * n, 0.0);
+	lastIterations = 0;
+
+	for (size_t k = 0; k < n; k++)
+	{
+		const Instrument &ins = instruments[k];
+		const double q = quotes[byMaturity[k]];
+		double *row = &jac[k * n];
+		if (ins.kind == CurveQuote::Deposit)
+		{
+			// exp(z t) = 1 + q tau, closed form
+			double growth = 1 + q * ins.tau;
+			if (growth <= 0)
+				throw runtime_error("Error: curve " + name + " deposit rate " + to_string(q) + " has no discount factor");
+			zeros[k] = std::log(growth) / ins.t;
+			row[k] = ins.t * growth / ins.tau;
+			continue;
+		}
+
+		// par swap: f(z) = 1 - df(T) - q * annuity(z) = 0. payments before the previous pillar
+		// only read solved pillars, their part of the annuity is summed once
+		const vector<Flow> &flows = ins.flows;
+		size_t first = 0;
+		double knownAnnuity = 0.0;
+		for (; first < flows.size() && flows[first].i1 < k; first++)
+		{
+			const Flow &f = flows[first];
+			knownAnnuity += f.tau * std::exp(-(f.w0 * zeros[f.i0] + f.w1 * zeros[f.i1]) * f.t);
+		}
+		zeros[k] = k > 0 ? zeros[k - 1] : q;
+		for (int iter = 0;; iter++)
+		{
+			if (iter == 50)
+				throw runtime_error("Error: curve " + name + " pillar " + to_string(k) + " did not converge");
+			double annuity = knownAnnuity, slope = 0.0; // slope = d annuity / d zeros[k]
+			for (size_t j = first; j < flows.size(); j++)
+			{
+				const Flow &f = flows[j];
+				double df = std::exp(-(f.w0 * zeros[f.i0] + f.w1 * zeros[f.i1]) * f.t);
+				double w = (f.i0 == k ? f.w0 : 0.0) + f.w1;
+				annuity += f.tau * df;
+				slope -= f.tau * df * f.t * w;
+			}
+			double dfT = std::exp(-zeros[k] * ins.t);
+			double step = (1 - dfT - q * annuity) / (ins.t * dfT - q * slope);
+			zeros[k] -= step;
+			lastIterations++;
+			if (std::abs(step) < 1e-15)
+				break;
+		}
+
+		// row k of the Jacobian: q = (1 - df(T)) / annuity, so
+		// dq / dz_m = (t df(T) [m == k] + q * sum tau df t w_m) / annuity
+		double annuity = 0.0;
+		for (const Flow &f : flows)
+			annuity += f.tau * std::exp(-(f.w0 * zeros[f.i0] + f.w1 * zeros[f.i1]) * f.t);
+		for (const Flow &f : flows)
+		{
+			double df = std::exp(-(f.w0 * zeros[f.i0] + f.w1 * zeros[f.i1]) * f.t);
+			double g = q * f.tau * df * f.t / annuity;
+			row[f.i0] += g * f.w0;
+			row[f.i1] += g * f.w1;
+		}
+		row[k] += ins.t * std::exp(-zeros[k] * ins.t) / annuity;
+	}
+
+	auto curve = make_shared<RateCurve>(name);
+	curve->_asOf = curveDate;
+	for (size_t k = 0; k < n; k++)
+		curve->addRate(pillarDates[k], zeros[k]);
+	return curve;
+}
+
+vector<double> CurveBootstrapper::parRisk(const vector<double> &zeroSens) const
+{
+	// zeroSens = J^T parSens with J lower triangular: back substitution from the last pillar
+	const size_t n = pillarDates.size();
+	if (zeroSens.size() != n || jac.size() != n * n)
+		throw runtime_error("Error: par risk of curve " + name + " needs a build and one sensitivity per pillar");
+	vector<double> g(n);
+	for (size_t k = n; k-- > 0;)
+	{
+		double s = zeroSens[k];
+		for (size_t m = k + 1; m < n; m++)
+			s -= jac[m * n + k] * g[m];
+		g[k] = s / jac[k * n + k];
+	}
+	vector<double> out(n);
+	for (size_t k = 0; k < n; k++)
+		out[byMaturity[k]] = g[k];
+	return out;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Date.h"
+#include "Market.h"
+
+using namespace std;
+
+// one calibration instrument of a curve, quoted from the curve date
+struct CurveQuote
+{
+	enum Kind
+	{
+		Deposit, // simple rate to maturity, df = 1 / (1 + rate * days / 365)
+		ParSwap	 // spot starting swap priced like Swap::Pv, fixed = float at the par rate
+	};
+	Kind kind;
+	string tenor;			// eg. "ON", "3M", "10Y"
+	double frequency = 0.5; // swaps only, like Swap: 0.25, 0.5 or 1
+};
+
+// builds a RateCurve (zero rates, linear interpolation, one pillar per instrument maturity)
+// from deposit and par swap quotes. all the date work (Swap's schedules, year fractions and
+// interpolation weights) happens once in the constructor, build() is arithmetic only so it
+// can rerun on every quote tick. each pillar is solved in maturity order by Newton with the
+// analytic derivative, and the same derivatives give the quote to zero rate Jacobian
+class CurveBootstrapper
+{
+public:
+	CurveBootstrapper(const string &curveName, const Date &asOf, const vector<CurveQuote> &instruments);
+
+	// quotes[i] is the rate of instruments[i]. throws if a pillar does not converge
+	shared_ptr<RateCurve> build(const vector<double> &quotes);
+
+	// pillars in maturity order, pillar k is the maturity of instrument order()[k]
+	inline const vector<Date> &pillars() const { return pillarDates; }
+	inline const vector<size_t> &order() const { return byMaturity; }
+	// zero rates of the last build, per pillar
+	inline const vector<double> &zeroRates() const { return zeros; }
+
+	// d quote / d zero rate of the last build, row major pillars x pillars and lower
+	// triangular: quote k only reads pillars 0..k
+	inline const vector<double> &jacobian() const { return jac; }
+
+	// d pv / d quote (in instrument order) from d pv / d pillar zero rate, eg. Swap::PvAdjoint
+	// on the built curve: one triangular solve with the Jacobian, no rebuilds
+	vector<double> parRisk(const vector<double> &zeroSens) const;
+
+	// Newton iterations of the last build, summed over the pillars
+	inline int iterations() const { return lastIterations; }
+
+private:
+	// one discounted date of an instrument, rate = w0 * zero[i0] + w1 * zero[i1]
+	struct Flow
+	{
+		double tau; // accrual, the fixed coupon is rate * tau
+		double t;	// discounting year fraction
+		size_t i0;
+		size_t i1;
+		double w0;
+		double w1;
+	};
+	struct Instrument
+	{
+		CurveQuote::Kind kind;
+		double t;	// maturity year fraction
+		double tau; // deposits: accrual to maturity
+		vector<Flow> flows; // swaps: fixed leg payments, the last one at the maturity pillar
+	};
+
+	string name;
+	Date curveDate;
+	vector<Date> pillarDates;
+	vector<size_t> byMaturity;	  // instrument index of each pillar
+	vector<Instrument> instruments; // per pillar
+	vector<double> zeros;
+	vector<double> jac;
+	int lastIterations = 0;
+};
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cmath>
+#include "CashflowLedger.h"
+#include "MathKernels.h"
+
+size_t CashflowLedger::add(const Trade &trade)
+{
+	if (auto swap = dynamic_cast<const Swap *>(&trade))
+		return add(*swap);
+	if (auto bond = dynamic_cast<const Bond *>(&trade))
+		return add(*bond);
+	return notLinear;
+}
+
+size_t CashflowLedger::add(const Swap &swap)
+{
+	const vector<Date> &schedule = swap.getSchedule();
+	uint32_t t = (uint32_t)trades.size();
+	double absNotional = std::abs(swap.getNotional());
+	trades.push_back({true, swap.getNotional(), 1.0, schedule.back()});
+
+	CurveFlows &flows = curves[swap.getRateCurve()];
+	flows.pendingSwaps.push_back({t, schedule.front(), schedule.back()});
+	for (size_t i = 1; i < schedule.size(); i++)
+	{
+		double tau = (schedule[i] - schedule[i - 1]) / 365.0;
+		flows.pendingSwapCoupons.push_back({schedule[i], t, absNotional * swap.getRate() * tau});
+	}
+	return t;
+}
+
+size_t CashflowLedger::add(const Bond &bond)
+{
+	const vector<Date> &schedule = bond.getSchedule();
+	uint32_t t = (uint32_t)trades.size();
+	string dir = to_lower(bond.direction);
+	trades.push_back({false, bond.getNotional(), dir == "short" ? -1.0 : 1.0, schedule.back()});
+
+	CurveFlows &flows = curves[bond.getRateCurve()];
+	flows.pendingBonds.push_back({t, schedule.front(), schedule.back()});
+	for (size_t i = 1; i < schedule.size(); i++)
+	{
+		double tau = (schedule[i] - schedule[i - 1]) / 360.0;
+		flows.pendingBondCoupons.push_back({schedule[i], t, bond.getCoupon() * bond.getNotional() * tau});
+	}
+	return t;
+}
+
+size_t CashflowLedger::flowCount() const
+{
+	size_t n = 0;
+	for (const auto &c : curves)
+	{
+		const CurveFlows &flows = c.second;
+		n += flows.swapCoupons.trade.size() + flows.bondCoupons.trade.size() + flows.pendingSwapCoupons.size() + flows.pendingBondCoupons.size();
+		// a start and a maturity per swap, a maturity per bond
+		n += 2 * (flows.swaps.trade.size() + flows.pendingSwaps.size()) + flows.bonds.trade.size() + flows.pendingBonds.size();
+	}
+	return n;
+}
+
+void CashflowLedger::merge(CurveFlows &flows) const
+{
+	// the new dates, merged into the sorted old ones. moved[k] is the new index of old date k
+	vector<Date> added;
+	for (const auto *pending : {&flows.pendingSwapCoupons, &flows.pendingBondCoupons})
+		for (const PendingCoupon &c : *pending)
+			added.push_back(c.date);
+	for (const auto *pending : {&flows.pendingSwaps, &flows.pendingBonds})
+		for (const PendingLeg &leg : *pending)
+		{
+			added.push_back(leg.start);
+			added.push_back(leg.end);
+		}
+	std::sort(added.begin(), added.end());
+	added.erase(std::unique(added.begin(), added.end()), added.end());
+	vector<Date> dates;
+	dates.reserve(flows.dates.size() + added.size());
+	vector<uint32_t> moved(flows.dates.size());
+	size_t k = 0, j = 0;
+	while (k < flows.dates.size() || j < added.size())
+	{
+		if (k < flows.dates.size() && (j == added.size() || flows.dates[k] <= added[j]))
+		{
+			if (j < added.size() && flows.dates[k] == added[j])
+				j++;
+			moved[k++] = (uint32_t)dates.size();
+			dates.push_back(flows.dates[k - 1]);
+		}
+		else
+			dates.push_back(added[j++]);
+	}
+	auto indexOf = [&](const Date &date)
+	{ return (uint32_t)(std::lower_bound(dates.begin(), dates.end(), date) - dates.begin()); };
+
+	// the new coupons sorted by date (stable, so a trade's coupons keep their schedule order)
+	// and merged with the old ones in one pass
+	auto mergeCoupons = [&](Coupons &coupons, vector<PendingCoupon> &pending)
+	{
+		std::stable_sort(pending.begin(), pending.end(), [](const PendingCoupon &a, const PendingCoupon &b)
+						 { return a.date < b.date; });
+		Coupons out;
+		size_t n = coupons.trade.size() + pending.size();
+		out.date.reserve(n);
+		out.trade.reserve(n);
+		out.amount.reserve(n);
+		auto push = [&](uint32_t date, uint32_t trade, double amount)
+		{
+			out.date.push_back(date);
+			out.trade.push_back(trade);
+			out.amount.push_back(amount);
+		};
+		size_t f = 0;
+		uint32_t d = 0;
+		for (const PendingCoupon &c : pending)
+		{
+			while (dates[d] < c.date)
+				d++;
+			for (; f < coupons.trade.size() && moved[coupons.date[f]] <= d; f++)
+				push(moved[coupons.date[f]], coupons.trade[f], coupons.amount[f]);
+			push(d, c.trade, c.amount);
+		}
+		for (; f < coupons.trade.size(); f++)
+			push(moved[coupons.date[f]], coupons.trade[f], coupons.amount[f]);
+		coupons = std::move(out);
+		vector<PendingCoupon>().swap(pending);
+	};
+	mergeCoupons(flows.swapCoupons, flows.pendingSwapCoupons);
+	mergeCoupons(flows.bondCoupons, flows.pendingBondCoupons);
+
+	auto mergeLegs = [&](Legs &legs, vector<PendingLeg> &pending)
+	{
+		for (size_t i = 0; i < legs.trade.size(); i++)
+		{
+			legs.start[i] = moved[legs.start[i]];
+			legs.end[i] = moved[legs.end[i]];
+		}
+		for (const PendingLeg &leg : pending)
+		{
+			legs.trade.push_back(leg.trade);
+			legs.start.push_back(indexOf(leg.start));
+			legs.end.push_back(indexOf(leg.end));
+		}
+		vector<PendingLeg>().swap(pending);
+	};
+	mergeLegs(flows.swaps, flows.pendingSwaps);
+	mergeLegs(flows.bonds, flows.pendingBonds);
+	flows.dates.swap(dates);
+}
+
+void CashflowLedger::value(const Market &mkt, vector<double> &pv) const
+{
+	{
+		lock_guard<mutex> lock(mergeMutex);
+		for (auto &c : curves)
+			if (!c.second.pendingSwaps.empty() || !c.second.pendingBonds.empty())
+				merge(c.second);
+	}
+
+	const Date valueDate = mkt.asOf;
+	size_t n = trades.size();
+	thread_local vector<double> fixed, dfStart, dfEnd, dfSwap, dfBond;
+	fixed.assign(n, 0.0);
+	dfStart.resize(n);
+	dfEnd.resize(n);
+
+	for (const auto &c : curves)
+	{
+		const CurveFlows &flows = c.second;
+		// dates before today are not discounted, like the firstPayment / lower_bound of the trades:
+		// their coupons are dropped, a start is worth 1 and a maturity 0
+		const uint32_t first = (uint32_t)(std::lower_bound(flows.dates.begin(), flows.dates.end(), valueDate) - flows.dates.begin());
+		const size_t nDates = flows.dates.size() - first;
+		const Date *dates = flows.dates.data() + first;
+		auto rc = mkt.getCurve(c.first);
+		if (!flows.swaps.trade.empty())
+		{
+			dfSwap.resize(nDates);
+			if (nDates)
+				rc->getDfs(dates, nDates, dfSwap.data());
+		}
+		if (!flows.bonds.trade.empty())
+		{
+			dfBond.resize(nDates);
+			if (nDates)
+				rc->getRates(dates, nDates, dfBond.data());
+			for (size_t k = 0; k < nDates; k++)
+				dfBond[k] = -dfBond[k] * ((dates[k] - valueDate) / 360.0);
+			imp::expBatch(dfBond.data(), dfBond.data(), nDates);
+		}
+
+		auto scatter = [&](const Coupons &coupons, const vector<double> &df)
+		{
+			const uint32_t *date = coupons.date.data(), *trade = coupons.trade.data();
+			const double *amount = coupons.amount.data();
+			size_t f = std::lower_bound(coupons.date.begin(), coupons.date.end(), first) - coupons.date.begin();
+			for (; f < coupons.date.size(); f++)
+				fixed[trade[f]] += amount[f] * df[date[f] - first];
+		};
+		scatter(flows.swapCoupons, dfSwap);
+		scatter(flows.bondCoupons, dfBond);
+		for (size_t k = 0; k < flows.swaps.trade.size(); k++)
+		{
+			uint32_t t = flows.swaps.trade[k], start = flows.swaps.start[k], end = flows.swaps.end[k];
+			dfStart[t] = start >= first ? dfSwap[start - first] : 1.0;
+			dfEnd[t] = end >= first ? dfSwap[end - first] : 0.0;
+		}
+		for (size_t k = 0; k < flows.bonds.trade.size(); k++)
+		{
+			uint32_t t = flows.bonds.trade[k], end = flows.bonds.end[k];
+			dfEnd[t] = end >= first ? dfBond[end - first] : 0.0;
+		}
+	}
+	pv.resize(n);
+	for (size_t t = 0; t < n; t++)
+	{
+		const TradeInfo &info = trades[t];
+		bool live = info.maturityDate >= valueDate;
+		if (info.isSwap)
+		{
+			double pvFloat = live ? std::abs(info.notional) * (dfStart[t] - dfEnd[t]) : 0.0;
+			pv[t] = info.notional > 0 ? pvFloat - fixed[t] : fixed[t] - pvFloat;
+		}
+		else
+		{
+			double value = fixed[t];
+			if (live)
+				value += info.notional * dfEnd[t];
+			pv[t] = info.sign * value;
+		}
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Date.h"
+#include "Market.h"
+#include "Trade.h"
+#include "Swap.h"
+#include "Bond.h"
+
+using namespace std;
+
+// the fixed cashflows of every swap and bond in flat arrays per curve, sorted by pay date.
+// value() discounts each curve's unique dates once and scatters amount * df into the trades,
+// instead of every trade walking its own schedule. per trade the flows are added in schedule
+// order with the same products as Swap::Pv / Bond::Pv, so the pvs are bit for bit the same
+// (once the curve's day table covers the dates, like the trades' own lookups)
+class CashflowLedger
+{
+public:
+	static constexpr size_t notLinear = size_t(-1);
+
+	// a Swap or a Bond: its flows go in and its pv index is returned. anything else is not
+	// added, notLinear. the trade is read now, later changes to it are not seen
+	size_t add(const Trade &trade);
+	size_t add(const Swap &swap);
+	size_t add(const Bond &bond);
+
+	inline size_t size() const { return trades.size(); }
+	size_t flowCount() const;
+
+	// pv[i] of the i-th added trade. flows added since the last call are merged in first
+	void value(const Market &mkt, vector<double> &pv) const;
+
+private:
+	struct TradeInfo
+	{
+		bool isSwap;
+		double notional; // signed
+		double sign;	 // bonds: -1 for short
+		Date maturityDate;
+	};
+	// fixed coupons sorted by pay date, fixed[trade] += amount * df[date]. swaps discount on
+	// 365 days through getDfs, bonds on 360 days, each kind has its own
+	struct Coupons
+	{
+		vector<uint32_t> date; // index into CurveFlows::dates
+		vector<uint32_t> trade;
+		vector<double> amount;
+	};
+	// the trades of one kind on a curve and the date indices of their start and maturity
+	struct Legs
+	{
+		vector<uint32_t> trade;
+		vector<uint32_t> start;
+		vector<uint32_t> end;
+	};
+	struct PendingCoupon
+	{
+		Date date;
+		uint32_t trade;
+		double amount;
+	};
+	struct PendingLeg
+	{
+		uint32_t trade;
+		Date start;
+		Date end;
+	};
+	struct CurveFlows
+	{
+		vector<Date> dates; // unique, sorted
+		Coupons swapCoupons, bondCoupons;
+		Legs swaps, bonds;
+		vector<PendingCoupon> pendingSwapCoupons, pendingBondCoupons;
+		vector<PendingLeg> pendingSwaps, pendingBonds;
+	};
+
+	void merge(CurveFlows &flows) const;
+
+	vector<TradeInfo> trades;
+	mutable map<string, CurveFlows> curves;
+	mutable mutex mergeMutex;
+};
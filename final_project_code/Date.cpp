@@ -1,146 +1,63 @@
 #include "Date.h"
 
-long Date::getSerialDate() const
-{ // 1900-1-1 ->1
-	// Adjust for Excel's incorrect leap year handling (Excel treats 1900 as a leap year)
-	int daysSinceEpoch = 0;
-	for (int y = 1900; y < year; ++y)
-	{
-		daysSinceEpoch += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
-	}
-
-	int daysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
-	if (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
-	{
-		daysInMonth[1] = 29; // Leap year adjustment
-	}
-
-	for (int m = 0; m < month - 1; ++m)
-	{
-		daysSinceEpoch += daysInMonth[m];
-	}
-
-	daysSinceEpoch += day;
-
-	// Excel incorrectly considers 1900 as a leap year, so we add 1 for compatibility
-	if (year > 1900)
-	{
-		daysSinceEpoch += 1;
-	}
-	return daysSinceEpoch;
-}
-void Date::serialToDate(int serial)
+Date dateAddTenor(const Date &start, const std::string &tenorStr)
 {
-	int daysSinceEpoch = serial - 2; // Adjust for Excel's incorrect leap year handling
-	int y = 1900;
-	int m = 1;
-	int d = 1;
-
-	while (daysSinceEpoch > 0)
+	if (!tenorStr.empty() && tolower(tenorStr[0]) == 'o')
 	{
-		int daysInMonth;
-		switch (m)
-		{
-		case 4:
-		case 6:
-		case 9:
-		case 11:
-			daysInMonth = 30;
-			break;
-		case 2:
-			daysInMonth = (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 29 : 28;
-			break;
-		default:
-			daysInMonth = 31;
-		}
-
-		if (daysSinceEpoch >= daysInMonth)
-		{
-			daysSinceEpoch -= daysInMonth;
-			m++;
-			if (m > 12)
-			{
-				m = 1;
-				y++;
-			}
-		}
-		else
-		{
-			d += daysSinceEpoch;
-			break;
-		}
+		string lower = to_lower(tenorStr);
+		if (lower == "on" || lower == "o/n")
+			return dateAddTenor(start, 1, 'D');
 	}
-
-	year = y;
-	month = m;
-	day = d;
-	serialNumber = serial;
+	int numUnit = stoi(tenorStr.substr(0, tenorStr.size() - 1));
+	auto tenorUnit = tenorStr.back();
+	if (tenorUnit != 'W' && tenorUnit != 'M' && tenorUnit != 'Y')
+		throw std::runtime_error("Error: found unsupported tenor: " + tenorStr);
+	return dateAddTenor(start, numUnit, tenorUnit);
 }
 
-Date dateAddTenor(const Date &start, const std::string &tenorStr)
+void couponSchedule(const Date &start, const Date &end, double freq, std::vector<Date> &schedule)
 {
-	Date newdate = start;
-	if (to_lower(tenorStr) == "on" || to_lower(tenorStr) == "o/n")
-	{
-		long newSerial = start.getSerialDate() + 1;
-		newdate.serialToDate(newSerial);
-	}
+	if (start == end || freq <= 0 || freq > 1)
+		throw std::runtime_error("Error: start date is later than end date, or invalid frequency!");
+
+	int months;
+	if (freq == 0.25)
+		months = 3;
+	else if (freq == 0.5)
+		months = 6;
 	else
+		months = 12;
+
+	schedule.clear();
+	Date seed = start;
+	for (int k = 1; seed < end; k++)
 	{
-		int numUnit = stoi(tenorStr.substr(0, tenorStr.size() - 1));
-		auto tenorUnit = tenorStr.back();
-		if (tenorUnit == 'W')
-		{
-			long newSerial = start.getSerialDate() + numUnit * 7;
-			newdate.serialToDate(newSerial);
-		}
-		else if (tenorUnit == 'M')
-		{
-			// add numUnit months, roll over year if needed
-			newdate.month += numUnit;
-			while (newdate.month > 12)
-			{
-				newdate.month -= 12;
-				newdate.year += 1;
-			}
-			// For simplicity, keep day constant
-			newdate.serialNumber = newdate.getSerialDate();
-		}
-		else if (tenorUnit == 'Y')
-		{
-			newdate.year += numUnit;
-			newdate.serialNumber = newdate.getSerialDate();
-		}
-		else
-			throw std::runtime_error("Error: found unsupported tenor: " + tenorStr);
+		schedule.push_back(seed);
+		seed = dateAddTenor(start, k * months, 'M');
 	}
-
-	return newdate;
-}
-
-// This function returns the number of days between two dates
-double operator-(const Date &d1, const Date &d2)
-{
-	long numOfDays = d1.getSerialDate() - d2.getSerialDate();
-	return numOfDays;
+	schedule.push_back(end);
+	if (schedule.size() < 2)
+		throw std::runtime_error("Error: invalid schedule, check input!");
 }
 
 // Output
 std::ostream &operator<<(std::ostream &os, const Date &d)
 {
-	os << d.year << "-";
-	if (d.month < 10)
+	civil::YMD ymd = civil::civilFromSerial(d.getSerialDate());
+	os << ymd.y << "-";
+	if (ymd.m < 10)
 		os << "0";
-	os << d.month << "-";
-	if (d.day < 10)
+	os << ymd.m << "-";
+	if (ymd.d < 10)
 		os << "0";
-	os << d.day;
+	os << ymd.d;
 	return os;
 }
 std::istream &operator>>(std::istream &is, Date &d)
 {
+	int y, m, dd;
 	char dash1, dash2;
-	is >> d.year >> dash1 >> d.month >> dash2 >> d.day;
-	d.serialNumber = d.getSerialDate();
+	is >> y >> dash1 >> m >> dash2 >> dd;
+	d.serialToDate(civil::serialFromCivil(y, m, dd));
 	return is;
 }
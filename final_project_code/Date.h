@@ -2,49 +2,140 @@
 #define DATE_H
 
 #include <iostream>
+#include <cstdint>
 #include "helper.h"
 
+namespace civil
+{
+	// days since 1970-01-01 for a proleptic gregorian y-m-d, O(1)
+	// the day may overflow the month (eg. 2025-02-31), it simply rolls forward
+	constexpr int32_t daysFromCivil(int y, int m, int d)
+	{
+		y -= m <= 2;
+		const int era = (y >= 0 ? y : y - 399) / 400;
+		const int yoe = y - era * 400;
+		const int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+		const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		return era * 146097 + doe - 719468;
+	}
+
+	// inverse of daysFromCivil, O(1)
+	struct YMD
+	{
+		int y;
+		int m;
+		int d;
+	};
+	constexpr YMD civilFromDays(int32_t z)
+	{
+		z += 719468;
+		const int era = (z >= 0 ? z : z - 146096) / 146097;
+		const int doe = z - era * 146097;
+		const int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+		const int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+		const int mp = (5 * doy + 2) / 153;
+		const int d = doy - (153 * mp + 2) / 5 + 1;
+		const int m = mp < 10 ? mp + 3 : mp - 9;
+		return YMD{yoe + era * 400 + (m <= 2), m, d};
+	}
+
+	// Excel style serial: 1900-01-01 -> 1, and one extra day from 1901 on
+	// (Excel treats 1900 as a leap year), same numbers as the old loop based version
+	constexpr int32_t kEpoch = daysFromCivil(1899, 12, 31);
+	constexpr int32_t kFirst1901 = daysFromCivil(1901, 1, 1);
+	constexpr int32_t kLastSerial1900 = kFirst1901 - kEpoch - 1;
+
+	constexpr int32_t serialFromCivil(int y, int m, int d)
+	{
+		const int32_t days = daysFromCivil(y, m, d);
+		return days - kEpoch + (days >= kFirst1901 ? 1 : 0);
+	}
+	constexpr YMD civilFromSerial(int32_t serial)
+	{
+		return civilFromDays(serial + kEpoch - (serial > kLastSerial1900 ? 1 : 0));
+	}
+}
+
+// a date is a single 4 byte excel serial number, y/m/d are derived on demand
 class Date
 {
 public:
-	Date() {};
-	Date(int y, int m, int d) : year(y), month(m), day(d)
+	constexpr Date() {};
+	constexpr Date(int y, int m, int d) : serialNumber(civil::serialFromCivil(y, m, d))
 	{
-		serialNumber = getSerialDate();
 		if (serialNumber < 1)
 			throw std::runtime_error("Error: invalid date, serial number is less than 1!");
 	};
 	Date(const std::string &strDate)
 	{
 		// format is "yyyy-mm-dd"
-		year = stoi(strDate.substr(0, 4));
-		month = stoi(strDate.substr(5, 2));
-		day = stoi(strDate.substr(8, 2));
-		serialNumber = getSerialDate();
+		int y = stoi(strDate.substr(0, 4));
+		int m = stoi(strDate.substr(5, 2));
+		int d = stoi(strDate.substr(8, 2));
+		serialNumber = civil::serialFromCivil(y, m, d);
 	};
+	static constexpr Date fromSerial(int32_t serial)
+	{
+		Date dt;
+		dt.serialNumber = serial;
+		return dt;
+	}
+
+	constexpr long getSerialDate() const { return serialNumber; }
+	constexpr void serialToDate(int serial) { serialNumber = serial; }
 
-	long getSerialDate() const;
-	void serialToDate(int serial);
+	constexpr int year() const { return civil::civilFromSerial(serialNumber).y; }
+	constexpr int month() const { return civil::civilFromSerial(serialNumber).m; }
+	constexpr int day() const { return civil::civilFromSerial(serialNumber).d; }
 
-	int year;
-	int month;
-	int day;
-	int serialNumber = 1;
+private:
+	int32_t serialNumber = 1;
 };
 
 // GLOBAL OPERATORS ONLY (No member versions)
-inline bool operator<(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() < rhs.getSerialDate(); }
-inline bool operator<=(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() <= rhs.getSerialDate(); }
-inline bool operator>(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() > rhs.getSerialDate(); }
-inline bool operator>=(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() >= rhs.getSerialDate(); }
-inline bool operator==(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() == rhs.getSerialDate(); }
-inline bool operator!=(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() != rhs.getSerialDate(); }
+constexpr bool operator<(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() < rhs.getSerialDate(); }
+constexpr bool operator<=(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() <= rhs.getSerialDate(); }
+constexpr bool operator>(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() > rhs.getSerialDate(); }
+constexpr bool operator>=(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() >= rhs.getSerialDate(); }
+constexpr bool operator==(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() == rhs.getSerialDate(); }
+constexpr bool operator!=(const Date &lhs, const Date &rhs) { return lhs.getSerialDate() != rhs.getSerialDate(); }
 
 // For year fraction
-double operator-(const Date &d1, const Date &d2);
+constexpr double operator-(const Date &d1, const Date &d2)
+{
+	// number of days between two dates
+	return d1.getSerialDate() - d2.getSerialDate();
+}
+
+// add n units of 'D', 'W', 'M' or 'Y', month/year keep the day of month (may roll over)
+constexpr Date dateAddTenor(const Date &start, int numUnit, char tenorUnit)
+{
+	if (tenorUnit == 'D')
+		return Date::fromSerial(start.getSerialDate() + numUnit);
+	if (tenorUnit == 'W')
+		return Date::fromSerial(start.getSerialDate() + numUnit * 7);
+
+	civil::YMD ymd = civil::civilFromSerial(start.getSerialDate());
+	if (tenorUnit == 'M')
+	{
+		// add numUnit months, roll over year if needed
+		int months = ymd.y * 12 + (ymd.m - 1) + numUnit;
+		ymd.y = months / 12;
+		ymd.m = months % 12 + 1;
+	}
+	else if (tenorUnit == 'Y')
+		ymd.y += numUnit;
+	else
+		throw std::runtime_error("Error: found unsupported tenor unit");
+	return Date::fromSerial(civil::serialFromCivil(ymd.y, ymd.m, ymd.d));
+}
 
 Date dateAddTenor(const Date &start, const std::string &tenorStr);
 
+// coupon dates of a swap or bond: the start date, then every 3, 6 or 12 months (freq 0.25,
+// 0.5, 1) rolled from the start so the day of month never drifts, then the end date
+void couponSchedule(const Date &start, const Date &end, double freq, std::vector<Date> &schedule);
+
 std::ostream &operator<<(std::ostream &os, const Date &d);
 std::istream &operator>>(std::istream &is, Date &d);
 
@@ -6,6 +6,7 @@
 #include "Payoff.h"
 #include "Types.h"
 #include "Pricer.h"
+#include "BlackScholes.h"
 #include <cmath>
 
 class EuropeanOption : public TreeProduct
@@ -29,12 +30,13 @@ public:
 	virtual double Payoff(double S) const override { return PAYOFF::VanillaOption(optType, strike, S); }
 	virtual const Date &GetExpiry() const override { return expiryDate; }
 	virtual double ValueAtNode(double S, double t, double continuation) const override { return continuation; }
+	virtual TreeTerms GetTreeTerms() const override { return TreeTerms{false, optType, strike}; }
 
 	virtual double Pv(const Market &mkt) const override
 	{
-		// Use CRR binomial tree model, 50 steps
-		CRRBinomialTreePricer pricer(50);
-		return pricer.Price(mkt, std::make_shared<EuropeanOption>(*this));
+		// tree model from DefaultTreeOptions(), CRR with 50 steps unless SetDefaultTreeOptions changed it
+		auto pricer = MakeTreePricer(DefaultTreeOptions());
+		return pricer->PriceTree(mkt, *this) * notional; // no copy of the trade per call
 	}
 
 	// Optional: Black-Scholes price for comparison
@@ -42,7 +44,7 @@ public:
 	{
 		double S = mkt.getStockPrice(underlying); // spot
 		double K = strike;
-		double T = (expiryDate - mkt.asOf) / 360.0;
+		double T = (expiryDate - mkt.asOf) / 365.0; // same year fraction as the tree
 		auto rc = mkt.getCurve(rateCurve);
 		double r = rc->getRate(expiryDate);
 		auto vc = mkt.getVolCurve("LOGVOL");
@@ -51,20 +53,16 @@ public:
 		if (T <= 0 || vol <= 0)
 			return 0.0;
 
-		double d1 = (std::log(S / K) + (r + 0.5 * vol * vol) * T) / (vol * std::sqrt(T));
-		double d2 = d1 - vol * std::sqrt(T);
-
-		auto N = [](double x)
-		{ return 0.5 * std::erfc(-x / std::sqrt(2)); };
-
-		double df = std::exp(-r * T);
-		double price = 0.0;
-		if (optType == OptionType::Call)
-			price = S * N(d1) - K * df * N(d2);
-		else
-			price = K * df * N(-d2) - S * N(-d1);
+		return bs::price(optType, S, K, T, r, vol) * notional;
+	}
 
-		return price * notional;
+	// closed form price and greeks per unit notional, see OptionGreeks
+	OptionGreeks BlackGreeks(const Market &mkt) const
+	{
+		double T = (expiryDate - mkt.asOf) / 365.0;
+		double r = mkt.getCurve(rateCurve)->getRate(expiryDate);
+		double vol = mkt.getVolCurve("LOGVOL")->getVol(expiryDate);
+		return bs::greeks(optType, mkt.getStockPrice(underlying), strike, T, r, vol);
 	}
 
 protected:
@@ -77,13 +75,17 @@ protected:
 class EuroCallSpread : public EuropeanOption
 {
 public:
-	EuroCallSpread(double _k1, double _k2, const Date &_expiry) : strike1(_k1), strike2(_k2)
+	EuroCallSpread(double _k1, double _k2, const Date &_expiry, const std::string &name = "", double _notional = 1) : strike1(_k1), strike2(_k2)
 	{
 		expiryDate = _expiry;
+		underlying = to_upper(name);
+		notional = _notional;
+		rateCurve = "USD-SOFR";
 		assert(_k1 < _k2);
 	};
 	virtual double Payoff(double S) const { return PAYOFF::CallSpread(strike1, strike2, S); };
 	virtual const Date &GetExpiry() const { return expiryDate; };
+	virtual TreeTerms GetTreeTerms() const override { return TreeTerms(); } // not a vanilla payoff
 
 private:
 	double strike1;
@@ -0,0 +1,102 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+#include "ImpliedVol.h"
+#include "BlackScholes.h"
+
+void impliedVols(const Market &mkt, const string &underlying, const string &rateCurve, const OptionQuotes &quotes,
+				 vector<double> &vols, ThreadPool &pool)
+{
+	const size_t n = quotes.size();
+	if (quotes.expiry.size() != n || quotes.type.size() != n || quotes.strike.size() != n)
+		throw runtime_error("Error: option quotes of " + underlying + " have arrays of different sizes");
+
+	// T and r once per expiry
+	const double S = mkt.getStockPrice(underlying);
+	auto curve = mkt.getCurve(rateCurve);
+	const size_t m = quotes.expiries.size();
+	vector<double> T(m), r(m);
+	for (size_t e = 0; e < m; e++)
+	{
+		T[e] = (quotes.expiries[e] - mkt.asOf) / 365.0;
+		r[e] = curve->getRate(quotes.expiries[e]);
+	}
+	for (size_t i = 0; i < n; i++)
+		if (quotes.expiry[i] >= m)
+			throw runtime_error("Error: option quote " + to_string(i) + " of " + underlying + " has no expiry");
+
+	vols.resize(n);
+	const size_t block = 4096;
+	pool.parallel_for(0, (n + block - 1) / block, [&](size_t b)
+					  {
+		size_t first = b * block, count = std::min(block, n - first);
+		vector<double> spot(count, S), t(count), rate(count);
+		for (size_t k = 0; k < count; k++)
+		{
+			t[k] = T[quotes.expiry[first + k]];
+			rate[k] = r[quotes.expiry[first + k]];
+		}
+		bs::impliedVolBatch(count, quotes.type.data() + first, quotes.price.data() + first, spot.data(),
+							quotes.strike.data() + first, t.data(), rate.data(), vols.data() + first); }, 1);
+}
+
+shared_ptr<VolCurve> buildAtmVolCurve(const string &curveName, const Market &mkt, const string &underlying,
+									  const string &rateCurve, const OptionQuotes &quotes, ThreadPool &pool)
+{
+	vector<double> vols;
+	impliedVols(mkt, underlying, rateCurve, quotes, vols, pool);
+
+	// log forward per expiry, then the nearest usable quote on each side of it in one pass
+	const double logS = std::log(mkt.getStockPrice(underlying));
+	auto curve = mkt.getCurve(rateCurve);
+	const size_t m = quotes.expiries.size();
+	vector<double> logF(m);
+	for (size_t e = 0; e < m; e++)
+		logF[e] = logS + curve->getRate(quotes.expiries[e]) * (quotes.expiries[e] - mkt.asOf) / 365.0;
+
+	const size_t none = quotes.size();
+	vector<size_t> below(m, none), above(m, none);
+	vector<double> kBelow(m), kAbove(m);
+	for (size_t i = 0; i < quotes.size(); i++)
+	{
+		if (!(vols[i] > 0) || !std::isfinite(vols[i]))
+			continue;
+		size_t e = quotes.expiry[i];
+		double k = std::log(quotes.strike[i]);
+		if (k <= logF[e])
+		{
+			if (below[e] == none || k > kBelow[e] || (k == kBelow[e] && quotes.type[i] == Put))
+			{
+				below[e] = i;
+				kBelow[e] = k;
+			}
+		}
+		else if (above[e] == none || k < kAbove[e] || (k == kAbove[e] && quotes.type[i] == Call))
+		{
+			above[e] = i;
+			kAbove[e] = k;
+		}
+	}
+
+	// VolCurve interpolates its tenors in the order they are added
+	vector<size_t> byDate(m);
+	std::iota(byDate.begin(), byDate.end(), 0);
+	std::sort(byDate.begin(), byDate.end(), [&](size_t a, size_t b)
+			  { return quotes.expiries[a] < quotes.expiries[b]; });
+
+	auto vc = make_shared<VolCurve>(curveName);
+	vc->_asOf = mkt.asOf;
+	for (size_t e : byDate)
+	{
+		double vol;
+		if (below[e] != none && above[e] != none)
+			vol = vols[below[e]] + (vols[above[e]] - vols[below[e]]) * (logF[e] - kBelow[e]) / (kAbove[e] - kBelow[e]);
+		else if (below[e] != none || above[e] != none)
+			vol = vols[below[e] != none ? below[e] : above[e]];
+		else
+			continue;
+		vc->addVol(quotes.expiries[e], vol);
+	}
+	return vc;
+}
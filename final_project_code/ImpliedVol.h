@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Date.h"
+#include "Market.h"
+#include "Types.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// option prices of one underlying as arrays, one entry per quote. a chain has many strikes
+// per expiry, so the expiries are listed once and quotes refer to them by index
+struct OptionQuotes
+{
+	vector<Date> expiries;
+	vector<uint32_t> expiry; // index into expiries
+	vector<OptionType> type; // Call or Put
+	vector<double> strike;
+	vector<double> price; // per unit notional, like bs::price
+
+	inline size_t size() const { return price.size(); }
+	inline void add(uint32_t expiryIndex, OptionType optType, double K, double px)
+	{
+		expiry.push_back(expiryIndex);
+		type.push_back(optType);
+		strike.push_back(K);
+		price.push_back(px);
+	}
+};
+
+// vols[i] is the implied vol of quote i against the market's spot and the zero rate of
+// rateCurve, T in days / 365 like the pricers. blocks of quotes run bs::impliedVolBatch on
+// the pool. nan where the price is outside the no-arbitrage bounds
+void impliedVols(const Market &mkt, const string &underlying, const string &rateCurve, const OptionQuotes &quotes,
+				 vector<double> &vols, ThreadPool &pool = defaultThreadPool());
+
+// the atm curve of a chain for VolCurve::addVol: per expiry, the implied vol at the forward,
+// linear in log strike between the nearest quoted strikes on either side of it (the nearest
+// one when all are on one side, out of the money on a tie). expiries without a usable
+// quote are left out
+shared_ptr<VolCurve> buildAtmVolCurve(const string &curveName, const Market &mkt, const string &underlying,
+									  const string &rateCurve, const OptionQuotes &quotes, ThreadPool &pool = defaultThreadPool());
@@ -0,0 +1,172 @@
+#include "Lattice.h"
+#include "MathKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LATTICE_X86_DISPATCH 1
+#endif
+
+namespace lattice
+{
+	namespace
+	{
+		// strikes per SIMD group, states are padded to a multiple of it
+		constexpr size_t strikeLanes = imp::lanes;
+
+		// states are node major, strike minor: v[i * nStrikes + j]. the payoff is x > 0 ? x : 0
+		// with x = sign * (S - K) so a nan spot pays 0 like the scalar payoffs
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi" // see MathKernels.h
+		using imp::Lanes;
+		using imp::loadLanes;
+		using imp::storeLanes;
+
+		// inlined into each target specific copy below, so the vector type lowers to
+		// SSE2, AVX2 or AVX-512 instructions
+		template <bool American>
+		__attribute__((always_inline)) inline void rollBackKernel(const TreeParams &tp, const double *strikes, const double *signs,
+																  size_t nStrikes, double *v, double *s)
+		{
+			const size_t K = nStrikes;
+			const Lanes zero = {};
+			for (int i = 0; i <= tp.nSteps; i++)
+				for (size_t j = 0; j < K; j += strikeLanes)
+				{
+					Lanes x = loadLanes(signs + j) * (s[i] - loadLanes(strikes + j));
+					storeLanes(v + i * K + j, x > zero ? x : zero);
+				}
+
+			const double pu = tp.df * tp.p;
+			const double pd = tp.df * (1 - tp.p);
+			const double invU = 1 / tp.u;
+			for (int k = tp.nSteps - 1; k >= 0; k--)
+			{
+				if (American)
+				{
+					for (int i = 0; i <= k; i++)
+						s[i] *= invU;
+					if (k == 0)
+						s[0] = tp.S0;
+				}
+				for (int i = 0; i <= k; i++)
+				{
+					double *vi = v + i * K;
+					const double *vn = vi + K;
+					for (size_t j = 0; j < K; j += strikeLanes)
+					{
+						Lanes cont = pu * loadLanes(vi + j) + pd * loadLanes(vn + j);
+						if (American)
+						{
+							Lanes x = loadLanes(signs + j) * (s[i] - loadLanes(strikes + j));
+							Lanes exercise = x > zero ? x : zero;
+							cont = exercise < cont ? cont : exercise; // max(exercise, cont)
+						}
+						storeLanes(vi + j, cont);
+					}
+				}
+			}
+		}
+#pragma GCC diagnostic pop
+#else
+		template <bool American>
+		inline void rollBackKernel(const TreeParams &tp, const double *strikes, const double *signs, size_t nStrikes, double *v, double *s)
+		{
+			const size_t K = nStrikes;
+			for (int i = 0; i <= tp.nSteps; i++)
+				for (size_t j = 0; j < K; j++)
+				{
+					double x = signs[j] * (s[i] - strikes[j]);
+					v[i * K + j] = x > 0 ? x : 0.0;
+				}
+
+			const double pu = tp.df * tp.p;
+			const double pd = tp.df * (1 - tp.p);
+			const double invU = 1 / tp.u;
+			for (int k = tp.nSteps - 1; k >= 0; k--)
+			{
+				if (American)
+				{
+					for (int i = 0; i <= k; i++)
+						s[i] *= invU;
+					if (k == 0)
+						s[0] = tp.S0;
+				}
+				for (int i = 0; i <= k; i++)
+					for (size_t j = 0; j < K; j++)
+					{
+						double cont = pu * v[i * K + j] + pd * v[(i + 1) * K + j];
+						if (American)
+						{
+							double x = signs[j] * (s[i] - strikes[j]);
+							double exercise = x > 0 ? x : 0.0;
+							cont = exercise < cont ? cont : exercise;
+						}
+						v[i * K + j] = cont;
+					}
+			}
+		}
+#endif
+
+		void rollBackScalar(const TreeParams &tp, bool american, const double *strikes, const double *signs, size_t n, double *v, double *s)
+		{
+			american ? rollBackKernel<true>(tp, strikes, signs, n, v, s) : rollBackKernel<false>(tp, strikes, signs, n, v, s);
+		}
+
+#ifdef LATTICE_X86_DISPATCH
+		__attribute__((target("avx2")))
+		void rollBackAvx2(const TreeParams &tp, bool american, const double *strikes, const double *signs, size_t n, double *v, double *s)
+		{
+			american ? rollBackKernel<true>(tp, strikes, signs, n, v, s) : rollBackKernel<false>(tp, strikes, signs, n, v, s);
+		}
+
+		__attribute__((target("avx512f")))
+		void rollBackAvx512(const TreeParams &tp, bool american, const double *strikes, const double *signs, size_t n, double *v, double *s)
+		{
+			american ? rollBackKernel<true>(tp, strikes, signs, n, v, s) : rollBackKernel<false>(tp, strikes, signs, n, v, s);
+		}
+#endif
+
+		using RollBackFn = void (*)(const TreeParams &, bool, const double *, const double *, size_t, double *, double *);
+		RollBackFn selectRollBack()
+		{
+#ifdef LATTICE_X86_DISPATCH
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+				return rollBackAvx512;
+			if (__builtin_cpu_supports("avx2"))
+				return rollBackAvx2;
+#endif
+			return rollBackScalar;
+		}
+	}
+
+	void priceStrikes(const TreeParams &tp, bool american, const double *strikes, const double *signs, size_t nStrikes,
+					  std::vector<double> &states, std::vector<double> &spots, double *out)
+	{
+		static const RollBackFn rollBack = selectRollBack();
+
+		// strikes go in blocks small enough that a block's states stay in cache
+		const size_t cacheDoubles = 32768; // 256KB
+		size_t block = std::max(cacheDoubles / (tp.nSteps + 1) / strikeLanes, (size_t)1) * strikeLanes;
+		block = std::min(block, (nStrikes + strikeLanes - 1) / strikeLanes * strikeLanes);
+
+		// states of a block, then its strikes and signs padded with zeros (padding pays 0)
+		states.resize((tp.nSteps + 1) * block + 2 * block);
+		double *v = states.data();
+		double *blockStrikes = v + (tp.nSteps + 1) * block;
+		double *blockSigns = blockStrikes + block;
+		for (size_t first = 0; first < nStrikes; first += block)
+		{
+			size_t n = std::min(block, nStrikes - first);
+			for (size_t j = 0; j < block; j++)
+			{
+				blockStrikes[j] = j < n ? strikes[first + j] : 0.0;
+				blockSigns[j] = j < n ? signs[first + j] : 0.0;
+			}
+			terminalSpots(tp, spots);
+			rollBack(tp, american, blockStrikes, blockSigns, block, v, spots.data());
+			for (size_t j = 0; j < n; j++)
+				out[first + j] = v[j];
+		}
+	}
+}
@@ -0,0 +1,174 @@
+#ifndef _LATTICE_H
+#define _LATTICE_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "TreeProduct.h"
+#include "Payoff.h"
+
+// backward induction kernels for recombining binomial trees. the payoff and the
+// exercise rule are template policies so the per node loop has no virtual calls
+namespace lattice
+{
+	// payoffs, inlined into the node loop. written like PAYOFF::VanillaOption so a
+	// degenerate (nan) spot pays 0 the same way
+	struct CallPayoff
+	{
+		double strike;
+		double operator()(double S) const { return S > strike ? S - strike : 0.0; }
+	};
+	struct PutPayoff
+	{
+		double strike;
+		double operator()(double S) const { return S < strike ? strike - S : 0.0; }
+	};
+	struct VanillaPayoff // binaries, keeps the PAYOFF switch but no virtual call
+	{
+		OptionType optType;
+		double strike;
+		double operator()(double S) const { return PAYOFF::VanillaOption(optType, strike, S); }
+	};
+
+	// exercise rules, node() gets the spot, the node time and the continuation value
+	template <class Payoff>
+	struct EuropeanExercise
+	{
+		static constexpr bool usesSpot = false;
+		Payoff payoff;
+		double terminal(double S) const { return payoff(S); }
+		double node(double, double, double continuation) const { return continuation; }
+	};
+	template <class Payoff>
+	struct AmericanExercise
+	{
+		static constexpr bool usesSpot = true;
+		Payoff payoff;
+		double terminal(double S) const { return payoff(S); }
+		double node(double S, double, double continuation) const { return std::max(payoff(S), continuation); }
+	};
+	// anything else goes through the trade's virtuals
+	struct TradeExercise
+	{
+		static constexpr bool usesSpot = true;
+		const TreeProduct *trade;
+		double terminal(double S) const { return trade->Payoff(S); }
+		double node(double S, double t, double continuation) const { return trade->ValueAtNode(S, t, continuation); }
+	};
+
+	// the tree: node (k, i) has spot S0 * u^(k-i) * d^i, i = 0 is the top node
+	struct TreeParams
+	{
+		int nSteps;
+		double S0;
+		double u;
+		double d;
+		double p;  // probability of the up move
+		double df; // one step discount factor
+		double dt;
+		double t0 = 0; // time of the root, < 0 for a tree started before today
+	};
+
+	// terminal spots by multiplicative recurrence, no pow per node
+	inline void terminalSpots(const TreeParams &tp, std::vector<double> &spots)
+	{
+		spots.resize(tp.nSteps + 1);
+		double ratio = tp.d / tp.u;
+		double s = tp.S0 * std::pow(tp.u, tp.nSteps);
+		for (int i = 0; i <= tp.nSteps; i++)
+		{
+			spots[i] = s;
+			s *= ratio;
+		}
+	}
+
+	// rolls states back from step `fromStep` to step `toStep`, spots must hold the
+	// spots of `fromStep`. the inner loops are branch free and vectorizable
+	template <class Exercise>
+	void rollBack(const TreeParams &tp, const Exercise &ex, int fromStep, int toStep, std::vector<double> &states, std::vector<double> &spots)
+	{
+		const double pu = tp.df * tp.p;
+		const double pd = tp.df * (1 - tp.p);
+		const double invU = 1 / tp.u;
+		double *v = states.data();
+		double *s = spots.data();
+		for (int k = fromStep - 1; k >= toStep; k--)
+		{
+			if constexpr (Exercise::usesSpot)
+			{
+				for (int i = 0; i <= k; i++)
+					s[i] *= invU; // S0 u^(k+1-i) d^i -> S0 u^(k-i) d^i
+				if (k == 0)
+					s[0] = tp.S0; // exact root spot, no recurrence drift
+			}
+			const double t = tp.t0 + tp.dt * k;
+			for (int i = 0; i <= k; i++)
+				v[i] = ex.node(s[i], t, pu * v[i] + pd * v[i + 1]);
+		}
+	}
+
+	template <class Exercise>
+	double price(const TreeParams &tp, const Exercise &ex, std::vector<double> &states, std::vector<double> &spots)
+	{
+		terminalSpots(tp, spots);
+		states.resize(tp.nSteps + 1);
+		for (int i = 0; i <= tp.nSteps; i++)
+			states[i] = ex.terminal(spots[i]);
+		rollBack(tp, ex, tp.nSteps, 0, states, spots);
+		return states[0];
+	}
+
+	// nodes of a tree started two steps before today (Pelsser-Vorst), what the greeks are read
+	// from: the three nodes of step 2 straddle today's spot, the root is two steps earlier
+	struct ExtendedNodes
+	{
+		double S[3]; // spots of step 2, top node first
+		double V[3];
+		double root;
+		double rootValue;
+	};
+
+	// rolls states from step `fromStep` back to the root like rollBack, keeping step 2
+	template <class Exercise>
+	ExtendedNodes rollBackExtended(const TreeParams &tp, const Exercise &ex, int fromStep, std::vector<double> &states, std::vector<double> &spots)
+	{
+		ExtendedNodes nodes;
+		rollBack(tp, ex, fromStep, 2, states, spots);
+		for (int i = 0; i < 3; i++)
+		{
+			nodes.S[i] = tp.S0 * std::pow(tp.u, 2 - i) * std::pow(tp.d, i);
+			nodes.V[i] = states[i];
+		}
+		rollBack(tp, ex, 2, 0, states, spots);
+		nodes.root = tp.S0;
+		nodes.rootValue = states[0];
+		return nodes;
+	}
+
+	// one lattice, many call/put strikes (signs[j] is +1 for a call, -1 for a put), out[j] is
+	// the price of strike j. runs across strikes with SIMD, see Lattice.cpp
+	void priceStrikes(const TreeParams &tp, bool american, const double *strikes, const double *signs, size_t nStrikes,
+					  std::vector<double> &states, std::vector<double> &spots, double *out);
+
+	// picks the inlined policy for the trade's payoff and calls fn(exercise)
+	template <class Fn>
+	auto withExercise(const TreeProduct &trade, Fn &&fn)
+	{
+		TreeTerms terms = trade.GetTreeTerms();
+		switch (terms.optType)
+		{
+		case Call:
+			return terms.american ? fn(AmericanExercise<CallPayoff>{{terms.strike}}) : fn(EuropeanExercise<CallPayoff>{{terms.strike}});
+		case Put:
+			return terms.american ? fn(AmericanExercise<PutPayoff>{{terms.strike}}) : fn(EuropeanExercise<PutPayoff>{{terms.strike}});
+		case BinaryCall:
+		case BinaryPut:
+			return terms.american ? fn(AmericanExercise<VanillaPayoff>{{terms.optType, terms.strike}}) : fn(EuropeanExercise<VanillaPayoff>{{terms.optType, terms.strike}});
+		default:
+			return fn(TradeExercise{&trade});
+		}
+	}
+}
+
+#endif
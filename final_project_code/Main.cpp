@@ -1,99 +1,78 @@
 #include <fstream>
 #include <ctime>
 #include <chrono>
+#include <filesystem>
 
 #include "Market.h"
 #include "Pricer.h"
 #include "RiskEngine.h"
 #include "Factory.h"
+#include "TradeLoader.h"
+#include "PortfolioSnapshot.h"
+#include "ResultWriter.h"
 #include "thread_pool.h"
 #include "helper.h"
+#include "Benchmark.h"
 
 using namespace std;
 
-struct TradeResult
-{
-	size_t id;
-	string tradeInfo;
-	double PV = 0;
-	double DV01 = 0;
-	double Vega = 0;
-};
-
-// Simple trim
-static inline std::string trim(const std::string &s)
-{
-	auto start = s.begin();
-	while (start != s.end() && std::isspace(*start))
-		start++;
-	auto end = s.end();
-	do
-	{
-		end--;
-	} while (std::distance(start, end) > 0 && std::isspace(*end));
-	return std::string(start, end + 1);
-}
-
-// Loads all trades from trade.txt using the correct factory for each type
+// Loads all trades from trade.txt using the correct factory for each type, malformed rows
+// are reported with their line number and skipped. a trade.snap written from trade.txt as it
+// is now (same size and write time) is opened instead, unless it cannot be read
 void loadTrade(vector<shared_ptr<Trade>> &myPortfolio)
 {
 	string fileName = "trade.txt";
-	string header;
-	vector<string> tradeData;
-	readFromFile(fileName, header, tradeData);
-	vector<string> tradeHeader = split(header, ";");
-	for (size_t i = 0; i < tradeData.size(); i++)
+	string snapName = "trade.snap";
+	std::error_code ec;
+	if (std::filesystem::exists(snapName, ec))
 	{
-		vector<string> tradeInfo = split(tradeData[i], ";");
-		int id = stoi(tradeInfo[0]);
-		string type = tradeInfo[1];
-		Date tradeDate = Date(tradeInfo[2]);
-		Date startDate = Date(tradeInfo[3]);
-		Date endDate = Date(tradeInfo[4]);
-		double notional = stod(tradeInfo[5]);
-		string undelrying = tradeInfo[6];
-		double rate = stod(tradeInfo[7]);
-		double strike = stod(tradeInfo[8]);
-		double freq = stod(tradeInfo[9]);
-		string optionTypeStr = tradeInfo[10];
-		string direction = trim(tradeInfo[11]); // Read the direction column
-		std::transform(direction.begin(), direction.end(), direction.begin(), ::tolower);
-
-		// Adjust notional based on direction for correct PV sign
-		if (direction == "receive" || direction == "short")
-		{
-			notional *= -1.0;
-		}
-		OptionType optionType = OptionType::None;
-		if (optionTypeStr == "call")
-			optionType = OptionType::Call;
-		else if (optionTypeStr == "put")
-			optionType = OptionType::Put;
-		else
-			optionType = OptionType::None;
-
-		shared_ptr<Trade> trade;
-		if (type == "bond")
+		try
 		{
-			auto bFactory = std::make_unique<BondFactory>();
-			trade = bFactory->createTrade(undelrying, startDate, endDate, notional, rate, freq, optionType);
+			PortfolioSnapshot snap(snapName);
+			if (snap.source() == PortfolioSnapshot::Source::of(fileName))
+			{
+				myPortfolio = snap.trades();
+				return;
+			}
+			cerr << "Error: " << snapName << " was not written from the current " << fileName << ", loading " << fileName << endl;
 		}
-		else if (type == "swap")
+		catch (const runtime_error &e)
 		{
-			auto sFactory = std::make_unique<SwapFactory>();
-			trade = sFactory->createTrade(undelrying, startDate, endDate, notional, rate, freq, optionType);
+			cerr << e.what() << ", loading " << fileName << endl;
 		}
-		else if (type == "european")
-		{
-			auto eFactory = std::make_unique<EurOptFactory>();
-			trade = eFactory->createTrade(undelrying, startDate, endDate, notional, strike, freq, optionType);
-		}
-		else if (type == "american")
+	}
+	vector<TradeLoadError> errors;
+	myPortfolio = loadTrades(fileName, errors);
+	for (const auto &err : errors)
+		cerr << "Error: " << fileName << " line " << err.line << ": " << err.message << endl;
+}
+
+// text trade file to binary snapshot, returns the process exit code. a file with malformed
+// rows is not converted, the snapshot would drop them without a word on every later run
+int convertTrades(const string &fileName, const string &snapName)
+{
+	try
+	{
+		auto source = PortfolioSnapshot::Source::of(fileName); // before reading, a later edit makes it stale
+		MappedFile file(fileName);
+		vector<TradeRow> rows;
+		vector<TradeLoadError> errors;
+		parseTradeRows(file.data(), file.size(), rows, errors);
+		for (const auto &err : errors)
+			cerr << "Error: " << fileName << " line " << err.line << ": " << err.message << endl;
+		if (!errors.empty())
 		{
-			auto aFactory = std::make_unique<AmericanOptFactory>();
-			trade = aFactory->createTrade(undelrying, startDate, endDate, notional, strike, freq, optionType);
+			cerr << "Error: " << errors.size() << " malformed rows, " << snapName << " not written" << endl;
+			return 1;
 		}
-		myPortfolio.push_back(trade);
+		PortfolioSnapshot::write(snapName, rows, source);
+		cout << "wrote " << rows.size() << " trades to " << snapName << endl;
+		return 0;
+	}
+	catch (const exception &e)
+	{
+		cerr << e.what() << endl;
+		return 1;
 	}
 }
 
@@ -162,23 +141,33 @@ void loadVolCurve(Market &mkt, const string &fileName, const string &curveName)
 	mkt.addVolCurve(curveName, curve);
 }
 
-// Output PV, Delta, Vega per trade to output.txt
+// Output PV, Delta, Vega per trade to output.txt, streamed through a ResultWriter
 void outPutResult(const vector<TradeResult> &results)
 {
-	vector<string> output;
-	size_t i = 0;
-	for (auto re : results)
+	try
 	{
-		i++;
-		string row;
-		row = to_string(re.id) + "; " + re.tradeInfo + "; PV:" + to_string(re.PV) + "; Delta:" + to_string(re.DV01) + "; Vega:" + to_string(re.Vega);
-		output.push_back(row);
+		ResultWriter writer("output.txt", ResultFormat::Text);
+		for (const auto &re : results)
+			writer.write(re);
+		writer.close();
+	}
+	catch (const exception &e)
+	{
+		cerr << e.what() << endl;
 	}
-	outputToFile("output.txt", output);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+	// ./main --bench <name> runs a micro benchmark instead of the pricing flow
+	if (argc > 2 && string(argv[1]) == "--bench")
+		return runBenchmark(argv[2]);
+	// ./main --convert-trades [trade.txt] [trade.snap] writes the binary snapshot loadTrade prefers
+	if (argc > 1 && string(argv[1]) == "--convert-trades")
+		return convertTrades(argc > 2 ? argv[2] : "trade.txt", argc > 3 ? argv[3] : "trade.snap");
+	// ./main --key-rate also prints the key rate dv01 of every trade, one line each
+	const bool showKeyRate = argc > 1 && string(argv[1]) == "--key-rate";
+
 	// Get the current system time
 	auto now = std::chrono::system_clock::now();
 	std::time_t t = std::chrono::system_clock::to_time_t(now);
@@ -224,10 +213,12 @@ int main()
 	// step 3, creat a pricer and price the portfolio, output the pricing result of each deal
 	vector<TradeResult> results;
 	auto pricer = make_shared<CRRBinomialTreePricer>(50);
+	vector<double> pvs;
+	pricer->PricePortfolio(*mkt, myPortfolio, pvs); // options on one underlying and expiry share a tree
 	for (size_t i = 0; i < myPortfolio.size(); i++)
 	{
 		auto &trade = myPortfolio[i];
-		double pv = pricer->Price(*mkt, trade);
+		double pv = pvs[i];
 		cout << "Trade " << i << " (" << trade->getType() << "): PV = " << pv << endl;
 		// log pv details out in a file
 		TradeResult re;
@@ -274,57 +265,58 @@ int main()
 	re.computeRisk("dv01", swap, true);
 	auto dv01_of_swap = re.getResult();
 
-	// example 3, demo using thread pool
+	// example 3, demo using thread pool, each task hands its result back through a future
 	if (true)
 	{
 		map<string, double> swapDv01;
-		ThreadPool pool(4);
+		ThreadPool &pool = defaultThreadPool();
 
-		auto pv_job = [&swapDv01, risk_id, &eCall, &m_up, &m_down]()
+		auto pv_job = [&eCall, &m_up, &m_down]()
 		{
 			cout << "Task is running on thread: " << this_thread::get_id() << endl;
 			auto pricer = std::make_unique<CRRBinomialTreePricer>(50);
 			double pv_u = pricer->Price(m_up, eCall);
 			double pv_d = pricer->Price(m_down, eCall);
-			double dv01 = (pv_u - pv_d) / 2.;
-			swapDv01.emplace(std::make_pair(risk_id, dv01));
-			this_thread::sleep_for(chrono::milliseconds(100));
+			return (pv_u - pv_d) / 2.;
 		};
 
+		vector<future<double>> jobs;
 		for (int i = 0; i < 5; ++i)
 		{
-			pool.enqueue(pv_job);
+			jobs.push_back(pool.submit(pv_job));
+		}
+		for (auto &job : jobs)
+		{
+			swapDv01[risk_id] = job.get();
 		}
 	}
 
-	// ---- Main requirement: compute DV01/Vega for each trade in portfolio ----
-	// RiskEngine: for each trade, compute DV01 and Vega using central difference
-
-	for (size_t i = 0; i < myPortfolio.size(); i++)
+	// example 4, key rate dv01 of the whole portfolio, one column per curve pillar. a line per
+	// trade floods the output of a real book, so only with --key-rate
+	if (showKeyRate)
 	{
-		auto &trade = myPortfolio[i];
-		// Risk computation for current trade
-		RiskEngine risk(*mkt, curve_shock, vol_shock, price_shock);
-
-		// Compute DV01 for all curves (sum up for total Delta)
-		risk.computeRisk("dv01", trade, true);
-		auto dv01_result = risk.getResult();
-		double totalDelta = 0.0;
-		for (auto &kv : dv01_result)
+		auto keyRate = re.computeKeyRateRisk(myPortfolio, {"USD-SOFR", "SGD-SORA"}, defaultThreadPool());
+		for (size_t i = 0; i < keyRate.nTrades; i++)
 		{
-			totalDelta += kv.second;
+			cout << "Trade " << i << " key rate dv01:";
+			for (size_t j = 0; j < keyRate.columns(); j++)
+			{
+				if (keyRate.at(i, j) != 0)
+					cout << " " << keyRate.curveIds[j] << "@" << keyRate.pillars[j] << "=" << keyRate.at(i, j);
+			}
+			cout << endl;
 		}
-		results[i].DV01 = totalDelta;
+	}
 
-		// Compute Vega (sum up for total Vega)
-		risk.computeRisk("vega", trade, true);
-		auto vega_result = risk.getResult();
-		double totalVega = 0.0;
-		for (auto &kv : vega_result)
-		{
-			totalVega += kv.second;
-		}
-		results[i].Vega = totalVega;
+	// ---- Main requirement: compute DV01/Vega for each trade in portfolio ----
+	// RiskEngine: the scenario markets are built once, every trade is priced under every
+	// scenario on the pool, DV01 and Vega are central differences of that grid
+
+	auto portfolioRisk = re.computePortfolioRisk(myPortfolio, defaultThreadPool());
+	for (size_t i = 0; i < myPortfolio.size(); i++)
+	{
+		results[i].DV01 = portfolioRisk.totalDv01(i); // summed over all curves
+		results[i].Vega = portfolioRisk.vega[i];
 	}
 
 	// step 5, output result to file
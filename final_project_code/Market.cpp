@@ -1,4 +1,5 @@
 #include "Market.h"
+#include "MathKernels.h"
 #include <cmath>
 #include <algorithm>
 
@@ -16,6 +17,30 @@ namespace imp
 		else
 			return y0 + (x - x0) * (y1 - y0) / (x1 - x0);
 	}
+
+	// same result as lower_bound + linearInterpolate for every date, ascending dates
+	// walk the tenors once, unsorted input falls back to a binary search per date
+	void linearInterpolate(const vector<Date>& xs, const vector<double>& ys, const Date* dates, size_t n, double* out)
+	{
+		bool ascending = std::is_sorted(dates, dates + n);
+		size_t seg = 0; // index of the first tenor >= date
+		for (size_t i = 0; i < n; i++)
+		{
+			const Date& date = dates[i];
+			if (ascending)
+				while (seg < xs.size() && xs[seg] < date)
+					seg++;
+			else
+				seg = std::lower_bound(xs.begin(), xs.end(), date) - xs.begin();
+
+			if (seg == xs.size())
+				out[i] = ys.back();
+			else if (seg == 0 || xs[seg] == date)
+				out[i] = ys[seg];
+			else
+				out[i] = linearInterpolate(xs[seg - 1].getSerialDate(), ys[seg - 1], xs[seg].getSerialDate(), ys[seg], date.getSerialDate());
+		}
+	}
 }
 
 void RateCurve::display() const
@@ -34,9 +59,10 @@ void RateCurve::addRate(Date tenor, double rate)
 	{
 		tenors.push_back(tenor);
 		rates.push_back(rate);
+		table.reset();
 	}
 }
-double RateCurve::getRate(Date date) const
+double RateCurve::interpolateRate(Date date) const
 {
 	// use linear interpolation to get rate
 	auto it = std::lower_bound(tenors.begin(), tenors.end(), date);
@@ -60,19 +86,155 @@ double RateCurve::getRate(Date date) const
 		return newRate;
 	}
 }
+RateCurve::DayTable RateCurve::buildDayTable() const
+{
+	DayTable tbl;
+	tbl.asOfSerial = _asOf.getSerialDate();
+	long nDays = tenors.empty() ? 0 : tenors.back().getSerialDate() - tbl.asOfSerial + 1;
+	if (nDays > 0)
+	{
+		tbl.rates.resize(nDays);
+		tbl.dfs.resize(nDays);
+		// interpolateRate day by day, but walking the tenors once. every scenario market
+		// with a shocked curve builds one of these, so it has to be cheap
+		size_t seg = 0; // index of the first tenor >= day
+		for (long i = 0; i < nDays; i++)
+		{
+			long x = tbl.asOfSerial + i;
+			while (seg < tenors.size() && tenors[seg].getSerialDate() < x)
+				seg++;
+			double r;
+			if (seg == tenors.size())
+				r = rates.back();
+			else if (seg == 0 || tenors[seg].getSerialDate() == x)
+				r = rates[seg];
+			else
+				r = imp::linearInterpolate(tenors[seg - 1].getSerialDate(), rates[seg - 1], tenors[seg].getSerialDate(), rates[seg], x);
+			tbl.rates[i] = r;
+			tbl.dfs[i] = -r * (i / 365.0);
+		}
+		imp::expBatch(tbl.dfs.data(), tbl.dfs.data(), nDays);
+	}
+	return tbl;
+}
+const RateCurve::DayTable* RateCurve::dayTable() const
+{
+	const DayTable* tbl = table.get([this] { return buildDayTable(); });
+	// a table built for another value date is ignored, callers fall back to interpolation
+	return tbl->asOfSerial == _asOf.getSerialDate() ? tbl : nullptr;
+}
+double RateCurve::getRate(Date date) const
+{
+	const DayTable* tbl = dayTable();
+	if (tbl)
+	{
+		long idx = date.getSerialDate() - tbl->asOfSerial;
+		if (idx >= 0 && idx < (long)tbl->rates.size())
+			return tbl->rates[idx];
+	}
+	return interpolateRate(date);
+}
 double RateCurve::getDf(Date _date) const
 {
-	double ccr = getRate(_date);
+	const DayTable* tbl = dayTable();
+	if (tbl)
+	{
+		long idx = _date.getSerialDate() - tbl->asOfSerial;
+		if (idx >= 0 && idx < (long)tbl->dfs.size())
+			return tbl->dfs[idx];
+	}
+	double ccr = interpolateRate(_date);
 	double t = (_date - _asOf) / 365.0;
 	return exp(-ccr * t);
 }
+RateWeights RateCurve::getRateWeights(Date date) const
+{
+	// same segment search as interpolateRate, flat extrapolation puts all weight on the end pillar
+	RateWeights w;
+	auto it = std::lower_bound(tenors.begin(), tenors.end(), date);
+	if (it == tenors.end())
+		w.i0 = w.i1 = tenors.size() - 1;
+	else if (it == tenors.begin() || *it == date)
+		w.i0 = w.i1 = it - tenors.begin();
+	else
+	{
+		w.i1 = it - tenors.begin();
+		w.i0 = w.i1 - 1;
+		double x0 = tenors[w.i0].getSerialDate();
+		double x1 = tenors[w.i1].getSerialDate();
+		w.w1 = (date.getSerialDate() - x0) / (x1 - x0);
+		w.w0 = 1 - w.w1;
+	}
+	return w;
+}
+void RateCurve::getRates(const Date* dates, size_t n, double* out) const
+{
+	// only use the day table if someone already paid for it
+	const DayTable* tbl = table.peek();
+	if (tbl && tbl->asOfSerial == _asOf.getSerialDate())
+	{
+		bool all = true;
+		for (size_t i = 0; i < n; i++)
+		{
+			long idx = dates[i].getSerialDate() - tbl->asOfSerial;
+			if (idx < 0 || idx >= (long)tbl->rates.size())
+			{
+				all = false;
+				break;
+			}
+			out[i] = tbl->rates[idx];
+		}
+		if (all)
+			return;
+	}
+	interpolateRates(dates, n, out);
+}
+void RateCurve::getDfs(const Date* dates, size_t n, double* out) const
+{
+	const DayTable* tbl = table.peek();
+	if (tbl && tbl->asOfSerial == _asOf.getSerialDate())
+	{
+		bool all = true;
+		for (size_t i = 0; i < n; i++)
+		{
+			long idx = dates[i].getSerialDate() - tbl->asOfSerial;
+			if (idx < 0 || idx >= (long)tbl->dfs.size())
+			{
+				all = false;
+				break;
+			}
+			out[i] = tbl->dfs[idx];
+		}
+		if (all)
+			return;
+	}
+	// df = exp(-r * t), the exponents are formed in out and exponentiated in place
+	interpolateRates(dates, n, out);
+	for (size_t i = 0; i < n; i++)
+		out[i] = -out[i] * ((dates[i] - _asOf) / 365.0);
+	imp::expBatch(out, out, n);
+}
+void RateCurve::interpolateRates(const Date* dates, size_t n, double* out) const
+{
+	imp::linearInterpolate(tenors, rates, dates, n, out);
+}
 void RateCurve::shock(Date tenor, double value)
 {
-	// parallel shock all tenors rate
+	// a pillar tenor bumps only that pillar, which under linear interpolation is a
+	// triangular bump fading to zero at the neighbour pillars (key rate shock)
+	auto it = find(tenors.begin(), tenors.end(), tenor);
+	if (it != tenors.end())
+	{
+		rates[it - tenors.begin()] += value;
+		table.reset();
+		return;
+	}
+	// any other tenor, eg. Date(): parallel shock all tenors rate
 	for (auto &rt : rates)
 	{
 		rt += value;
 	}
+	table.reset();
 }
 
 void VolCurve::addVol(Date tenor, double vol)
@@ -108,6 +270,10 @@ double VolCurve::getVol(Date date) const
 		return vol;
 	}
 }
+void VolCurve::getVols(const Date* dates, size_t n, double* out) const
+{
+	imp::linearInterpolate(tenors, vols, dates, n, out);
+}
 void VolCurve::display() const
 {
 	cout << "vol curve:" << name << endl;
@@ -130,38 +296,74 @@ void Market::Print() const
 {
 	cout << "market asof: " << asOf << endl;
 
-	for (auto curve : curves)
+	for (auto curve : *curves)
 	{
 		curve.second->display();
 	}
-	for (auto vol : vols)
+	for (auto vol : *vols)
 	{
 		vol.second->display();
 	}
-	for (auto price : bondPrices)
+	for (auto price : *bondPrices)
 	{
 		cout << "Bond: " << price.first << ", Price: " << price.second << endl;
 	}
-	for (auto price : stockPrices)
+	for (auto price : *stockPrices)
 	{
-		cout << "Stock: " << price.first << ", Price: " << price.second << endl;
+		cout << "Stock: " << price.first << ", Price: " << getStockPrice(price.first) << endl;
 	}
 }
 void Market::addCurve(const std::string &name, shared_ptr<RateCurve> curve)
 {
-	curves.emplace(name, curve);
+	writable(curves).emplace(name, curve);
 }
 void Market::addVolCurve(const std::string &name, shared_ptr<VolCurve> vol)
 {
-	vols.emplace(name, vol);
+	writable(vols).emplace(name, vol);
 }
 void Market::addBondPrice(const std::string &bondName, double price)
 {
-	bondPrices.emplace(bondName, price);
+	writable(bondPrices).emplace(bondName, price);
 }
 void Market::addStockPrice(const std::string &stockName, double price)
 {
-	stockPrices.emplace(stockName, price);
+	writable(stockPrices).emplace(stockName, price);
+}
+void Market::setCurve(const string &name, shared_ptr<RateCurve> curve)
+{
+	writable(curves)[name] = curve;
+}
+void Market::setVolCurve(const string &name, shared_ptr<VolCurve> vol)
+{
+	writable(vols)[name] = vol;
+}
+void Market::setStockPrice(const string &stockName, double price)
+{
+	writable(stockPrices)[stockName] = price;
+	stockShocks.erase(stockName);
+}
+void Market::shockCurve(const string &name, Date tenor, double shock)
+{
+	auto shocked = make_shared<RateCurve>(*getCurve(name));
+	shocked->shock(tenor, shock);
+	writable(curves)[name] = shocked;
+}
+void Market::shockVolCurve(const string &name, Date tenor, double shock)
+{
+	auto shocked = make_shared<VolCurve>(*getVolCurve(name));
+	shocked->shock(tenor, shock);
+	writable(vols)[name] = shocked;
+}
+void Market::shockPrice(const string &underlying, double shock)
+{
+	// same as the old in-place += : an unknown ticker starts from 0
+	auto it = stockPrices->find(underlying);
+	double base = it != stockPrices->end() ? it->second : 0.0;
+	auto sh = stockShocks.find(underlying);
+	if (sh != stockShocks.end())
+		sh->second += shock;
+	else
+		stockShocks.emplace(underlying, base + shock);
 }
 std::ostream &operator<<(std::ostream &os, const Market &mkt)
 {
@@ -172,4 +374,4 @@ std::istream &operator>>(std::istream &is, Market &mkt)
 {
 	is >> mkt.asOf;
 	return is;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -5,26 +5,88 @@
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <atomic>
 #include "Date.h"
 
 using namespace std;
 
+namespace imp
+{
+	// lazily built immutable cache object, readers never lock.
+	// reset() is for the owner's mutators and must not race with readers,
+	// copies start empty and rebuild on first use
+	template <class T>
+	class LazyCache {
+	public:
+		LazyCache() {}
+		LazyCache(const LazyCache&) {}
+		LazyCache& operator=(const LazyCache&) { reset(); return *this; }
+		~LazyCache() { reset(); }
+
+		template <class Build>
+		const T* get(Build&& build) const {
+			const T* cur = ptr.load(std::memory_order_acquire);
+			if (cur)
+				return cur;
+			// concurrent first calls may both build, the loser throws its copy away
+			const T* fresh = new T(build());
+			if (ptr.compare_exchange_strong(cur, fresh, std::memory_order_acq_rel))
+				return fresh;
+			delete fresh;
+			return cur;
+		}
+		const T* peek() const { return ptr.load(std::memory_order_acquire); } // nullptr if not built
+		void reset() { delete ptr.exchange(nullptr); }
+
+	private:
+		mutable std::atomic<const T*> ptr{ nullptr };
+	};
+}
+
+// zero rate at a date as w0 * rates[i0] + w1 * rates[i1], the derivative of getRate wrt the pillars
+struct RateWeights {
+	size_t i0 = 0;
+	size_t i1 = 0;
+	double w0 = 1;
+	double w1 = 0;
+};
+
 class RateCurve {
 public:
 	RateCurve() {};
 	RateCurve(const string& _name) : name(_name) {};
 	void addRate(Date tenor, double rate);
-	void shock(Date tenor, double value); //implement this
+	void shock(Date tenor, double value); // key rate bump if tenor is a pillar, parallel otherwise
 	double getRate(Date date) const; //implement this function using linear interpolation
 	double getDf(Date date) const; // using df = exp(-rt), and r is getRate function
+	// batch versions of getRate/getDf, dates in ascending order are merged against the tenors in one pass
+	void getRates(const Date* dates, size_t n, double* out) const;
+	void getDfs(const Date* dates, size_t n, double* out) const;
+	void getRates(const vector<Date>& dates, vector<double>& out) const { out.resize(dates.size()); getRates(dates.data(), dates.size(), out.data()); }
+	void getDfs(const vector<Date>& dates, vector<double>& out) const { out.resize(dates.size()); getDfs(dates.data(), dates.size(), out.data()); }
+	RateWeights getRateWeights(Date date) const;
+	inline const vector<Date>& getTenors() const { return tenors; }
+	inline const vector<double>& getPillarRates() const { return rates; }
 	void display() const;
 
 	std::string name;
 	Date _asOf;//same as market data date
 
 private:
+	// zero rate and df for every day from _asOf to the last tenor, index = serial - asOf
+	struct DayTable {
+		long asOfSerial;
+		vector<double> rates;
+		vector<double> dfs;
+	};
+	double interpolateRate(Date date) const;
+	void interpolateRates(const Date* dates, size_t n, double* out) const;
+	DayTable buildDayTable() const;
+	const DayTable* dayTable() const;
+
 	vector<Date> tenors;
 	vector<double> rates; //zero coupon rate or continous compounding rate
+	imp::LazyCache<DayTable> table; // reset by addRate and shock
 };
 
 class VolCurve { // atm vol curve without smile
@@ -33,6 +95,8 @@ public:
 	VolCurve(const string& _name) : name(_name) {};
 	void addVol(Date tenor, double rate); //implement this
 	double getVol(Date date) const; //implement this function using linear interpolation
+	void getVols(const Date* dates, size_t n, double* out) const; // batch getVol
+	void getVols(const vector<Date>& dates, vector<double>& out) const { out.resize(dates.size()); getVols(dates.data(), dates.size(), out.data()); }
 	void display() const; //implement this
 	void shock(Date tenor, double value); //implement this
 
@@ -52,41 +116,60 @@ public:
 		cout << "default constructor is called" << endl;
 	};
 	Market(const Date& now) : asOf(now) {};
-	Market(const Market& other) {
-		this->asOf = other.asOf;
-		// Deep copy each Curve
-		for (const auto& curve : other.curves) {
-			curves.emplace(curve.first,std::make_shared<RateCurve>(*(curve.second))); // Deep copy each Curve
-		}
-		// Deep copy each Curve
-		for (const auto& vol : other.vols) {
-			vols.emplace(vol.first, std::make_shared<VolCurve>(*vol.second)); // Deep copy each Curve
-		}
-		bondPrices = other.bondPrices;
-		stockPrices = other.stockPrices;		
-	} 
+	// copies are cheap: curves and price tables are shared with the source market,
+	// a shock on the copy clones only the curve it bumps (copy-on-write)
+	Market(const Market& other) = default;
+	Market& operator=(const Market& other) = default;
+
 	void Print() const;
 	void addCurve(const std::string& name, shared_ptr<RateCurve> curve);//implement this
 	void addVolCurve(const std::string& name, shared_ptr<VolCurve> vol);//implement this
 	void addBondPrice(const std::string& bondName, double price);//implement this
 	void addStockPrice(const std::string& stockName, double price);//implement this
 
-	inline void shockPrice(const string& underlying, double shock) { stockPrices[underlying] += shock; }
-	inline shared_ptr<RateCurve> getCurve(const string& name) const { return curves.at(name); };
-	inline shared_ptr<VolCurve> getVolCurve(const string& name) const { return vols.at(name); };
+	// live updates (ticks), unlike add* these replace an existing entry. other markets that
+	// share the old data keep it
+	void setCurve(const string& name, shared_ptr<RateCurve> curve);
+	void setVolCurve(const string& name, shared_ptr<VolCurve> vol);
+	void setStockPrice(const string& stockName, double price);
+
+	// scenario shocks, only touch this market even if the data is shared
+	void shockCurve(const string& name, Date tenor, double shock);
+	void shockVolCurve(const string& name, Date tenor, double shock);
+	void shockPrice(const string& underlying, double shock);
+
+	inline shared_ptr<const RateCurve> getCurve(const string& name) const { return curves->at(name); };
+	inline shared_ptr<const VolCurve> getVolCurve(const string& name) const { return vols->at(name); };
 	inline double getStockPrice(const string& name) const {
-		auto it = stockPrices.find(name);
-		if (it != stockPrices.end()) {
+		if (!stockShocks.empty()) {
+			auto sh = stockShocks.find(name);
+			if (sh != stockShocks.end())
+				return sh->second;
+		}
+		auto it = stockPrices->find(name);
+		if (it != stockPrices->end()) {
 			return it->second;
 		}
 		throw std::runtime_error("Stock price not found for: " + name);
 	}
 
 private:
-	unordered_map<string, shared_ptr<VolCurve>> vols;
-	unordered_map<string, shared_ptr<RateCurve>> curves;
-	unordered_map<string, double> bondPrices;
-	unordered_map<string, double> stockPrices;
+	template <class T>
+	using Table = unordered_map<string, T>;
+
+	// the table this market may write to, cloned first if another market shares it
+	template <class T>
+	static Table<T>& writable(shared_ptr<const Table<T>>& table) {
+		if (table.use_count() > 1)
+			table = make_shared<const Table<T>>(*table);
+		return const_cast<Table<T>&>(*table);
+	}
+
+	shared_ptr<const Table<shared_ptr<const VolCurve>>> vols = make_shared<const Table<shared_ptr<const VolCurve>>>();
+	shared_ptr<const Table<shared_ptr<const RateCurve>>> curves = make_shared<const Table<shared_ptr<const RateCurve>>>();
+	shared_ptr<const Table<double>> bondPrices = make_shared<const Table<double>>();
+	shared_ptr<const Table<double>> stockPrices = make_shared<const Table<double>>();
+	Table<double> stockShocks; // shocked spots of this market only, override stockPrices
 
 };
 
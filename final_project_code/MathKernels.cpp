@@ -0,0 +1,109 @@
+#include "MathKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IMP_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+namespace imp
+{
+	namespace
+	{
+		void expBatchScalar(const double* x, double* out, size_t n)
+		{
+			for (size_t i = 0; i < n; i++)
+				out[i] = expKernel(x[i]);
+		}
+
+#ifdef IMP_X86_DISPATCH
+		// the avx targets have fma, and a contracted mul + add rounds once where expKernel rounds
+		// twice: no contraction keeps the lanes bit for bit equal to the scalar tail
+		__attribute__((target("avx2"), optimize("fp-contract=off")))
+		void expBatchAvx2(const double* x, double* out, size_t n)
+		{
+			const __m256d log2e = _mm256_set1_pd(1.4426950408889634);
+			const __m256d ln2hi = _mm256_set1_pd(6.93145751953125e-1);
+			const __m256d ln2lo = _mm256_set1_pd(1.42860682030941723212e-6);
+			const __m256d magic = _mm256_set1_pd(6755399441055744.0);
+			const __m256d lo = _mm256_set1_pd(-708.0);
+			const __m256d hi = _mm256_set1_pd(709.0);
+			const double coef[] = { 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+				1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0 };
+
+			size_t i = 0;
+			for (; i + 4 <= n; i += 4)
+			{
+				__m256d v = _mm256_loadu_pd(x + i);
+				v = _mm256_min_pd(_mm256_max_pd(v, lo), hi);
+				__m256d nm = _mm256_add_pd(_mm256_mul_pd(v, log2e), magic);
+				__m256d k = _mm256_sub_pd(nm, magic);
+				__m256d r = _mm256_sub_pd(_mm256_sub_pd(v, _mm256_mul_pd(k, ln2hi)), _mm256_mul_pd(k, ln2lo));
+				__m256d p = _mm256_set1_pd(1.0 / 479001600.0);
+				for (double c : coef)
+					p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(c));
+				__m256i scale = _mm256_slli_epi64(_mm256_castpd_si256(nm), 52);
+				p = _mm256_castsi256_pd(_mm256_add_epi64(_mm256_castpd_si256(p), scale));
+				_mm256_storeu_pd(out + i, p);
+			}
+			// gcc turns the tail into a jump without vzeroupper, and dirty upper halves slow every
+			// SSE instruction after it (libm included) until something clears them
+			_mm256_zeroupper();
+			expBatchScalar(x + i, out + i, n - i);
+		}
+
+		// gcc 12 warns on the _mm512_undefined_pd() inside the max / min intrinsics
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+		__attribute__((target("avx512f"), optimize("fp-contract=off")))
+		void expBatchAvx512(const double* x, double* out, size_t n)
+		{
+			const __m512d log2e = _mm512_set1_pd(1.4426950408889634);
+			const __m512d ln2hi = _mm512_set1_pd(6.93145751953125e-1);
+			const __m512d ln2lo = _mm512_set1_pd(1.42860682030941723212e-6);
+			const __m512d magic = _mm512_set1_pd(6755399441055744.0);
+			const __m512d lo = _mm512_set1_pd(-708.0);
+			const __m512d hi = _mm512_set1_pd(709.0);
+			const double coef[] = { 1.0 / 39916800.0, 1.0 / 3628800.0, 1.0 / 362880.0, 1.0 / 40320.0, 1.0 / 5040.0,
+				1.0 / 720.0, 1.0 / 120.0, 1.0 / 24.0, 1.0 / 6.0, 0.5, 1.0, 1.0 };
+
+			size_t i = 0;
+			for (; i + 8 <= n; i += 8)
+			{
+				__m512d v = _mm512_loadu_pd(x + i);
+				v = _mm512_min_pd(_mm512_max_pd(v, lo), hi);
+				__m512d nm = _mm512_add_pd(_mm512_mul_pd(v, log2e), magic);
+				__m512d k = _mm512_sub_pd(nm, magic);
+				__m512d r = _mm512_sub_pd(_mm512_sub_pd(v, _mm512_mul_pd(k, ln2hi)), _mm512_mul_pd(k, ln2lo));
+				__m512d p = _mm512_set1_pd(1.0 / 479001600.0);
+				for (double c : coef)
+					p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(c));
+				__m512i scale = _mm512_slli_epi64(_mm512_castpd_si512(nm), 52);
+				p = _mm512_castsi512_pd(_mm512_add_epi64(_mm512_castpd_si512(p), scale));
+				_mm512_storeu_pd(out + i, p);
+			}
+			_mm256_zeroupper(); // see expBatchAvx2
+			expBatchScalar(x + i, out + i, n - i);
+		}
+#pragma GCC diagnostic pop
+#endif
+
+		using ExpBatchFn = void (*)(const double*, double*, size_t);
+		ExpBatchFn selectExpBatch()
+		{
+#ifdef IMP_X86_DISPATCH
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+				return expBatchAvx512;
+			if (__builtin_cpu_supports("avx2"))
+				return expBatchAvx2;
+#endif
+			return expBatchScalar;
+		}
+	}
+
+	void expBatch(const double* x, double* out, size_t n)
+	{
+		static const ExpBatchFn fn = selectExpBatch();
+		fn(x, out, n);
+	}
+}
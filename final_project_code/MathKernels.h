@@ -0,0 +1,236 @@
+#ifndef MATH_KERNELS_H
+#define MATH_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace imp
+{
+	// exp by cody-waite reduction and a degree 12 taylor polynomial, ~1e-16 relative.
+	// the SIMD kernels below run exactly this sequence of operations, so the
+	// scalar and vector results are bit for bit the same
+	inline double expKernel(double x)
+	{
+		const double log2e = 1.4426950408889634;
+		const double ln2hi = 6.93145751953125e-1;
+		const double ln2lo = 1.42860682030941723212e-6;
+		const double magic = 6755399441055744.0; // 1.5 * 2^52, rounds to nearest integer
+
+		x = x < -708.0 ? -708.0 : (x > 709.0 ? 709.0 : x);
+		double nm = x * log2e + magic;
+		double n = nm - magic;
+		double r = (x - n * ln2hi) - n * ln2lo;
+
+		double p = 1.0 / 479001600.0;
+		p = p * r + 1.0 / 39916800.0;
+		p = p * r + 1.0 / 3628800.0;
+		p = p * r + 1.0 / 362880.0;
+		p = p * r + 1.0 / 40320.0;
+		p = p * r + 1.0 / 5040.0;
+		p = p * r + 1.0 / 720.0;
+		p = p * r + 1.0 / 120.0;
+		p = p * r + 1.0 / 24.0;
+		p = p * r + 1.0 / 6.0;
+		p = p * r + 0.5;
+		p = p * r + 1.0;
+		p = p * r + 1.0;
+
+		// scale by 2^n, the low bits of nm hold n
+		int64_t nBits, pBits;
+		std::memcpy(&nBits, &nm, sizeof(nBits));
+		std::memcpy(&pBits, &p, sizeof(pBits));
+		pBits += (int64_t)((uint64_t)nBits << 52);
+		std::memcpy(&p, &pBits, sizeof(p));
+		return p;
+	}
+
+	// out[i] = exp(x[i]), dispatches to AVX-512 / AVX2 when the cpu has it
+	void expBatch(const double* x, double* out, size_t n);
+
+	// width of the batch kernels, arrays they work on in place are padded to a multiple
+	constexpr size_t lanes = 8;
+
+#ifdef __GNUC__
+	// 8 doubles as one gcc vector. kernels written with it are compiled once per target
+	// (see Lattice.cpp, BlackScholes.cpp) and lower to SSE2, AVX2 or AVX-512. everything
+	// here is always inlined, so the vector argument ABI gcc warns about never applies
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpsabi"
+	typedef double Lanes __attribute__((vector_size(lanes * sizeof(double))));
+	typedef int64_t LanesI __attribute__((vector_size(lanes * sizeof(double))));
+
+	__attribute__((always_inline)) inline Lanes splat(double x) { return Lanes{} + x; }
+	__attribute__((always_inline)) inline Lanes loadLanes(const double* p)
+	{
+		Lanes x;
+		std::memcpy(&x, p, sizeof(x));
+		return x;
+	}
+	__attribute__((always_inline)) inline void storeLanes(double* p, Lanes x) { std::memcpy(p, &x, sizeof(x)); }
+
+	// expKernel per lane
+	__attribute__((always_inline)) inline Lanes expLanes(Lanes x)
+	{
+		const Lanes lo = splat(-708.0), hi = splat(709.0), magic = splat(6755399441055744.0);
+		x = x < lo ? lo : x;
+		x = x > hi ? hi : x;
+		Lanes nm = x * 1.4426950408889634 + magic;
+		Lanes n = nm - magic;
+		Lanes r = (x - n * 6.93145751953125e-1) - n * 1.42860682030941723212e-6;
+		Lanes p = splat(1.0 / 479001600.0);
+		p = p * r + 1.0 / 39916800.0;
+		p = p * r + 1.0 / 3628800.0;
+		p = p * r + 1.0 / 362880.0;
+		p = p * r + 1.0 / 40320.0;
+		p = p * r + 1.0 / 5040.0;
+		p = p * r + 1.0 / 720.0;
+		p = p * r + 1.0 / 120.0;
+		p = p * r + 1.0 / 24.0;
+		p = p * r + 1.0 / 6.0;
+		p = p * r + 0.5;
+		p = p * r + 1.0;
+		p = p * r + 1.0;
+		return (Lanes)((LanesI)p + ((LanesI)nm << 52));
+	}
+
+	// log of positive normal numbers: x = m * 2^e with m in [sqrt(1/2), sqrt(2)), then the
+	// atanh series log(m) = 2 f (1 + f^2 / 3 + f^4 / 5 + ...), f = (m - 1) / (m + 1), ~1e-16
+	__attribute__((always_inline)) inline Lanes logLanes(Lanes x)
+	{
+		LanesI bits = (LanesI)x;
+		LanesI e = ((bits >> 52) & 0x7ff) - 1023;
+		Lanes m = (Lanes)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+		LanesI big = m > 1.4142135623730951; // -1 where true
+		m = big ? m * 0.5 : m;
+		e -= big;
+		Lanes f = (m - 1.0) / (m + 1.0);
+		Lanes s = f * f;
+		Lanes p = splat(1.0 / 23);
+		p = p * s + 1.0 / 21;
+		p = p * s + 1.0 / 19;
+		p = p * s + 1.0 / 17;
+		p = p * s + 1.0 / 15;
+		p = p * s + 1.0 / 13;
+		p = p * s + 1.0 / 11;
+		p = p * s + 1.0 / 9;
+		p = p * s + 1.0 / 7;
+		p = p * s + 1.0 / 5;
+		p = p * s + 1.0 / 3;
+		p = p * s + 1.0;
+		Lanes k = __builtin_convertvector(e, Lanes);
+		return k * 6.93145751953125e-1 + (2.0 * f * p + k * 1.42860682030941723212e-6);
+	}
+
+	// standard normal cdf, Hart's double precision algorithm as given by West (2005), ~1e-14.
+	// e must be exp(-x^2 / 2), callers that also need the density already have it. the
+	// continued fraction for |x| > 7.07 is only evaluated when some lane needs it
+	__attribute__((always_inline)) inline Lanes normCdfLanes(Lanes x, Lanes e)
+	{
+		Lanes a = (Lanes)((LanesI)x & 0x7fffffffffffffffLL);
+
+		Lanes num = a * 3.52624965998911e-02 + 0.700383064443688;
+		num = num * a + 6.37396220353165;
+		num = num * a + 33.912866078383;
+		num = num * a + 112.079291497871;
+		num = num * a + 221.213596169931;
+		num = num * a + 220.206867912376;
+		Lanes den = a * 8.83883476483184e-02 + 1.75566716318264;
+		den = den * a + 16.064177579207;
+		den = den * a + 86.7807322029461;
+		den = den * a + 296.564248779674;
+		den = den * a + 637.333633378831;
+		den = den * a + 793.826512519948;
+		den = den * a + 440.413735824752;
+		Lanes c = e * num / den;
+
+		LanesI far = a >= 7.07106781186547;
+		int64_t anyFar = 0;
+		for (size_t l = 0; l < lanes; l++)
+			anyFar |= far[l];
+		if (anyFar)
+		{
+			Lanes cf = a + 0.65;
+			cf = a + 4.0 / cf;
+			cf = a + 3.0 / cf;
+			cf = a + 2.0 / cf;
+			cf = a + 1.0 / cf;
+			c = far ? e / (cf * 2.506628274631) : c;
+			c = a > 37.0 ? Lanes{} : c;
+		}
+		return x > 0.0 ? 1.0 - c : c;
+	}
+
+	// the same from Cody's rational erfc (Math. Comp. 1969, as in netlib's CALERF), ~1e-15
+	// relative also deep in the tails, where the one above drifts to ~1e-8. the branches are
+	// blended as numerator and denominator, one division in all
+	__attribute__((always_inline)) inline Lanes normCdfPreciseLanes(Lanes x, Lanes e)
+	{
+		Lanes y = (Lanes)((LanesI)x & 0x7fffffffffffffffLL) * 0.70710678118654752; // N(-|x|) = erfc(y) / 2
+		LanesI central = y <= 0.46875, far = y > 4.0;
+		int64_t anyCentral = 0, anyFar = 0;
+		for (size_t l = 0; l < lanes; l++)
+		{
+			anyCentral |= central[l];
+			anyFar |= far[l];
+		}
+
+		// 0.5 < y <= 4: erfc = e P(y) / Q(y)
+		Lanes num = y * 2.15311535474403846e-8 + 5.64188496988670089e-1;
+		num = num * y + 8.88314979438837594e00;
+		num = num * y + 6.61191906371416295e01;
+		num = num * y + 2.98635138197400131e02;
+		num = num * y + 8.81952221241769090e02;
+		num = num * y + 1.71204761263407058e03;
+		num = num * y + 2.05107837782607147e03;
+		num = num * y + 1.23033935479799725e03;
+		Lanes den = y + 1.57449261107098347e01;
+		den = den * y + 1.17693950891312499e02;
+		den = den * y + 5.37181101862009858e02;
+		den = den * y + 1.62138957456669019e03;
+		den = den * y + 3.29079923573345963e03;
+		den = den * y + 4.36261909014324716e03;
+		den = den * y + 3.43936767414372164e03;
+		den = den * y + 1.23033935480374942e03;
+		num = e * num;
+		den = 2.0 * den;
+		if (anyFar)
+		{
+			// erfc = e (1 / sqrt(pi) - P(z) / (z Q(z))) / y, z = y^2, P and Q scaled by z^5
+			Lanes z = y * y;
+			Lanes fnum = z * 6.58749161529837803e-4 + 1.60837851487422766e-2;
+			fnum = fnum * z + 1.25781726111229246e-1;
+			fnum = fnum * z + 3.60344899949804439e-1;
+			fnum = fnum * z + 3.05326634961232344e-1;
+			fnum = fnum * z + 1.63153871373020978e-2;
+			Lanes fden = z * 2.33520497626869185e-3 + 6.05183413124413191e-2;
+			fden = fden * z + 5.27905102951428412e-1;
+			fden = fden * z + 1.87295284992346725e00;
+			fden = fden * z + 2.56852019228982242e00;
+			fden = fden * z + 1.0;
+			num = far ? e * (z * fden * 5.6418958354775628695e-1 - fnum) : num;
+			den = far ? 2.0 * y * z * fden : den;
+		}
+		if (anyCentral)
+		{
+			// y <= 0.46875: erfc = 1 - y P(y^2) / Q(y^2)
+			Lanes z = y * y;
+			Lanes cnum = z * 1.85777706184603153e-1 + 3.16112374387056560e00;
+			cnum = cnum * z + 1.13864154151050156e02;
+			cnum = cnum * z + 3.77485237685302021e02;
+			cnum = cnum * z + 3.20937758913846947e03;
+			Lanes cden = z + 2.36012909523441209e01;
+			cden = cden * z + 2.44024637934444173e02;
+			cden = cden * z + 1.28261652607737228e03;
+			cden = cden * z + 2.84423683343917062e03;
+			num = central ? cden - y * cnum : num;
+			den = central ? 2.0 * cden : den;
+		}
+		Lanes c = num / den;
+		return x > 0.0 ? 1.0 - c : c;
+	}
+#pragma GCC diagnostic pop
+#endif
+}
+
+#endif
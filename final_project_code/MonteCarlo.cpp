@@ -0,0 +1,421 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "MonteCarlo.h"
+#include "MathKernels.h"
+#include "Payoff.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define MC_X86_DISPATCH 1
+#endif
+
+#ifdef __GNUC__
+#pragma GCC diagnostic ignored "-Wpsabi" // see MathKernels.h
+#endif
+
+namespace mc
+{
+	namespace
+	{
+		const size_t L = imp::lanes;
+
+		// AS241 coefficients: central region |p - 0.5| <= 0.425, then r = sqrt(-log(min(p, 1 - p)))
+		// up to 5 and beyond
+		const double A[8] = {3.3871328727963666080e0, 1.3314166789178437745e+2, 1.9715909503065514427e+3, 1.3731693765509461125e+4,
+							 4.5921953931549871457e+4, 6.7265770927008700853e+4, 3.3430575583588128105e+4, 2.5090809287301226727e+3};
+		const double B[8] = {1.0, 4.2313330701600911252e+1, 6.8718700749205790830e+2, 5.3941960214247511077e+3,
+							 2.1213794301586595867e+4, 3.9307895800092710610e+4, 2.8729085735721942674e+4, 5.2264952788528545610e+3};
+		const double C[8] = {1.42343711074968357734e0, 4.63033784615654529590e0, 5.76949722146069140550e0, 3.64784832476320460504e0,
+							 1.27045825245236838258e0, 2.41780725177450611770e-1, 2.27238449892691845833e-2, 7.74545014278341407640e-4};
+		const double D[8] = {1.0, 2.05319162663775882187e0, 1.67638483018380384940e0, 6.89767334985100004550e-1,
+							 1.48103976427480074590e-1, 1.51986665636164571966e-2, 5.47593808499534494600e-4, 1.05075007164441684324e-9};
+		const double E[8] = {6.65790464350110377720e0, 5.46378491116411436990e0, 1.78482653991729133580e0, 2.96560571828504891230e-1,
+							 2.65321895265761230930e-2, 1.24266094738807843860e-3, 2.71155556874348757815e-5, 2.01033439929228813265e-7};
+		const double F[8] = {1.0, 5.99832206555887937690e-1, 1.36929880922735805310e-1, 1.48753612908506148525e-2,
+							 7.86869131145613259100e-4, 1.84631831751005468180e-5, 1.42151175831644588870e-7, 2.04426310338993978564e-15};
+
+		template <class T>
+		inline T poly7(const double *c, T x)
+		{
+			T p = c[7] * x + c[6];
+			for (int k = 5; k >= 0; k--)
+				p = p * x + c[k];
+			return p;
+		}
+
+		// uniform in (0, 1) from the top 52 of two philox words, exact: the mantissa is filled
+		// with the bits and 2^52 subtracted
+		inline double uniform(uint32_t hi, uint32_t lo)
+		{
+			uint64_t bits = 0x4330000000000000ULL | ((uint64_t)hi << 20) | (lo >> 12);
+			double d;
+			std::memcpy(&d, &bits, sizeof(d));
+			return ((d - 4503599627370496.0) + 0.5) * (1.0 / 4503599627370496.0);
+		}
+
+		// philox call k of stream (seed, block, dim) gives the uniforms 16 * (k / 8) + k % 8 and
+		// 16 * (k / 8) + 8 + k % 8, so 8 lanes of calls fill 16 consecutive uniforms
+		inline void philoxPair(uint64_t seed, uint64_t block, uint32_t dim, uint32_t k, double &u0, double &u1)
+		{
+			uint32_t ctr[4] = {k, dim, (uint32_t)block, (uint32_t)(block >> 32)};
+			uint32_t key[2] = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+			philox(ctr, key);
+			u0 = uniform(ctr[0], ctr[1]);
+			u1 = uniform(ctr[2], ctr[3]);
+		}
+
+#ifdef __GNUC__
+		using imp::Lanes;
+		using imp::LanesI;
+		using imp::loadLanes;
+		using imp::splat;
+		using imp::storeLanes;
+		typedef uint64_t LanesU __attribute__((vector_size(L * sizeof(double))));
+
+		__attribute__((always_inline)) inline void philoxUniformsKernel(uint64_t seed, uint64_t block, uint32_t dim, size_t groups, double *u)
+		{
+			const LanesU lane = {0, 1, 2, 3, 4, 5, 6, 7};
+			const LanesU low = LanesU{} + 0xffffffffULL;
+			for (size_t g = 0; g < groups; g++)
+			{
+				LanesU c0 = lane + g * L, c1 = LanesU{} + dim, c2 = LanesU{} + (uint32_t)block, c3 = LanesU{} + (uint32_t)(block >> 32);
+				uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+				for (int round = 0; round < 10; round++)
+				{
+					LanesU p0 = c0 * 0xD2511F53ULL;
+					LanesU p1 = c2 * 0xCD9E8D57ULL;
+					c0 = (p1 >> 32) ^ c1 ^ k0;
+					c1 = p1 & low;
+					c2 = (p0 >> 32) ^ c3 ^ k1;
+					c3 = p0 & low;
+					k0 += 0x9E3779B9u;
+					k1 += 0xBB67AE85u;
+				}
+				const LanesU exponent = LanesU{} + 0x4330000000000000ULL;
+				Lanes d0 = (Lanes)(exponent | (c0 << 20) | (c1 >> 12));
+				Lanes d1 = (Lanes)(exponent | (c2 << 20) | (c3 >> 12));
+				storeLanes(u + 2 * L * g, ((d0 - 4503599627370496.0) + 0.5) * (1.0 / 4503599627370496.0));
+				storeLanes(u + 2 * L * g + L, ((d1 - 4503599627370496.0) + 0.5) * (1.0 / 4503599627370496.0));
+			}
+		}
+
+		__attribute__((always_inline)) inline Lanes inverseNormalLanes(Lanes p)
+		{
+			Lanes q = p - 0.5;
+			Lanes r = 0.180625 - q * q;
+			Lanes x = q * poly7(A, r) / poly7(B, r);
+
+			LanesI tail = (q > 0.425) | (q < -0.425);
+			int64_t anyTail = 0;
+			for (size_t l = 0; l < L; l++)
+				anyTail |= tail[l];
+			if (!anyTail)
+				return x;
+
+			Lanes t = -imp::logLanes(q < 0.0 ? p : 1.0 - p);
+			for (size_t l = 0; l < L; l++)
+				t[l] = __builtin_sqrt(t[l] > 0.0 ? t[l] : 0.0);
+			Lanes t1 = t - 1.6;
+			Lanes y = poly7(C, t1) / poly7(D, t1);
+			LanesI far = t > 5.0;
+			int64_t anyFar = 0;
+			for (size_t l = 0; l < L; l++)
+				anyFar |= far[l];
+			if (anyFar)
+			{
+				Lanes t2 = t - 5.0;
+				y = far ? poly7(E, t2) / poly7(F, t2) : y;
+			}
+			y = q < 0.0 ? -y : y;
+			return tail ? y : x;
+		}
+
+		__attribute__((always_inline)) inline void inverseNormalsKernel(double *z, size_t groups)
+		{
+			for (size_t g = 0; g < groups; g++)
+				storeLanes(z + L * g, inverseNormalLanes(loadLanes(z + L * g)));
+		}
+
+		__attribute__((always_inline)) inline Lanes payoffLanes(Lanes S, Lanes strike, Lanes phi, bool binary)
+		{
+			const Lanes zero = {}, one = splat(1.0);
+			Lanes x = phi * (S - strike);
+			return binary ? (x >= 0.0 ? one : zero) : (x > 0.0 ? x : zero);
+		}
+
+		__attribute__((always_inline)) inline void vanillaMomentsKernel(const double *z, size_t n, double S0, double drift, double volT, OptionType optType,
+																		double strike, bool antithetic, Moments &m)
+		{
+			const Lanes zero = {}, K = splat(strike);
+			const Lanes phi = splat((optType == Call || optType == BinaryCall) ? 1.0 : -1.0);
+			const bool binary = optType == BinaryCall || optType == BinaryPut;
+			const LanesI lane = {0, 1, 2, 3, 4, 5, 6, 7};
+			Lanes sy = {}, syy = {}, sc = {}, scc = {}, syc = {};
+			for (size_t i = 0; i < n; i += L)
+			{
+				Lanes zi = {};
+				std::memcpy(&zi, z + i, std::min(L, n - i) * sizeof(double));
+				LanesI valid = (lane + (int64_t)i) < (int64_t)n;
+				Lanes S = S0 * imp::expLanes(drift + volT * zi);
+				Lanes y = payoffLanes(S, K, phi, binary);
+				Lanes c = S;
+				if (antithetic)
+				{
+					Lanes Sa = S0 * imp::expLanes(drift - volT * zi);
+					y = 0.5 * (y + payoffLanes(Sa, K, phi, binary));
+					c = 0.5 * (c + Sa);
+				}
+				y = valid ? y : zero;
+				c = valid ? c : zero;
+				sy += y;
+				syy += y * y;
+				sc += c;
+				scc += c * c;
+				syc += y * c;
+			}
+			m.n += n;
+			for (size_t l = 0; l < L; l++)
+			{
+				m.y += sy[l];
+				m.yy += syy[l];
+				m.c += sc[l];
+				m.cc += scc[l];
+				m.yc += syc[l];
+			}
+		}
+
+		__attribute__((always_inline)) inline void stepPathsKernel(const double *prev, const double *z, size_t n, double drift, double vol, double *S)
+		{
+			size_t i = 0;
+			for (; i + L <= n; i += L)
+				storeLanes(S + i, loadLanes(prev + i) * imp::expLanes(drift + vol * loadLanes(z + i)));
+			for (; i < n; i++)
+				S[i] = prev[i] * imp::expKernel(drift + vol * z[i]); // bit for bit the lanes result
+		}
+#else
+		inline void philoxUniformsKernel(uint64_t seed, uint64_t block, uint32_t dim, size_t groups, double *u)
+		{
+			for (size_t g = 0; g < groups; g++)
+				for (size_t l = 0; l < L; l++)
+					philoxPair(seed, block, dim, (uint32_t)(g * L + l), u[2 * L * g + l], u[2 * L * g + L + l]);
+		}
+
+		inline void inverseNormalsKernel(double *z, size_t groups)
+		{
+			for (size_t i = 0; i < groups * L; i++)
+				z[i] = inverseNormal(z[i]);
+		}
+
+		inline void vanillaMomentsKernel(const double *z, size_t n, double S0, double drift, double volT, OptionType optType,
+										 double strike, bool antithetic, Moments &m)
+		{
+			for (size_t i = 0; i < n; i++)
+			{
+				double S = S0 * std::exp(drift + volT * z[i]);
+				double y = PAYOFF::VanillaOption(optType, strike, S);
+				double c = S;
+				if (antithetic)
+				{
+					double Sa = S0 * std::exp(drift - volT * z[i]);
+					y = 0.5 * (y + PAYOFF::VanillaOption(optType, strike, Sa));
+					c = 0.5 * (c + Sa);
+				}
+				m.n += 1;
+				m.y += y;
+				m.yy += y * y;
+				m.c += c;
+				m.cc += c * c;
+				m.yc += y * c;
+			}
+		}
+
+		inline void stepPathsKernel(const double *prev, const double *z, size_t n, double drift, double vol, double *S)
+		{
+			for (size_t i = 0; i < n; i++)
+				S[i] = prev[i] * std::exp(drift + vol * z[i]);
+		}
+#endif
+
+		// the target specific copies of every kernel
+		struct Kernels
+		{
+			void (*philoxUniforms)(uint64_t, uint64_t, uint32_t, size_t, double *);
+			void (*inverseNormals)(double *, size_t);
+			void (*vanillaMoments)(const double *, size_t, double, double, double, OptionType, double, bool, Moments &);
+			void (*stepPaths)(const double *, const double *, size_t, double, double, double *);
+		};
+
+		void philoxUniformsScalar(uint64_t seed, uint64_t block, uint32_t dim, size_t groups, double *u) { philoxUniformsKernel(seed, block, dim, groups, u); }
+		void inverseNormalsScalar(double *z, size_t groups) { inverseNormalsKernel(z, groups); }
+		void vanillaMomentsScalar(const double *z, size_t n, double S0, double drift, double volT, OptionType optType,
+								  double strike, bool antithetic, Moments &m)
+		{
+			vanillaMomentsKernel(z, n, S0, drift, volT, optType, strike, antithetic, m);
+		}
+		void stepPathsScalar(const double *prev, const double *z, size_t n, double drift, double vol, double *S) { stepPathsKernel(prev, z, n, drift, vol, S); }
+
+#ifdef MC_X86_DISPATCH
+		__attribute__((target("avx2"))) void philoxUniformsAvx2(uint64_t seed, uint64_t block, uint32_t dim, size_t groups, double *u) { philoxUniformsKernel(seed, block, dim, groups, u); }
+		__attribute__((target("avx2"))) void inverseNormalsAvx2(double *z, size_t groups) { inverseNormalsKernel(z, groups); }
+		__attribute__((target("avx2"))) void vanillaMomentsAvx2(const double *z, size_t n, double S0, double drift, double volT, OptionType optType,
+																double strike, bool antithetic, Moments &m)
+		{
+			vanillaMomentsKernel(z, n, S0, drift, volT, optType, strike, antithetic, m);
+		}
+		__attribute__((target("avx2"))) void stepPathsAvx2(const double *prev, const double *z, size_t n, double drift, double vol, double *S) { stepPathsKernel(prev, z, n, drift, vol, S); }
+
+		__attribute__((target("avx512f"))) void philoxUniformsAvx512(uint64_t seed, uint64_t block, uint32_t dim, size_t groups, double *u) { philoxUniformsKernel(seed, block, dim, groups, u); }
+		__attribute__((target("avx512f"))) void inverseNormalsAvx512(double *z, size_t groups) { inverseNormalsKernel(z, groups); }
+		__attribute__((target("avx512f"))) void vanillaMomentsAvx512(const double *z, size_t n, double S0, double drift, double volT, OptionType optType,
+																	 double strike, bool antithetic, Moments &m)
+		{
+			vanillaMomentsKernel(z, n, S0, drift, volT, optType, strike, antithetic, m);
+		}
+		__attribute__((target("avx512f"))) void stepPathsAvx512(const double *prev, const double *z, size_t n, double drift, double vol, double *S) { stepPathsKernel(prev, z, n, drift, vol, S); }
+#endif
+
+		Kernels selectKernels()
+		{
+#ifdef MC_X86_DISPATCH
+			__builtin_cpu_init();
+			if (__builtin_cpu_supports("avx512f"))
+				return {philoxUniformsAvx512, inverseNormalsAvx512, vanillaMomentsAvx512, stepPathsAvx512};
+			if (__builtin_cpu_supports("avx2"))
+				return {philoxUniformsAvx2, inverseNormalsAvx2, vanillaMomentsAvx2, stepPathsAvx2};
+#endif
+			return {philoxUniformsScalar, inverseNormalsScalar, vanillaMomentsScalar, stepPathsScalar};
+		}
+
+		const Kernels &kernels()
+		{
+			static const Kernels k = selectKernels();
+			return k;
+		}
+
+		// direction numbers of dimensions 2.. from Joe and Kuo (new-joe-kuo-6.21201):
+		// degree s, coefficients a of the primitive polynomial, initial m
+		struct SobolPoly
+		{
+			int s;
+			uint32_t a;
+			uint32_t m[6];
+		};
+		const SobolPoly sobolPolys[sobolMaxDims - 1] = {
+			{1, 0, {1}},
+			{2, 1, {1, 3}},
+			{3, 1, {1, 3, 1}},
+			{3, 2, {1, 1, 1}},
+			{4, 1, {1, 1, 3, 3}},
+			{4, 4, {1, 3, 5, 13}},
+			{5, 2, {1, 1, 5, 5, 17}},
+			{5, 4, {1, 1, 5, 5, 5}},
+			{5, 7, {1, 1, 7, 11, 19}},
+			{5, 11, {1, 1, 5, 1, 1}},
+			{5, 13, {1, 1, 1, 3, 11}},
+			{5, 14, {1, 3, 5, 5, 31}},
+			{6, 1, {1, 3, 3, 9, 7, 49}},
+			{6, 13, {1, 1, 1, 15, 21, 21}},
+			{6, 16, {1, 3, 1, 13, 27, 49}},
+		};
+
+		struct SobolDirections
+		{
+			uint32_t v[sobolMaxDims][32];
+			SobolDirections()
+			{
+				for (int k = 0; k < 32; k++)
+					v[0][k] = 1u << (31 - k);
+				for (uint32_t d = 1; d < sobolMaxDims; d++)
+				{
+					const SobolPoly &poly = sobolPolys[d - 1];
+					const int s = poly.s;
+					for (int k = 0; k < 32; k++)
+					{
+						if (k < s)
+						{
+							v[d][k] = poly.m[k] << (31 - k);
+							continue;
+						}
+						uint32_t x = v[d][k - s] ^ (v[d][k - s] >> s);
+						for (int j = 1; j < s; j++)
+							if ((poly.a >> (s - 1 - j)) & 1)
+								x ^= v[d][k - j];
+						v[d][k] = x;
+					}
+				}
+			}
+		};
+	}
+
+	double inverseNormal(double p)
+	{
+		double q = p - 0.5;
+		if (std::abs(q) <= 0.425)
+		{
+			double r = 0.180625 - q * q;
+			return q * poly7(A, r) / poly7(B, r);
+		}
+		double r = std::sqrt(-std::log(q < 0 ? p : 1 - p));
+		double x = r <= 5.0 ? poly7(C, r - 1.6) / poly7(D, r - 1.6) : poly7(E, r - 5.0) / poly7(F, r - 5.0);
+		return q < 0 ? -x : x;
+	}
+
+	void philoxNormals(uint64_t seed, uint64_t block, uint32_t dim, size_t n, double *z)
+	{
+		// whole groups of 16 in place, the tail through a scratch group
+		const Kernels &k = kernels();
+		size_t full = n / (2 * L);
+		k.philoxUniforms(seed, block, dim, full, z);
+		k.inverseNormals(z, 2 * full);
+		if (n % (2 * L))
+		{
+			double tail[2 * L];
+			for (size_t l = 0; l < L; l++)
+				philoxPair(seed, block, dim, (uint32_t)(full * L + l), tail[l], tail[L + l]);
+			k.inverseNormals(tail, 2);
+			std::copy(tail, tail + n % (2 * L), z + 2 * L * full);
+		}
+	}
+
+	uint32_t sobolShift(uint64_t seed, uint64_t replicate, uint32_t dim)
+	{
+		// a counter no philoxNormals block reaches, k < 2^31 there
+		uint32_t ctr[4] = {0xffffffffu, dim, (uint32_t)replicate, (uint32_t)(replicate >> 32)};
+		uint32_t key[2] = {(uint32_t)seed, (uint32_t)(seed >> 32)};
+		philox(ctr, key);
+		return ctr[0];
+	}
+
+	void sobolNormals(uint64_t first, uint32_t dim, uint32_t shift, size_t n, double *z)
+	{
+		static const SobolDirections directions;
+		const uint32_t *v = directions.v[dim];
+		uint64_t gray = first ^ (first >> 1);
+		uint32_t x = 0;
+		for (int k = 0; k < 32; k++)
+			if ((gray >> k) & 1)
+				x ^= v[k];
+		for (size_t i = 0; i < n; i++)
+		{
+			z[i] = ((x ^ shift) + 0.5) * (1.0 / 4294967296.0);
+			x ^= v[__builtin_ctzll(first + i + 1)]; // gray code step to the next point
+		}
+		size_t groups = n / L;
+		kernels().inverseNormals(z, groups);
+		for (size_t i = groups * L; i < n; i++)
+			z[i] = inverseNormal(z[i]);
+	}
+
+	void vanillaMoments(const double *z, size_t n, double S0, double drift, double volT, OptionType optType,
+						double strike, bool antithetic, Moments &m)
+	{
+		if (optType != Call && optType != Put && optType != BinaryCall && optType != BinaryPut)
+			throw "unsupported optionType";
+		kernels().vanillaMoments(z, n, S0, drift, volT, optType, strike, antithetic, m);
+	}
+
+	void stepPaths(const double *prev, const double *z, size_t n, double drift, double vol, double *S)
+	{
+		kernels().stepPaths(prev, z, n, drift, vol, S);
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef _MONTE_CARLO_H
+#define _MONTE_CARLO_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Types.h"
+
+// random numbers and path kernels for MonteCarloPricer. every normal is a pure function of
+// its position in the stream (seed, block, dimension, index), so a run gives the same bits
+// on any number of threads
+namespace mc
+{
+	// philox4x32-10 (Salmon et al. 2011): encrypts the counter with the key in place
+	inline void philox(uint32_t ctr[4], const uint32_t key[2])
+	{
+		uint32_t k0 = key[0], k1 = key[1];
+		for (int round = 0; round < 10; round++)
+		{
+			uint64_t p0 = (uint64_t)0xD2511F53u * ctr[0];
+			uint64_t p1 = (uint64_t)0xCD9E8D57u * ctr[2];
+			uint32_t next[4] = {(uint32_t)(p1 >> 32) ^ ctr[1] ^ k0, (uint32_t)p1, (uint32_t)(p0 >> 32) ^ ctr[3] ^ k1, (uint32_t)p0};
+			ctr[0] = next[0];
+			ctr[1] = next[1];
+			ctr[2] = next[2];
+			ctr[3] = next[3];
+			k0 += 0x9E3779B9u;
+			k1 += 0xBB67AE85u;
+		}
+	}
+
+	// Wichura's AS241 (PPND16) inverse of the standard normal cdf, p in (0, 1), ~1e-16
+	double inverseNormal(double p);
+
+	// z[i] = normal i of the philox stream (seed, block, dim), i in [0, n)
+	void philoxNormals(uint64_t seed, uint64_t block, uint32_t dim, size_t n, double *z);
+
+	// z[i] = inverse normal of coordinate dim of sobol point first + i, points in gray code
+	// order with Joe-Kuo direction numbers, xor-ed with shift (a random digital shift) and taken
+	// at the middle of their 2^-32 cell
+	constexpr uint32_t sobolMaxDims = 16;
+	void sobolNormals(uint64_t first, uint32_t dim, uint32_t shift, size_t n, double *z);
+
+	// the digital shift of dimension dim in replicate r of a randomized sobol run
+	uint32_t sobolShift(uint64_t seed, uint64_t replicate, uint32_t dim);
+
+	// sums over samples y (the payoff) and c (the control), what mean, standard error and the
+	// control variate coefficient are made of. blocks are added up in a fixed order
+	struct Moments
+	{
+		double n = 0;
+		double y = 0;
+		double yy = 0;
+		double c = 0;
+		double cc = 0;
+		double yc = 0;
+
+		void add(const Moments &other)
+		{
+			n += other.n;
+			y += other.y;
+			yy += other.yy;
+			c += other.c;
+			cc += other.cc;
+			yc += other.yc;
+		}
+	};
+
+	// vanilla european samples, S = S0 exp(drift + volT z), y = payoff(S), c = S (the control).
+	// antithetic: one sample per z is the mean over z and -z. nothing is discounted
+	void vanillaMoments(const double *z, size_t n, double S0, double drift, double volT, OptionType optType,
+						double strike, bool antithetic, Moments &m);
+
+	// one time step of n paths: S[i] = prev[i] * exp(drift + vol * z[i])
+	void stepPaths(const double *prev, const double *z, size_t n, double drift, double vol, double *S);
+}
+
+#endif
@@ -0,0 +1,138 @@
+#include <algorithm>
+#include "PortfolioCache.h"
+
+PortfolioCache::PortfolioCache(const Market &market, const vector<shared_ptr<Trade>> &portfolio, ThreadPool &pool)
+	: mkt(market), trades(portfolio), pool(pool)
+{
+	vector<MarketDataId> deps;
+	for (size_t i = 0; i < trades.size(); i++)
+	{
+		deps.clear();
+		if (!trades[i]->getMarketDependencies(deps))
+		{
+			followAll.push_back(i);
+			continue;
+		}
+		for (const auto &id : deps)
+		{
+			auto &dependents = index[id];
+			if (dependents.empty() || dependents.back() != i)
+				dependents.push_back(i);
+		}
+	}
+	dirty.assign(trades.size(), 0);
+	pv.assign(trades.size(), 0.0);
+	markAllDirty();
+}
+
+void PortfolioCache::markDirty(const MarketDataId &id)
+{
+	auto mark = [this](size_t i)
+	{
+		if (!dirty[i])
+		{
+			dirty[i] = 1;
+			dirtyList.push_back(i);
+		}
+	};
+	auto it = index.find(id);
+	if (it != index.end())
+		for (size_t i : it->second)
+			mark(i);
+	for (size_t i : followAll)
+		mark(i);
+}
+
+void PortfolioCache::markAllDirty()
+{
+	for (size_t i = 0; i < trades.size(); i++)
+	{
+		if (!dirty[i])
+		{
+			dirty[i] = 1;
+			dirtyList.push_back(i);
+		}
+	}
+}
+
+void PortfolioCache::updateCurve(const string &name, shared_ptr<RateCurve> curve)
+{
+	mkt.setCurve(name, curve);
+	markDirty({MarketDataId::Curve, name});
+}
+
+void PortfolioCache::updateVolCurve(const string &name, shared_ptr<VolCurve> vol)
+{
+	mkt.setVolCurve(name, vol);
+	markDirty({MarketDataId::Vol, name});
+}
+
+void PortfolioCache::updateStockPrice(const string &name, double price)
+{
+	mkt.setStockPrice(name, price);
+	markDirty({MarketDataId::Stock, name});
+}
+
+void PortfolioCache::trackRisk(double _curveShock, double _volShock)
+{
+	withRisk = true;
+	curveShock = _curveShock;
+	volShock = _volShock;
+	dv01.assign(trades.size(), 0.0);
+	vega.assign(trades.size(), 0.0);
+	markAllDirty();
+}
+
+size_t PortfolioCache::refresh()
+{
+	if (dirtyList.empty())
+		return 0;
+
+	// trades reading the same data tend to be near each other, keep the order stable
+	std::sort(dirtyList.begin(), dirtyList.end());
+	pool.parallel_for(0, dirtyList.size(), [&](size_t k)
+					  {
+		size_t i = dirtyList[k];
+		pv[i] = trades[i]->Pv(mkt); });
+
+	if (withRisk)
+	{
+		// the curve and vol up/down markets RiskEngine builds, without its spot columns or
+		// tree greeks: columns are the curves in sorted order, then LOGVOL, up then down
+		vector<Market> shocked;
+		for (const char *curve : {"SGD-SORA", "USD-SOFR"})
+			for (double shock : {curveShock, -curveShock})
+			{
+				shocked.push_back(mkt);
+				shocked.back().shockCurve(curve, Date(), shock);
+			}
+		const size_t volColumn = shocked.size();
+		for (double shock : {volShock, -volShock})
+		{
+			shocked.push_back(mkt);
+			shocked.back().shockVolCurve("LOGVOL", Date(), shock);
+		}
+
+		const size_t nScen = shocked.size(), n = dirtyList.size();
+		vector<double> pvs(n * nScen);
+		pool.parallel_for(0, n * nScen, [&](size_t task)
+						  {
+			size_t s = task / n, k = task % n;
+			pvs[k * nScen + s] = trades[dirtyList[k]]->Pv(shocked[s]); });
+		for (size_t k = 0; k < n; k++)
+		{
+			const double *row = &pvs[k * nScen];
+			double total = 0.0;
+			for (size_t c = 0; c < volColumn; c += 2)
+				total += (row[c] - row[c + 1]) / 2.0;
+			dv01[dirtyList[k]] = total;
+			vega[dirtyList[k]] = (row[volColumn] - row[volColumn + 1]) / 2.0;
+		}
+	}
+
+	size_t repriced = dirtyList.size();
+	for (size_t i : dirtyList)
+		dirty[i] = 0;
+	dirtyList.clear();
+	return repriced;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "Trade.h"
+#include "Market.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// pvs (and optionally dv01 / vega) of a portfolio kept up to date as market data ticks.
+// every trade is indexed by the market data it reads (getMarketDependencies), an update
+// marks only those trades dirty and refresh() reprices just them on the pool
+class PortfolioCache
+{
+public:
+	PortfolioCache(const Market &market, const vector<shared_ptr<Trade>> &portfolio, ThreadPool &pool = defaultThreadPool());
+
+	// ticks: update the held market and mark the dependent trades dirty
+	void updateCurve(const string &name, shared_ptr<RateCurve> curve);
+	void updateVolCurve(const string &name, shared_ptr<VolCurve> vol);
+	void updateStockPrice(const string &name, double price);
+
+	// from now on refresh() also recomputes dv01 (summed over curves) and vega of the
+	// dirty trades, central differences under the curve and vol shifts RiskEngine applies.
+	// marks everything dirty
+	void trackRisk(double curveShock, double volShock);
+
+	// reprices the dirty trades, returns how many were repriced
+	size_t refresh();
+
+	inline const Market &market() const { return mkt; }
+	inline size_t dirtyCount() const { return dirtyList.size(); }
+	inline const vector<double> &pvs() const { return pv; }
+	inline const vector<double> &dv01s() const { return dv01; }
+	inline const vector<double> &vegas() const { return vega; }
+	inline size_t dependents(const MarketDataId &id) const
+	{
+		auto it = index.find(id);
+		return (it != index.end() ? it->second.size() : 0) + followAll.size();
+	}
+
+private:
+	void markDirty(const MarketDataId &id);
+	void markAllDirty();
+
+	Market mkt;
+	vector<shared_ptr<Trade>> trades;
+	ThreadPool &pool;
+
+	map<MarketDataId, vector<size_t>> index; // market data -> trades that read it
+	vector<size_t> followAll;				  // trades without known dependencies
+
+	vector<char> dirty; // per trade, dirtyList holds each dirty trade once
+	vector<size_t> dirtyList;
+	vector<double> pv;
+
+	bool withRisk = false;
+	double curveShock = 0.0, volShock = 0.0;
+	vector<double> dv01;
+	vector<double> vega;
+};
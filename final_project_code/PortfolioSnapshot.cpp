@@ -0,0 +1,286 @@
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "PortfolioSnapshot.h"
+#include "Swap.h"
+#include "Bond.h"
+#include "EuropeanTrade.h"
+#include "AmericanTrade.h"
+
+namespace
+{
+	enum Column
+	{
+		Order,
+		Id,
+		Name,
+		TradeDate,
+		StartDate,
+		EndDate,
+		Notional,
+		Rate,
+		Strike,
+		Freq,
+		Option,
+		ScheduleBegin,
+		ScheduleDates,
+		nColumns
+	};
+
+	// byte offsets from the start of the file, 0 for a column the kind does not have
+	struct KindBlock
+	{
+		uint64_t count;
+		uint64_t nScheduleDates;
+		uint64_t column[nColumns];
+	};
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder; // 0x01020304 as written, catches a file from the other endianness
+		uint64_t fileBytes;
+		uint64_t sourceBytes; // PortfolioSnapshot::Source
+		int64_t sourceTime;
+		uint64_t nNames;
+		uint64_t nameBegin; // nNames + 1 offsets into nameChars
+		uint64_t nameChars;
+		KindBlock kinds[4];
+	};
+
+	const char snapshotMagic[8] = {'T', 'R', 'A', 'D', 'E', 'S', 'N', 'P'};
+	constexpr uint32_t byteOrderMark = 0x01020304;
+
+	// appends the column 8 byte aligned, returns its offset
+	template <class T>
+	uint64_t appendColumn(vector<char> &buf, const vector<T> &values)
+	{
+		buf.resize((buf.size() + 7) & ~size_t(7), 0);
+		uint64_t offset = buf.size();
+		const char *bytes = reinterpret_cast<const char *>(values.data());
+		buf.insert(buf.end(), bytes, bytes + values.size() * sizeof(T));
+		return offset;
+	}
+
+	template <class T>
+	const T *columnAt(const char *base, size_t size, uint64_t offset, uint64_t count, const string &fileName)
+	{
+		if (offset == 0)
+			return nullptr;
+		if (offset % 8 != 0 || offset > size || count > (size - offset) / sizeof(T))
+			throw runtime_error("Error: trade snapshot '" + fileName + "' is corrupt or truncated");
+		return reinterpret_cast<const T *>(base + offset);
+	}
+}
+
+PortfolioSnapshot::Source PortfolioSnapshot::Source::of(const string &fileName)
+{
+	Source source;
+	std::error_code ec;
+	auto bytes = std::filesystem::file_size(fileName, ec);
+	if (ec)
+		return source;
+	auto time = std::filesystem::last_write_time(fileName, ec);
+	if (ec)
+		return source;
+	source.bytes = bytes;
+	source.writeTime = (int64_t)time.time_since_epoch().count();
+	return source;
+}
+
+void PortfolioSnapshot::write(const string &fileName, const vector<TradeRow> &rows, const Source &source)
+{
+	struct KindColumns
+	{
+		vector<uint32_t> order, name;
+		vector<int32_t> id, tradeDate, startDate, endDate, optionType, scheduleDates;
+		vector<double> notional, rate, strike, freq;
+		vector<uint64_t> scheduleBegin{0};
+	};
+	KindColumns kinds[4];
+	vector<string_view> names;
+	unordered_map<string_view, uint32_t> nameIndex;
+	vector<Date> schedule;
+
+	for (size_t i = 0; i < rows.size(); i++)
+	{
+		const TradeRow &r = rows[i];
+		KindColumns &k = kinds[r.kind];
+		auto found = nameIndex.emplace(r.underlying, (uint32_t)names.size());
+		if (found.second)
+			names.push_back(r.underlying);
+		k.order.push_back((uint32_t)i);
+		k.id.push_back(r.id);
+		k.name.push_back(found.first->second);
+		k.tradeDate.push_back((int32_t)r.tradeDate.getSerialDate());
+		k.startDate.push_back((int32_t)r.startDate.getSerialDate());
+		k.endDate.push_back((int32_t)r.endDate.getSerialDate());
+		k.notional.push_back(r.notional);
+		if (r.kind == TradeRow::Swap || r.kind == TradeRow::Bond)
+		{
+			try
+			{
+				couponSchedule(r.startDate, r.endDate, r.freq, schedule);
+			}
+			catch (const runtime_error &e)
+			{
+				throw runtime_error("Error: trade " + to_string(r.id) + ": " + e.what());
+			}
+			for (const Date &dt : schedule)
+				k.scheduleDates.push_back((int32_t)dt.getSerialDate());
+			k.scheduleBegin.push_back(k.scheduleDates.size());
+			k.rate.push_back(r.rate);
+			k.freq.push_back(r.freq);
+		}
+		else
+		{
+			k.strike.push_back(r.strike);
+			k.optionType.push_back((int32_t)r.optionType);
+		}
+	}
+
+	FileHeader header = {};
+	memcpy(header.magic, snapshotMagic, sizeof(snapshotMagic));
+	header.version = version;
+	header.byteOrder = byteOrderMark;
+	header.nNames = names.size();
+	header.sourceBytes = source.bytes;
+	header.sourceTime = source.writeTime;
+	vector<char> buf(sizeof(FileHeader), 0);
+
+	vector<uint64_t> nameBegin{0};
+	vector<char> nameChars;
+	for (string_view name : names)
+	{
+		nameChars.insert(nameChars.end(), name.begin(), name.end());
+		nameBegin.push_back(nameChars.size());
+	}
+	header.nameBegin = appendColumn(buf, nameBegin);
+	header.nameChars = appendColumn(buf, nameChars);
+
+	for (int kind = 0; kind < 4; kind++)
+	{
+		KindColumns &k = kinds[kind];
+		KindBlock &block = header.kinds[kind];
+		bool scheduled = kind == TradeRow::Swap || kind == TradeRow::Bond;
+		block.count = k.order.size();
+		block.column[Order] = appendColumn(buf, k.order);
+		block.column[Id] = appendColumn(buf, k.id);
+		block.column[Name] = appendColumn(buf, k.name);
+		block.column[TradeDate] = appendColumn(buf, k.tradeDate);
+		block.column[StartDate] = appendColumn(buf, k.startDate);
+		block.column[EndDate] = appendColumn(buf, k.endDate);
+		block.column[Notional] = appendColumn(buf, k.notional);
+		if (scheduled)
+		{
+			block.nScheduleDates = k.scheduleDates.size();
+			block.column[Rate] = appendColumn(buf, k.rate);
+			block.column[Freq] = appendColumn(buf, k.freq);
+			block.column[ScheduleBegin] = appendColumn(buf, k.scheduleBegin);
+			block.column[ScheduleDates] = appendColumn(buf, k.scheduleDates);
+		}
+		else
+		{
+			block.column[Strike] = appendColumn(buf, k.strike);
+			block.column[Option] = appendColumn(buf, k.optionType);
+		}
+		k = KindColumns();
+	}
+	header.fileBytes = buf.size();
+	memcpy(buf.data(), &header, sizeof(header));
+
+	ofstream out(fileName, ios::binary);
+	if (!out.is_open())
+		throw runtime_error("Error: Could not open trade snapshot '" + fileName + "' for writing");
+	out.write(buf.data(), buf.size());
+	if (!out)
+		throw runtime_error("Error: Could not write trade snapshot '" + fileName + "'");
+}
+
+PortfolioSnapshot::PortfolioSnapshot(const string &fileName) : file(fileName)
+{
+	const char *base = file.data();
+	size_t size = file.size();
+	FileHeader header;
+	if (size < sizeof(header))
+		throw runtime_error("Error: '" + fileName + "' is not a trade snapshot");
+	memcpy(&header, base, sizeof(header));
+	if (memcmp(header.magic, snapshotMagic, sizeof(snapshotMagic)) != 0 || header.byteOrder != byteOrderMark)
+		throw runtime_error("Error: '" + fileName + "' is not a trade snapshot");
+	if (header.version != version)
+		throw runtime_error("Error: trade snapshot '" + fileName + "' has version " + to_string(header.version) + ", expected " + to_string(version));
+	if (header.fileBytes != size)
+		throw runtime_error("Error: trade snapshot '" + fileName + "' is corrupt or truncated");
+	src.bytes = header.sourceBytes;
+	src.writeTime = header.sourceTime;
+
+	const uint64_t *nameBegin = columnAt<uint64_t>(base, size, header.nameBegin, header.nNames + 1, fileName);
+	const char *nameChars = columnAt<char>(base, size, header.nameChars, nameBegin[header.nNames], fileName);
+	for (size_t n = 0; n < header.nNames; n++)
+	{
+		if (nameBegin[n] > nameBegin[n + 1])
+			throw runtime_error("Error: trade snapshot '" + fileName + "' is corrupt or truncated");
+		nameViews.emplace_back(nameChars + nameBegin[n], nameBegin[n + 1] - nameBegin[n]);
+	}
+
+	for (int kind = 0; kind < 4; kind++)
+	{
+		const KindBlock &block = header.kinds[kind];
+		Columns &c = cols[kind];
+		size_t n = block.count;
+		c.count = n;
+		c.order = columnAt<uint32_t>(base, size, block.column[Order], n, fileName);
+		c.id = columnAt<int32_t>(base, size, block.column[Id], n, fileName);
+		c.name = columnAt<uint32_t>(base, size, block.column[Name], n, fileName);
+		c.tradeDate = columnAt<int32_t>(base, size, block.column[TradeDate], n, fileName);
+		c.startDate = columnAt<int32_t>(base, size, block.column[StartDate], n, fileName);
+		c.endDate = columnAt<int32_t>(base, size, block.column[EndDate], n, fileName);
+		c.notional = columnAt<double>(base, size, block.column[Notional], n, fileName);
+		c.rate = columnAt<double>(base, size, block.column[Rate], n, fileName);
+		c.strike = columnAt<double>(base, size, block.column[Strike], n, fileName);
+		c.freq = columnAt<double>(base, size, block.column[Freq], n, fileName);
+		c.optionType = columnAt<int32_t>(base, size, block.column[Option], n, fileName);
+		c.scheduleBegin = columnAt<uint64_t>(base, size, block.column[ScheduleBegin], n + 1, fileName);
+		c.scheduleDates = columnAt<int32_t>(base, size, block.column[ScheduleDates], block.nScheduleDates, fileName);
+		if (c.scheduleBegin && c.scheduleBegin[n] != block.nScheduleDates)
+			throw runtime_error("Error: trade snapshot '" + fileName + "' is corrupt or truncated");
+		total += n;
+	}
+}
+
+vector<shared_ptr<Trade>> PortfolioSnapshot::trades(ThreadPool &pool) const
+{
+	vector<shared_ptr<Trade>> out(total);
+	for (int kind = 0; kind < 4; kind++)
+	{
+		const Columns &c = cols[kind];
+		pool.parallel_for(0, c.count, [&](size_t i)
+						  {
+			if (c.order[i] >= total || c.name[i] >= nameViews.size())
+				throw runtime_error("Error: trade snapshot is corrupt");
+			string name(nameViews[c.name[i]]);
+			Date start = Date::fromSerial(c.startDate[i]), end = Date::fromSerial(c.endDate[i]);
+			shared_ptr<Trade> &trade = out[c.order[i]];
+			if (kind == TradeRow::Swap || kind == TradeRow::Bond)
+			{
+				uint64_t b = c.scheduleBegin[i], e = c.scheduleBegin[i + 1];
+				if (b >= e)
+					throw runtime_error("Error: trade snapshot is corrupt");
+				vector<Date> schedule(e - b);
+				for (uint64_t k = b; k < e; k++)
+					schedule[k - b] = Date::fromSerial(c.scheduleDates[k]);
+				if (kind == TradeRow::Swap)
+					trade = make_shared<Swap>(name, start, end, c.notional[i], c.rate[i], c.freq[i], std::move(schedule));
+				else
+					trade = make_shared<Bond>(name, start, end, c.notional[i], c.rate[i], c.freq[i], std::move(schedule));
+			}
+			else if (kind == TradeRow::European)
+				trade = make_shared<EuropeanOption>((OptionType)c.optionType[i], c.notional[i], c.strike[i], start, end, name);
+			else
+				trade = make_shared<AmericanOption>((OptionType)c.optionType[i], c.notional[i], c.strike[i], start, end, name); });
+	}
+	return out;
+}
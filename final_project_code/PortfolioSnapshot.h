@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Trade.h"
+#include "TradeLoader.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// a portfolio saved in a versioned binary file, read back through mmap with no parsing:
+//   header | underlying names | per trade kind: one column per field, coupon schedules
+// every column is 8 byte aligned, dates are excel serials. swaps and bonds carry their coupon
+// schedule, so opening a snapshot never runs dateAddTenor
+class PortfolioSnapshot
+{
+public:
+	static constexpr uint32_t version = 2;
+
+	// size and last write time of the trade file a snapshot was written from, a reader compares
+	// them with the file as it is now to tell whether the snapshot is current
+	struct Source
+	{
+		uint64_t bytes = 0;
+		int64_t writeTime = 0; // filesystem clock ticks
+		// zeros if the file cannot be read
+		static Source of(const string &fileName);
+		inline bool operator==(const Source &other) const { return bytes == other.bytes && writeTime == other.writeTime; }
+	};
+
+	// the columns of one trade kind, pointers into the mapped file. columns a kind does not
+	// use (strike of a swap, schedule of an option) are null
+	struct Columns
+	{
+		size_t count = 0;
+		const uint32_t *order = nullptr; // position of the trade in the source file
+		const int32_t *id = nullptr;
+		const uint32_t *name = nullptr; // index into names()
+		const int32_t *tradeDate = nullptr;
+		const int32_t *startDate = nullptr;
+		const int32_t *endDate = nullptr;
+		const double *notional = nullptr; // signed, like TradeRow
+		const double *rate = nullptr;
+		const double *strike = nullptr;
+		const double *freq = nullptr;
+		const int32_t *optionType = nullptr;
+		const uint64_t *scheduleBegin = nullptr; // count + 1 offsets into scheduleDates
+		const int32_t *scheduleDates = nullptr;
+	};
+
+	// maps the file, throws if it is not a snapshot of this version or is truncated
+	explicit PortfolioSnapshot(const string &fileName);
+
+	// writes rows (in file order) with the coupon schedules of their swaps and bonds, and the
+	// source they were parsed from (none: the snapshot never matches a file). throws on a row
+	// whose schedule cannot be generated
+	static void write(const string &fileName, const vector<TradeRow> &rows, const Source &source);
+	static inline void write(const string &fileName, const vector<TradeRow> &rows) { write(fileName, rows, Source()); }
+
+	inline size_t size() const { return total; }
+	inline const Source &source() const { return src; }
+	inline const Columns &columns(TradeRow::Kind kind) const { return cols[kind]; }
+	inline const vector<string_view> &names() const { return nameViews; }
+
+	// the trades in source file order, swaps and bonds built on the stored schedules
+	vector<shared_ptr<Trade>> trades(ThreadPool &pool = defaultThreadPool()) const;
+
+private:
+	MappedFile file;
+	Columns cols[4];
+	vector<string_view> nameViews;
+	size_t total = 0;
+	Source src;
+};
@@ -1,5 +1,14 @@
+#include <atomic>
 #include <cmath>
+#include <map>
+#include <tuple>
+#include <stdexcept>
 #include "Pricer.h"
+#include "Lattice.h"
+#include "BlackScholes.h"
+#include "MonteCarlo.h"
+#include "EuropeanTrade.h"
+#include "AmericanTrade.h"
 
 
 double Pricer::Price(const Market& mkt, std::shared_ptr<Trade> trade)
@@ -17,41 +26,284 @@ double Pricer::Price(const Market& mkt, std::shared_ptr<Trade> trade)
 	return pv;
 }
 
-double BinomialTreePricer::PriceTree(const Market& mkt, const TreeProduct& trade)
+void Pricer::PricePortfolio(const Market& mkt, const std::vector<std::shared_ptr<Trade>>& trades, std::vector<double>& pvs)
 {
-	// model setup
-	double T = (trade.GetExpiry() - mkt.asOf)/365.0;
-	double dt = T / nTimeSteps;
-	double s0 = mkt.getStockPrice(trade.getUnderlying());
+	pvs.resize(trades.size());
+	for (size_t i = 0; i < trades.size(); i++)
+		pvs[i] = Price(mkt, trades[i]);
+}
+
+BinomialTreePricer::TreeInputs BinomialTreePricer::ReadMarket(const Market& mkt, const std::string& underlying, const Date& expiry) const
+{
+	TreeInputs in;
+	in.T = (expiry - mkt.asOf)/365.0;
+	in.S0 = mkt.getStockPrice(underlying);
 	auto volCurve = mkt.getVolCurve("LOGVOL");
-	double vol = volCurve->getVol(trade.GetExpiry());
+	in.sigma = volCurve->getVol(expiry);
 	auto irCurve = mkt.getCurve("USD-SOFR");
-	double rate = irCurve->getRate(trade.GetExpiry());
-	ModelSetup(s0, vol, rate, dt);
-
-	// terminal payoff
-	for (int i = 0; i <= nTimeSteps; i++) {
-		states[i] = trade.Payoff(GetSpot(nTimeSteps, i));
-	}
-
-	// price by backward induction
-	for (int k = nTimeSteps - 1; k >= 0; k--)
-		for (int i = 0; i <= k; i++) {
-			// calculate continuation value
-			double df = exp(-rate * dt);
-			double continuation = df * (states[i] * GetProbUp() + states[i + 1] * GetProbDown());
-			// calculate the option value at node(k, i)
-			states[i] = trade.ValueAtNode(GetSpot(k, i), dt * k, continuation);
+	in.rate = irCurve->getRate(expiry);
+	return in;
+}
+
+BinomialTreePricer::TreeInputs BinomialTreePricer::ReadMarket(const Market& mkt, const TreeProduct& trade) const
+{
+	TreeInputs in = ReadMarket(mkt, trade.getUnderlying(), trade.GetExpiry());
+	in.terms = trade.GetTreeTerms();
+	return in;
+}
+
+namespace
+{
+	inline double pvOf(double pv) { return pv; }
+	inline double pvOf(const OptionGreeks& g) { return g.pv; }
+
+	// the tolerance mode of PriceTree and PriceGreeks: double the steps until two successive
+	// prices agree, withSteps(N) prices with N steps
+	template <class Fn>
+	auto doubleSteps(Fn withSteps, double tolerance, int maxSteps) -> decltype(withSteps(0))
+	{
+		int N = 16;
+		auto prev = withSteps(N);
+		while (2 * N <= maxSteps)
+		{
+			N *= 2;
+			auto cur = withSteps(N);
+			bool converged = std::abs(pvOf(cur) - pvOf(prev)) <= tolerance * std::max(std::abs(pvOf(cur)), 1e-12);
+			prev = cur;
+			if (converged)
+				return prev;
+		}
+		throw std::runtime_error("Error: tree price did not converge to a relative tolerance of " + std::to_string(tolerance) + " within " + std::to_string(N) + " steps");
+	}
+}
+
+double BinomialTreePricer::PriceTree(const Market& mkt, const TreeProduct& trade)
+{
+	TreeInputs in = ReadMarket(mkt, trade);
+	if (IsAnalytic(in.terms))
+		return bs::price(in.terms.optType, in.S0, in.terms.strike, in.T, in.rate, in.sigma);
+	if (tolerance <= 0)
+		return PriceWithSteps(in, trade, nTimeSteps);
+	return doubleSteps([&](int N) { return PriceWithSteps(in, trade, N); }, tolerance, maxTimeSteps);
+}
+
+OptionGreeks BinomialTreePricer::PriceGreeks(const Market& mkt, const TreeProduct& trade)
+{
+	TreeInputs in = ReadMarket(mkt, trade);
+	if (IsAnalytic(in.terms))
+		return bs::greeks(in.terms.optType, in.S0, in.terms.strike, in.T, in.rate, in.sigma);
+	if (tolerance <= 0)
+		return GreeksWithSteps(in, trade, nTimeSteps);
+	return doubleSteps([&](int N) { return GreeksWithSteps(in, trade, N); }, tolerance, maxTimeSteps);
+}
+
+bool BinomialTreePricer::CanBatch(const std::vector<const TreeProduct*>& trades) const
+{
+	if (tolerance > 0 || !SharesLattice() || trades.empty())
+		return false;
+	const TreeProduct& first = *trades[0];
+	bool american = first.GetTreeTerms().american;
+	for (auto trade : trades)
+	{
+		TreeTerms terms = trade->GetTreeTerms();
+		if ((terms.optType != Call && terms.optType != Put) || terms.american != american || IsAnalytic(terms))
+			return false;
+		if (trade->GetExpiry() != first.GetExpiry() || trade->getUnderlying() != first.getUnderlying())
+			return false;
+	}
+	return true;
+}
+
+void BinomialTreePricer::PriceTreeBatch(const Market& mkt, const std::vector<const TreeProduct*>& trades, std::vector<double>& out)
+{
+	out.resize(trades.size());
+	if (!CanBatch(trades))
+	{
+		for (size_t i = 0; i < trades.size(); i++)
+			out[i] = PriceTree(mkt, *trades[i]);
+		return;
+	}
+
+	// the lattice only depends on spot, vol, rate and expiry, all shared by the batch
+	TreeInputs in = ReadMarket(mkt, *trades[0]);
+	batchStrikes.resize(trades.size());
+	batchSigns.resize(trades.size());
+	for (size_t i = 0; i < trades.size(); i++)
+	{
+		TreeTerms terms = trades[i]->GetTreeTerms();
+		batchStrikes[i] = terms.strike;
+		batchSigns[i] = terms.optType == Call ? 1.0 : -1.0;
+	}
+	PriceStrikesOnLattice(in, in.terms.american, trades.size(), out.data());
+}
+
+void BinomialTreePricer::PriceStrikesOnLattice(const TreeInputs& in, bool american, size_t n, double* out)
+{
+	int N = nTimeSteps;
+	double dt = in.T / N;
+	modelSteps = N;
+	modelStrike = in.S0;
+	ModelSetup(in.S0, in.sigma, in.rate, dt);
+	lattice::TreeParams tp{N, currentSpot, u, d, p, exp(-in.rate * dt), dt};
+	lattice::priceStrikes(tp, american, batchStrikes.data(), batchSigns.data(), n, states, spots, out);
+}
+
+void BinomialTreePricer::PriceVanillaBatch(const Market& mkt, const std::string& underlying, const Date& expiry, bool american,
+	const OptionType* types, const double* strikes, size_t n, double* out)
+{
+	if (n == 0)
+		return;
+	TreeInputs in = ReadMarket(mkt, underlying, expiry);
+	bool shared = tolerance <= 0 && SharesLattice();
+	for (size_t i = 0; i < n && shared; i++)
+		shared = (types[i] == Call || types[i] == Put) && !IsAnalytic(TreeTerms{american, types[i], strikes[i]});
+	if (shared)
+	{
+		batchStrikes.assign(strikes, strikes + n);
+		batchSigns.resize(n);
+		for (size_t i = 0; i < n; i++)
+			batchSigns[i] = types[i] == Call ? 1.0 : -1.0;
+		PriceStrikesOnLattice(in, american, n, out);
+		return;
+	}
+	for (size_t i = 0; i < n; i++)
+	{
+		if (IsAnalytic(TreeTerms{american, types[i], strikes[i]}))
+			out[i] = bs::price(types[i], in.S0, strikes[i], in.T, in.rate, in.sigma);
+		else if (american)
+			out[i] = PriceTree(mkt, AmericanOption(types[i], 1, strikes[i], mkt.asOf, expiry, underlying));
+		else
+			out[i] = PriceTree(mkt, EuropeanOption(types[i], 1, strikes[i], mkt.asOf, expiry, underlying));
+	}
+}
+
+void BinomialTreePricer::PricePortfolio(const Market& mkt, const std::vector<std::shared_ptr<Trade>>& trades, std::vector<double>& pvs)
+{
+	pvs.resize(trades.size());
+	// (underlying, expiry, american) -> trade indices
+	std::map<std::tuple<std::string, int, bool>, std::vector<size_t>> groups;
+	// analytic europeans, as arrays for bs::greeksBatch
+	std::vector<size_t> analytic;
+	std::vector<OptionType> types;
+	std::vector<double> S, K, T, r, vol;
+	for (size_t i = 0; i < trades.size(); i++)
+	{
+		auto treePtr = trades[i]->getType() == "TreeProduct" ? dynamic_cast<const TreeProduct*>(trades[i].get()) : nullptr;
+		TreeTerms terms = treePtr ? treePtr->GetTreeTerms() : TreeTerms();
+		if (IsAnalytic(terms))
+		{
+			TreeInputs in = ReadMarket(mkt, *treePtr);
+			analytic.push_back(i);
+			types.push_back(terms.optType);
+			S.push_back(in.S0);
+			K.push_back(terms.strike);
+			T.push_back(in.T);
+			r.push_back(in.rate);
+			vol.push_back(in.sigma);
 		}
+		else if (terms.optType == Call || terms.optType == Put)
+			groups[std::make_tuple(treePtr->getUnderlying(), treePtr->GetExpiry().getSerialDate(), terms.american)].push_back(i);
+		else
+			pvs[i] = Price(mkt, trades[i]);
+	}
+
+	std::vector<const TreeProduct*> batch;
+	for (auto& group : groups)
+	{
+		const std::vector<size_t>& idx = group.second;
+		batch.clear();
+		for (size_t i : idx)
+			batch.push_back(static_cast<const TreeProduct*>(trades[i].get()));
+		PriceTreeBatch(mkt, batch, batchOut);
+		for (size_t j = 0; j < idx.size(); j++)
+			pvs[idx[j]] = batchOut[j] * trades[idx[j]]->getNotional();
+	}
 
-	return states[0];
+	batchOut.resize(analytic.size());
+	bs::greeksBatch(analytic.size(), types.data(), S.data(), K.data(), T.data(), r.data(), vol.data(), batchOut.data());
+	for (size_t j = 0; j < analytic.size(); j++)
+		pvs[analytic[j]] = batchOut[j] * trades[analytic[j]]->getNotional();
+}
 
+double BinomialTreePricer::PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	return PriceLattice(in, trade, N);
+}
+
+double BinomialTreePricer::PriceLattice(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	// model setup
+	double dt = in.T / N;
+	modelSteps = N;
+	modelStrike = in.terms.optType != None ? in.terms.strike : in.S0;
+	ModelSetup(in.S0, in.sigma, in.rate, dt);
+
+	// price by backward induction, the payoff is inlined when the trade describes it
+	lattice::TreeParams tp{N, currentSpot, u, d, p, exp(-in.rate * dt), dt};
+	return lattice::withExercise(trade, [&](const auto& ex)
+		{ return lattice::price(tp, ex, states, spots); });
+}
+
+// the quadratic through the three nodes of step 2 at today's spot gives price, delta and gamma,
+// the same quadratic at the root's spot against the root's value gives theta over 2 dt
+static OptionGreeks greeksFromNodes(const lattice::ExtendedNodes& nodes, double S0, double dt)
+{
+	OptionGreeks g;
+	const double* S = nodes.S;
+	const double* V = nodes.V;
+	if (!(S[0] > S[2]))
+	{
+		g.pv = V[1]; // no spread of spots to difference over
+		return g;
+	}
+	double f01 = (V[0] - V[1]) / (S[0] - S[1]);
+	double f12 = (V[1] - V[2]) / (S[1] - S[2]);
+	double f012 = (f01 - f12) / (S[0] - S[2]);
+	auto value = [&](double x)
+	{ return V[2] + (x - S[2]) * (f12 + f012 * (x - S[1])); };
+	g.pv = value(S0);
+	g.delta = f12 + f012 * (2 * S0 - S[1] - S[2]);
+	g.gamma = 2 * f012;
+	g.theta = (value(nodes.root) - nodes.rootValue) / (2 * dt);
+	return g;
+}
+
+OptionGreeks BinomialTreePricer::GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	return GreeksLattice(in, trade, N);
+}
+
+OptionGreeks BinomialTreePricer::GreeksLattice(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	if (in.T <= 0)
+	{
+		OptionGreeks g;
+		g.pv = PriceLattice(in, trade, N);
+		return g;
+	}
+	// the model of PriceLattice's N step tree, grown by two steps before today: the root sits
+	// one up and one down move away from the spot, so the middle node of step 2 is the spot
+	// and the tree after it is the one PriceTree rolls back
+	double dt = in.T / N;
+	modelSteps = N;
+	modelStrike = in.terms.optType != None ? in.terms.strike : in.S0;
+	ModelSetup(in.S0, in.sigma, in.rate, dt);
+	lattice::TreeParams tp{N + 2, in.S0 / (u * d), u, d, p, exp(-in.rate * dt), dt, -2 * dt};
+	lattice::ExtendedNodes nodes = lattice::withExercise(trade, [&](const auto& ex)
+		{
+			lattice::terminalSpots(tp, spots);
+			states.resize(tp.nSteps + 1);
+			for (int i = 0; i <= tp.nSteps; i++)
+				states[i] = ex.terminal(spots[i]);
+			return lattice::rollBackExtended(tp, ex, tp.nSteps, states, spots); });
+	return greeksFromNodes(nodes, in.S0, dt);
 }
 
 void CRRBinomialTreePricer::ModelSetup(double S0, double sigma, double rate, double dt)
 {
 	double b = std::exp((2 * rate + sigma * sigma) * dt) + 1;
 	u = (b + std::sqrt(b * b - 4 * std::exp(2 * rate * dt))) / 2 / std::exp(rate * dt);
+	d = 1 / u;
 	p = (std::exp(rate * dt) - 1 / u) / (u - 1 / u);
 	currentSpot = S0;
 }
@@ -63,3 +315,469 @@ void JRRNBinomialTreePricer::ModelSetup(double S0, double sigma, double rate, do
 	p = (std::exp(rate * dt) - d) / (u - d);
 	currentSpot = S0;
 }
+
+double LeisenReimerTreePricer::PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	return PriceLattice(in, trade, N | 1);
+}
+
+OptionGreeks LeisenReimerTreePricer::GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	return GreeksLattice(in, trade, N | 1);
+}
+
+void LeisenReimerTreePricer::ModelSetup(double S0, double sigma, double rate, double dt)
+{
+	// Peizer-Pratt method 2 inversion of the normal cdf for an n step tree
+	auto h = [](double z, double n)
+	{
+		double a = z / (n + 1.0 / 3.0 + 0.1 / (n + 1));
+		double root = 0.5 * std::sqrt(1 - std::exp(-a * a * (n + 1.0 / 6.0)));
+		return z >= 0 ? 0.5 + root : 0.5 - root;
+	};
+	double T = dt * modelSteps;
+	double volT = sigma * std::sqrt(T);
+	double d1 = (std::log(S0 / modelStrike) + (rate + 0.5 * sigma * sigma) * T) / volT;
+	double d2 = d1 - volT;
+	double growth = std::exp(rate * dt);
+	p = h(d2, modelSteps);
+	u = growth * h(d1, modelSteps) / p;
+	d = (growth - p * u) / (1 - p);
+	currentSpot = S0;
+}
+
+double BBSRTreePricer::PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	// two point richardson extrapolation of the smoothed tree
+	int half = std::max(N / 2, 1);
+	N = 2 * half;
+	return 2 * PriceSmoothed(in, trade, N) - PriceSmoothed(in, trade, half);
+}
+
+OptionGreeks BBSRTreePricer::GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	// the same extrapolation on every greek
+	int half = std::max(N / 2, 1);
+	N = 2 * half;
+	OptionGreeks fine, coarse;
+	PriceSmoothed(in, trade, N, &fine);
+	PriceSmoothed(in, trade, half, &coarse);
+	OptionGreeks g;
+	g.pv = 2 * fine.pv - coarse.pv;
+	g.delta = 2 * fine.delta - coarse.delta;
+	g.gamma = 2 * fine.gamma - coarse.gamma;
+	g.theta = 2 * fine.theta - coarse.theta;
+	return g;
+}
+
+double BBSRTreePricer::PriceSmoothed(const TreeInputs& in, const TreeProduct& trade, int N, OptionGreeks* greeks)
+{
+	OptionType type = in.terms.optType;
+	if (N < 2 || type == None || in.T <= 0)
+	{
+		// nothing to smooth with
+		if (!greeks)
+			return PriceLattice(in, trade, N);
+		*greeks = GreeksLattice(in, trade, N);
+		return greeks->pv;
+	}
+
+	const int extra = greeks ? 2 : 0; // steps before today, see GreeksLattice
+	const int steps = N + extra;
+	double dt = in.T / N;
+	modelSteps = N;
+	modelStrike = in.terms.strike;
+	ModelSetup(in.S0, in.sigma, in.rate, dt);
+	lattice::TreeParams tp{steps, greeks ? in.S0 / (u * d) : currentSpot, u, d, p, exp(-in.rate * dt), dt, -extra * dt};
+
+	// last step priced by black-scholes over dt instead of the final binomial step
+	lattice::TreeParams last = tp;
+	last.nSteps = steps - 1;
+	lattice::terminalSpots(last, spots);
+	states.resize(steps);
+	for (int i = 0; i < steps; i++)
+	{
+		double v = bs::price(type, spots[i], in.terms.strike, dt, in.rate, in.sigma);
+		states[i] = in.terms.american ? std::max(v, PAYOFF::VanillaOption(type, in.terms.strike, spots[i])) : v;
+	}
+	return lattice::withExercise(trade, [&](const auto& ex)
+		{
+			if (!greeks)
+			{
+				lattice::rollBack(tp, ex, steps - 1, 0, states, spots);
+				return states[0];
+			}
+			*greeks = greeksFromNodes(lattice::rollBackExtended(tp, ex, steps - 1, states, spots), in.S0, dt);
+			return greeks->pv; });
+}
+
+double FiniteDifferencePricer::PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	if (in.terms.optType == None)
+		return PriceLattice(in, trade, N);
+	return Solve(in, N, false).pv;
+}
+
+OptionGreeks FiniteDifferencePricer::GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N)
+{
+	if (in.terms.optType == None)
+		return GreeksLattice(in, trade, N);
+	return Solve(in, N, true);
+}
+
+OptionGreeks FiniteDifferencePricer::Solve(const TreeInputs& in, int N, bool greeks)
+{
+	const OptionType type = in.terms.optType;
+	const double K = in.terms.strike, S0 = in.S0, r = in.rate, sigma = in.sigma, T = in.T;
+	OptionGreeks g;
+	if (T <= 0 || sigma <= 0)
+	{
+		g.pv = PAYOFF::VanillaOption(type, K, S0);
+		return g;
+	}
+	N = std::max(N, 2);
+
+	// x = log(S / S0) on nodes -half .. half, spot at node half. dx is shrunk a little so the
+	// strike falls on a node too, which keeps the error smooth in N. the space error dominates
+	// once the time grid is graded, hence the many more nodes than time steps
+	const double k = std::log(K / S0);
+	double width = std::max(4 * sigma * std::sqrt(T), 1.5 * std::abs(k));
+	int half = 8 * N + 1;
+	double dx = width / half;
+	if (std::abs(k) > dx)
+	{
+		dx = std::abs(k) / std::ceil(std::abs(k) / dx);
+		half = (int)std::ceil(width / dx);
+	}
+	const int M = 2 * half;
+
+	// spots and terminal values, states holds V
+	spots.resize(M + 1);
+	states.resize(M + 1);
+	for (int j = 0; j <= M; j++)
+	{
+		spots[j] = S0 * std::exp((j - half) * dx);
+		states[j] = PAYOFF::VanillaOption(type, K, spots[j]);
+	}
+	spots[half] = S0;
+	const bool american = in.terms.american;
+	if (american)
+		exercise.assign(states.begin(), states.end());
+	// a binary jumps at the strike node, start it from the mid value or it converges at first order
+	int strikeNode = half + (int)std::lround(k / dx);
+	if ((type == BinaryCall || type == BinaryPut) && strikeNode > 0 && strikeNode < M && std::abs(spots[strikeNode] / K - 1) < 1e-9)
+		states[strikeNode] = 0.5;
+	rhs.resize(M + 1);
+
+	// dV/dtau = a V'' + b V' - r V in x, central differences
+	const double a = 0.5 * sigma * sigma / (dx * dx);
+	const double b = (r - 0.5 * sigma * sigma) / (2 * dx);
+	const double lo = a - b, mid = -2 * a - r, up = a + b;
+
+	// boundary values at time to expiry tau: the discounted payoff, floored by exercise
+	auto boundary = [&](double S, double tau)
+	{
+		double df = std::exp(-r * tau);
+		double v;
+		switch (type)
+		{
+		case Call:
+			v = std::max(S - K * df, 0.0);
+			break;
+		case Put:
+			v = std::max(K * df - S, 0.0);
+			break;
+		default:
+			v = df * PAYOFF::VanillaOption(type, K, S);
+		}
+		return american ? std::max(v, PAYOFF::VanillaOption(type, K, S)) : v;
+	};
+
+	// puts exercise below a boundary, calls above it: eliminate towards the exercise region
+	// and substitute back out of it, projecting on the payoff on the way
+	const bool exerciseLow = type == Put || type == BinaryPut;
+
+	// elimination multipliers, inverse pivots and off diagonal over pivot of (1 - theta h L),
+	// so the sweeps of a step have no division and one fma in their dependency chains. the
+	// matrix is constant along its diagonals and the pivots converge geometrically, once they
+	// stop moving the rest is a fill
+	mult.resize(M + 1);
+	inv.resize(M + 1);
+	coupling.resize(M + 1);
+	double l = 0, u = 0;
+	auto factorize = [&](double h, double theta)
+	{
+		l = -theta * h * lo;
+		u = -theta * h * up;
+		const double d = 1 - theta * h * mid;
+		// puts eliminate the upper diagonal from the top, calls the lower one from the bottom
+		const int first = exerciseLow ? M - 1 : 1, dir = exerciseLow ? -1 : 1;
+		const double towards = exerciseLow ? u : l, away = exerciseLow ? l : u;
+		double pivot = d;
+		inv[first] = 1 / pivot;
+		coupling[first] = away * inv[first];
+		int j = first + dir;
+		for (; j >= 1 && j < M; j += dir)
+		{
+			mult[j] = towards * inv[j - dir];
+			double next = d - mult[j] * away;
+			inv[j] = 1 / next;
+			coupling[j] = away * inv[j];
+			if (next == pivot)
+				break;
+			pivot = next;
+		}
+		if (j < 1 || j >= M)
+			return;
+		const int from = exerciseLow ? 1 : j + 1, to = exerciseLow ? j : M;
+		std::fill(mult.begin() + from, mult.begin() + to, mult[j]);
+		std::fill(inv.begin() + from, inv.begin() + to, inv[j]);
+		std::fill(coupling.begin() + from, coupling.begin() + to, coupling[j]);
+	};
+
+	double* V = states.data();
+	double* R = rhs.data();
+	const double* m = mult.data();
+	const double* p = inv.data();
+	const double* c = coupling.data();
+	double tau = 0;
+	auto step = [&](double h, double theta)
+	{
+		factorize(h, theta);
+		tau += h;
+		const double e = (1 - theta) * h;
+		for (int j = 1; j < M; j++)
+			R[j] = V[j] + e * (lo * V[j - 1] + mid * V[j] + up * V[j + 1]);
+		V[0] = boundary(spots[0], tau);
+		V[M] = boundary(spots[M], tau);
+		R[1] -= l * V[0];
+		R[M - 1] -= u * V[M];
+		if (exerciseLow)
+		{
+			// eliminate going down, then substitute up out of the exercise region
+			for (int j = M - 2; j >= 1; j--)
+				R[j] -= m[j] * R[j + 1];
+			double below = 0.0;
+			for (int j = 1; j < M; j++)
+			{
+				double v = R[j] * p[j] - c[j] * below;
+				V[j] = below = american ? std::max(v, exercise[j]) : v;
+			}
+		}
+		else
+		{
+			for (int j = 2; j < M; j++)
+				R[j] -= m[j] * R[j - 1];
+			double above = 0.0;
+			for (int j = M - 1; j >= 1; j--)
+			{
+				double v = R[j] * p[j] - c[j] * above;
+				V[j] = above = american ? std::max(v, exercise[j]) : v;
+			}
+		}
+	};
+
+	// time to expiry tau_n = T (n / N)^2: the exercise boundary and the payoff kink move like
+	// sqrt(tau), so the steps are short near expiry and long away from it. the first two are
+	// Rannacher smoothed, two implicit Euler half steps each, the rest are Crank-Nicolson.
+	// for greeks of an american the last one ends in two short implicit steps too: crank-nicolson
+	// hardly damps the ripples the exercise projection leaves, and gamma would read them off the
+	// grid. the price alone keeps the full crank-nicolson step, the last step is the longest and
+	// going implicit there costs the pv accuracy
+	auto node = [&](int n)
+	{
+		double s = double(n) / N;
+		return T * s * s;
+	};
+	for (int n = 1; n <= N; n++)
+	{
+		double h = node(n) - node(n - 1);
+		if (n <= 2)
+		{
+			step(0.5 * h, 1.0);
+			step(0.5 * h, 1.0);
+		}
+		else if (n == N && american && greeks)
+		{
+			step(0.75 * h, 0.5);
+			step(0.125 * h, 1.0);
+			step(0.125 * h, 1.0);
+		}
+		else
+			step(h, 0.5);
+	}
+
+	const double Vx = (V[half + 1] - V[half - 1]) / (2 * dx);
+	const double Vxx = (V[half + 1] - 2 * V[half] + V[half - 1]) / (dx * dx);
+	g.pv = V[half];
+	g.delta = Vx / S0;
+	g.gamma = (Vxx - Vx) / (S0 * S0);
+	// theta from the pde itself where the option is held, 0 where it is exercised
+	bool exercised = american && V[half] <= exercise[half];
+	g.theta = exercised ? 0.0 : r * g.pv - r * S0 * g.delta - 0.5 * sigma * sigma * S0 * S0 * g.gamma;
+	return g;
+}
+
+namespace
+{
+	TreePricingOptions defaultTreeOptions;
+	std::atomic<bool> defaultTreeOptionsRead{false};
+}
+
+const TreePricingOptions& DefaultTreeOptions()
+{
+	// load first: every pricing call comes through here, a store each time would bounce the line
+	if (!defaultTreeOptionsRead.load(std::memory_order_relaxed))
+		defaultTreeOptionsRead.store(true, std::memory_order_relaxed);
+	return defaultTreeOptions;
+}
+
+void SetDefaultTreeOptions(const TreePricingOptions& options)
+{
+	if (defaultTreeOptionsRead.load(std::memory_order_relaxed))
+		throw std::runtime_error("Error: default tree options set after pricing started");
+	defaultTreeOptions = options;
+}
+
+std::shared_ptr<BinomialTreePricer> MakeTreePricer(const TreePricingOptions& options)
+{
+	std::shared_ptr<BinomialTreePricer> pricer;
+	switch (options.method)
+	{
+	case TreeMethod::JRRN:
+		pricer = std::make_shared<JRRNBinomialTreePricer>(options.steps);
+		break;
+	case TreeMethod::LeisenReimer:
+		pricer = std::make_shared<LeisenReimerTreePricer>(options.steps);
+		break;
+	case TreeMethod::BBSR:
+		pricer = std::make_shared<BBSRTreePricer>(options.steps);
+		break;
+	case TreeMethod::FiniteDifference:
+		pricer = std::make_shared<FiniteDifferencePricer>(options.steps);
+		break;
+	default:
+		pricer = std::make_shared<CRRBinomialTreePricer>(options.steps);
+	}
+	if (options.tolerance > 0)
+		pricer->SetTolerance(options.tolerance);
+	pricer->SetAnalyticEuropean(options.analyticEuropean);
+	return pricer;
+}
+
+MonteCarloResult MonteCarloPricer::Simulate(const Market& mkt, const TreeProduct& trade) const
+{
+	TreeTerms terms = trade.GetTreeTerms();
+	if (terms.american)
+		throw std::runtime_error("MonteCarloPricer: american exercise is not supported");
+
+	MonteCarloResult result;
+	double T = (trade.GetExpiry() - mkt.asOf) / 365.0;
+	double S0 = mkt.getStockPrice(trade.getUnderlying());
+	if (T <= 0)
+	{
+		result.pv = trade.Payoff(S0);
+		return result;
+	}
+	double sigma = mkt.getVolCurve("LOGVOL")->getVol(trade.GetExpiry());
+	double r = mkt.getCurve("USD-SOFR")->getRate(trade.GetExpiry());
+	double df = std::exp(-r * T);
+
+	// vanilla payoffs only need the terminal spot and run in the SIMD kernel, anything else
+	// steps whole paths and calls PathPayoff per path
+	const bool vanilla = terms.optType != None;
+	const int steps = vanilla ? 1 : std::max(options.steps, 1);
+	if (options.sobol && steps > (int)mc::sobolMaxDims)
+		throw std::runtime_error("MonteCarloPricer: sobol supports at most " + std::to_string(mc::sobolMaxDims) + " steps");
+	const double dt = T / steps;
+	const double drift = (r - 0.5 * sigma * sigma) * dt;
+	const double volDt = sigma * std::sqrt(dt);
+
+	// one sample per normal vector, the mean of the pair when antithetic. sobol runs split the
+	// samples over the replicates, each the same points under its own digital shift
+	const size_t blockSamples = options.antithetic ? 4096 : 8192;
+	const size_t samples = options.antithetic ? (options.paths + 1) / 2 : options.paths;
+	const size_t nReps = options.sobol ? std::max(options.replicates, 2) : 1;
+	const size_t repSamples = (samples + nReps - 1) / nReps;
+	const size_t repBlocks = (repSamples + blockSamples - 1) / blockSamples;
+	std::vector<mc::Moments> moments(nReps * repBlocks);
+	pool.parallel_for(0, moments.size(), [&](size_t b)
+		{
+			size_t rep = b / repBlocks, first = (b % repBlocks) * blockSamples;
+			size_t n = std::min(blockSamples, repSamples - first);
+			std::vector<double> z(n * steps); // step major
+			for (int k = 0; k < steps; k++)
+			{
+				if (options.sobol)
+					mc::sobolNormals(first + 1, k, mc::sobolShift(options.seed, rep, k), n, &z[k * n]);
+				else
+					mc::philoxNormals(options.seed, b, k, n, &z[k * n]);
+			}
+			mc::Moments& m = moments[b];
+			if (vanilla)
+			{
+				mc::vanillaMoments(z.data(), n, S0, drift, volDt, terms.optType, terms.strike, options.antithetic, m);
+				return;
+			}
+
+			std::vector<double> spots(n * steps), start(n, S0), y(n, 0.0), c(n, 0.0), path(steps);
+			for (double sign : {1.0, -1.0})
+			{
+				if (sign < 0 && !options.antithetic)
+					break;
+				for (int k = 0; k < steps; k++)
+					mc::stepPaths(k ? &spots[(k - 1) * n] : start.data(), &z[k * n], n, drift, sign * volDt, &spots[k * n]);
+				for (size_t i = 0; i < n; i++)
+				{
+					for (int k = 0; k < steps; k++)
+						path[k] = spots[k * n + i];
+					y[i] += trade.PathPayoff(path.data(), steps);
+					c[i] += path[steps - 1];
+				}
+			}
+			double scale = options.antithetic ? 0.5 : 1.0;
+			for (size_t i = 0; i < n; i++)
+			{
+				double yi = scale * y[i], ci = scale * c[i];
+				m.n += 1;
+				m.y += yi;
+				m.yy += yi * yi;
+				m.c += ci;
+				m.cc += ci * ci;
+				m.yc += yi * ci;
+			}
+		}, 1);
+
+	std::vector<mc::Moments> reps(nReps);
+	mc::Moments total;
+	for (size_t b = 0; b < moments.size(); b++)
+		reps[b / repBlocks].add(moments[b]);
+	for (const auto& m : reps)
+		total.add(m);
+	const double N = total.n;
+	double var = N > 1 ? (total.yy - total.y * total.y / N) / (N - 1) : 0.0;
+	// y - beta (c - E[c]) with the variance minimising beta from all samples, E[c] undiscounted
+	double beta = 0, expectedC = S0 / df;
+	if (options.controlVariate && N > 1)
+	{
+		double varC = (total.cc - total.c * total.c / N) / (N - 1);
+		double cov = (total.yc - total.y * total.c / N) / (N - 1);
+		beta = varC > 0 ? cov / varC : 0.0;
+		var -= beta * cov;
+	}
+	auto estimate = [&](const mc::Moments& m) { return m.y / m.n - beta * (m.c / m.n - expectedC); };
+
+	double mean = estimate(total), stdError = std::sqrt(std::max(var, 0.0) / N);
+	if (options.sobol)
+	{
+		// the points within a replicate are not independent, their replicates are
+		double ss = 0;
+		for (const auto& m : reps)
+			ss += (estimate(m) - mean) * (estimate(m) - mean);
+		stdError = std::sqrt(ss / (nReps - 1) / nReps);
+	}
+	result.pv = df * mean;
+	result.stdError = df * stdError;
+	result.paths = (size_t)N * (options.antithetic ? 2 : 1);
+	return result;
+}
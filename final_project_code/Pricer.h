@@ -3,15 +3,20 @@
 
 #include <vector>
 #include <cmath>
+#include <cstdint>
 
 #include "Trade.h"
 #include "TreeProduct.h"
 #include "Market.h"
+#include "BlackScholes.h"
+#include "thread_pool.h"
 
 //interface
 class Pricer {
 public:
 	virtual double Price(const Market& mkt, std::shared_ptr<Trade> trade);
+	// pvs[i] = Price(mkt, trades[i]), pricers may override to share work across trades
+	virtual void PricePortfolio(const Market& mkt, const std::vector<std::shared_ptr<Trade>>& trades, std::vector<double>& pvs);
 
 private:
 	virtual double PriceTree(const Market& mkt, const TreeProduct& trade) { return 0; };
@@ -25,16 +30,72 @@ public:
 		states.resize(N + 1);
 	}
 	double PriceTree(const Market& mkt, const TreeProduct& trade) override;
+	// price, delta, gamma and theta per unit notional from one tree instead of a tree per bump:
+	// the tree starts two steps before today, so step 2 has three nodes around the spot for
+	// delta and gamma and the root gives theta. vega stays 0 (analytic europeans get all of bs::greeks)
+	virtual OptionGreeks PriceGreeks(const Market& mkt, const TreeProduct& trade);
+
+	// prices a strike ladder on one lattice, out[i] per unit notional like PriceTree. the trades
+	// must be calls/puts on the same underlying and expiry, all american or all european,
+	// anything else (or a strike aware model, or a tolerance) is priced trade by trade
+	void PriceTreeBatch(const Market& mkt, const std::vector<const TreeProduct*>& trades, std::vector<double>& out);
+	// the same from columns, eg. an OptionBook: n options of any type on one underlying, expiry and
+	// exercise, out[i] per unit notional like PriceTree. calls and puts share one lattice when
+	// the model allows it, anything else is priced one by one
+	void PriceVanillaBatch(const Market& mkt, const std::string& underlying, const Date& expiry, bool american,
+		const OptionType* types, const double* strikes, size_t n, double* out);
+	// groups the vanilla tree products by underlying, expiry and exercise and batches each group
+	void PricePortfolio(const Market& mkt, const std::vector<std::shared_ptr<Trade>>& trades, std::vector<double>& pvs) override;
+
+	// tolerance > 0: ignore N, double the steps from 16 until two prices agree to this relative
+	// tolerance. PriceTree / PriceGreeks throw if they still do not at maxSteps
+	inline void SetTolerance(double relTolerance, int maxSteps = 1 << 12) { tolerance = relTolerance; maxTimeSteps = maxSteps; }
+	// european calls, puts and binaries by closed form black-scholes instead of the tree
+	inline void SetAnalyticEuropean(bool analytic) { analyticEuropean = analytic; }
 
 protected:
+	// market inputs of one tree product
+	struct TreeInputs {
+		double S0;
+		double sigma;
+		double rate;
+		double T;
+		TreeTerms terms;
+	};
+	TreeInputs ReadMarket(const Market& mkt, const TreeProduct& trade) const;
+	TreeInputs ReadMarket(const Market& mkt, const std::string& underlying, const Date& expiry) const; // terms left empty
+	virtual double PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N); // default: PriceLattice
+	double PriceLattice(const TreeInputs& in, const TreeProduct& trade, int N);
+	virtual OptionGreeks GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N); // default: GreeksLattice
+	OptionGreeks GreeksLattice(const TreeInputs& in, const TreeProduct& trade, int N);
+	// false when the lattice depends on the strike or PriceWithSteps is not a plain lattice
+	virtual bool SharesLattice() const { return true; }
+	bool CanBatch(const std::vector<const TreeProduct*>& trades) const;
+	// one lattice for batchStrikes / batchSigns, out[j] per strike
+	void PriceStrikesOnLattice(const TreeInputs& in, bool american, size_t n, double* out);
+	bool IsAnalytic(const TreeTerms& terms) const { return analyticEuropean && !terms.american && terms.optType != None; }
+
+	// called once per tree, sets u, d and p. the node loop never calls back into the model
 	virtual void ModelSetup(double S0, double sigma, double rate, double dt) = 0; // pure virtual
-	virtual double GetSpot(int ti, int si) const = 0;
-	virtual double GetProbUp() const = 0;
-	virtual double GetProbDown() const = 0;
+
+	double u; // up multiplicative
+	double d; // down multiplicative
+	double p; // probability for up state
+	double currentSpot; // current market spot price
+	double modelStrike; // strike of the trade (spot if it has none), for strike aware models
+	int modelSteps; // steps of the tree being set up
+
+	std::vector<double> states;
+	std::vector<double> spots;
+	std::vector<double> batchStrikes;
+	std::vector<double> batchSigns;
+	std::vector<double> batchOut;
 
 private:
 	int nTimeSteps;
-	std::vector<double> states;
+	double tolerance = 0;
+	int maxTimeSteps = 1 << 12;
+	bool analyticEuropean = false;
 };
 
 class CRRBinomialTreePricer : public BinomialTreePricer
@@ -44,16 +105,6 @@ public:
 
 protected:
 	void ModelSetup(double S0, double sigma, double rate, double dt);
-	double GetSpot(int ti, int si) const {
-		return currentSpot * std::pow(u, ti - 2 * si);
-	}
-	double GetProbUp() const { return p; }
-	double GetProbDown() const { return 1 - p; }
-
-private:
-	double u; // up multiplicative
-	double p; // probability for up state
-	double currentSpot; // current market spot price
 };
 
 class JRRNBinomialTreePricer : public BinomialTreePricer
@@ -63,19 +114,121 @@ public:
 
 protected:
 	void ModelSetup(double S0, double sigma, double rate, double dt);
+};
 
-	double GetSpot(int ti, int si) const
-	{
-		return currentSpot * std::pow(u, ti - si) * std::pow(d, si);
-	}
-	double GetProbUp() const { return p; }
-	double GetProbDown() const { return 1 - p; }
+// Leisen-Reimer tree, probabilities from the Peizer-Pratt (method 2) inversion of d1/d2,
+// centred on the strike. second order convergence without odd/even oscillation, N is made odd
+class LeisenReimerTreePricer : public BinomialTreePricer
+{
+public:
+	LeisenReimerTreePricer(int N) : BinomialTreePricer(N | 1) {}
+
+protected:
+	double PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N) override;
+	OptionGreeks GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N) override;
+	bool SharesLattice() const override { return false; }
+	void ModelSetup(double S0, double sigma, double rate, double dt);
+};
+
+// binomial black-scholes with richardson extrapolation (BBSR): CRR tree whose last step is
+// replaced by the black-scholes value, then 2 * P(N) - P(N / 2)
+class BBSRTreePricer : public CRRBinomialTreePricer
+{
+public:
+	BBSRTreePricer(int N) : CRRBinomialTreePricer(N) {}
+
+protected:
+	double PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N) override;
+	OptionGreeks GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N) override;
+	bool SharesLattice() const override { return false; }
 
 private:
-	double u; // up multiplicative
-	double d; // down multiplicative
-	double p; // probability for up state
-	double currentSpot; // current market spot price
+	// greeks != nullptr: the tree starts two steps before today and they are filled too
+	double PriceSmoothed(const TreeInputs& in, const TreeProduct& trade, int N, OptionGreeks* greeks = nullptr);
 };
 
+// Crank-Nicolson on a log spot grid instead of a tree, for calls, puts and binaries (american
+// or european): the first two steps are Rannacher smoothed (implicit Euler half steps) against
+// the payoff kink, early exercise is a Brennan-Schwartz projection inside the tridiagonal solve.
+// N is the number of time steps, graded towards expiry. the grid gets about 16N space intervals
+// over +-4 standard deviations with the spot and the strike on nodes. anything else goes to
+// the CRR tree
+class FiniteDifferencePricer : public CRRBinomialTreePricer
+{
+public:
+	FiniteDifferencePricer(int N) : CRRBinomialTreePricer(N) {}
+
+protected:
+	double PriceWithSteps(const TreeInputs& in, const TreeProduct& trade, int N) override;
+	// delta and gamma off the grid around the spot, theta from the pde, all from the one solve
+	OptionGreeks GreeksWithSteps(const TreeInputs& in, const TreeProduct& trade, int N) override;
+	bool SharesLattice() const override { return false; }
+
+private:
+	// greeks: end on two short implicit steps, see Solve
+	OptionGreeks Solve(const TreeInputs& in, int N, bool greeks);
+
+	std::vector<double> exercise; // payoff per node, american only
+	std::vector<double> rhs;
+	std::vector<double> mult; // elimination multipliers
+	std::vector<double> inv; // inverse pivots
+	std::vector<double> coupling; // off diagonal over pivot
+};
+
+enum class TreeMethod {
+	CRR,
+	JRRN,
+	LeisenReimer,
+	BBSR,
+	FiniteDifference // not a tree, see FiniteDifferencePricer
+};
+
+struct TreePricingOptions {
+	TreeMethod method = TreeMethod::CRR;
+	int steps = 50;
+	double tolerance = 0; // > 0 picks the steps automatically, see BinomialTreePricer::SetTolerance
+	bool analyticEuropean = false; // see BinomialTreePricer::SetAnalyticEuropean
+};
+
+// price and standard error of one monte carlo run, per unit notional. for sobol runs the error
+// is the randomized qmc one, from the replicates' means
+struct MonteCarloResult {
+	double pv = 0;
+	double stdError = 0;
+	size_t paths = 0;
+};
+
+struct MonteCarloOptions {
+	size_t paths = 1 << 16; // antithetic pairs count as two
+	int steps = 1; // time steps for PathPayoff, vanilla europeans go to expiry in one
+	uint64_t seed = 1;
+	bool antithetic = true;
+	bool controlVariate = true; // the terminal spot, E[S_T] = S0 exp(rT)
+	bool sobol = false; // sobol points instead of philox, steps <= mc::sobolMaxDims
+	int replicates = 16; // sobol: independently shifted copies, stdError is the spread of their means
+};
+
+// black-scholes paths with the tree's market inputs (spot, LOGVOL and USD-SOFR at expiry), for
+// european exercise only. paths go in fixed blocks whose normals depend only on the seed and
+// the block, block sums are added in order: the same bits on any number of threads
+class MonteCarloPricer : public Pricer
+{
+public:
+	MonteCarloPricer(const MonteCarloOptions& _options = MonteCarloOptions(), ThreadPool& _pool = defaultThreadPool())
+		: options(_options), pool(_pool) {}
+	double PriceTree(const Market& mkt, const TreeProduct& trade) override { return Simulate(mkt, trade).pv; }
+	MonteCarloResult Simulate(const Market& mkt, const TreeProduct& trade) const;
+
+private:
+	MonteCarloOptions options;
+	ThreadPool& pool;
+};
+
+// options used by EuropeanOption::Pv and AmericanOption::Pv, CRR with 50 steps unless changed.
+// read concurrently by the pricing tasks, so they can only be set once, before the first read:
+// SetDefaultTreeOptions throws once DefaultTreeOptions() has been called
+const TreePricingOptions& DefaultTreeOptions();
+void SetDefaultTreeOptions(const TreePricingOptions& options);
+std::shared_ptr<BinomialTreePricer> MakeTreePricer(const TreePricingOptions& options);
+
 #endif
@@ -0,0 +1,281 @@
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include "ResultWriter.h"
+#include "TradeLoader.h"
+
+namespace
+{
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t byteOrder; // 0x01020304 as written, catches a file from the other endianness
+	};
+
+	// followed by count ids, pvs, dv01s, vegas, trade info end offsets, then infoChars chars
+	// padded to 8 bytes
+	struct GroupHeader
+	{
+		uint64_t count;
+		uint64_t infoChars;
+	};
+
+	const char resultMagic[8] = {'T', 'R', 'A', 'D', 'E', 'R', 'E', 'S'};
+	constexpr uint32_t byteOrderMark = 0x01020304;
+	constexpr size_t groupRows = 65536;
+	constexpr size_t maxQueued = 4; // blocks waiting for the writer thread
+	// longest "%f" of a double (-DBL_MAX: 309 digits, sign, 7 more), and of a shortest round trip
+	constexpr size_t maxFixed = 320;
+	constexpr size_t maxShortest = 32;
+
+	inline size_t padded(size_t bytes) { return (bytes + 7) & ~size_t(7); }
+
+	inline char *append(char *p, const char *s, size_t n)
+	{
+		memcpy(p, s, n);
+		return p + n;
+	}
+	template <size_t N>
+	inline char *append(char *p, const char (&s)[N]) { return append(p, s, N - 1); }
+
+	// the same digits as to_string (printf "%f")
+	inline char *appendFixed(char *p, double v) { return to_chars(p, p + maxFixed, v, chars_format::fixed, 6).ptr; }
+	inline char *appendShortest(char *p, double v) { return to_chars(p, p + maxShortest, v).ptr; }
+
+	template <class T>
+	char *appendColumn(char *p, const vector<T> &values) { return append(p, reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T)); }
+}
+
+ResultWriter::ResultWriter(const string &_fileName, ResultFormat _format, size_t _blockBytes)
+	: format(_format), blockBytes(_blockBytes), block(_blockBytes), fileName(_fileName)
+{
+	out = fopen(fileName.c_str(), format == ResultFormat::Binary ? "wb" : "w");
+	if (!out)
+		throw runtime_error("Error: Could not open file '" + fileName + "'");
+	setvbuf(out, nullptr, _IONBF, 0); // whole blocks go straight to write()
+
+	if (format == ResultFormat::Csv)
+	{
+		const char header[] = "id,trade,pv,dv01,vega\n";
+		used = append(reserve(sizeof(header)), header) - block.data();
+	}
+	else if (format == ResultFormat::Binary)
+	{
+		FileHeader header{};
+		memcpy(header.magic, resultMagic, sizeof(resultMagic));
+		header.version = version;
+		header.byteOrder = byteOrderMark;
+		used = append(reserve(sizeof(header)), reinterpret_cast<const char *>(&header), sizeof(header)) - block.data();
+	}
+	writer = thread(&ResultWriter::writerLoop, this);
+}
+
+ResultWriter::~ResultWriter()
+{
+	try
+	{
+		close();
+	}
+	catch (const exception &)
+	{
+	}
+}
+
+char *ResultWriter::reserve(size_t bytes)
+{
+	if (used + bytes > block.size())
+	{
+		flushBlock();
+		if (bytes > block.size())
+			block.resize(bytes);
+	}
+	return block.data() + used;
+}
+
+void ResultWriter::write(size_t id, string_view tradeInfo, double pv, double dv01, double vega)
+{
+	if (format == ResultFormat::Binary)
+	{
+		ids.push_back(id);
+		pvs.push_back(pv);
+		dv01s.push_back(dv01);
+		vegas.push_back(vega);
+		infoChars.insert(infoChars.end(), tradeInfo.begin(), tradeInfo.end());
+		infoEnd.push_back(infoChars.size());
+		if (ids.size() == groupRows)
+			flushGroup();
+		return;
+	}
+
+	char *p;
+	if (format == ResultFormat::Text)
+	{
+		p = reserve(tradeInfo.size() + 3 * maxFixed + 64);
+		p = to_chars(p, p + 24, id).ptr;
+		p = append(p, "; ");
+		p = append(p, tradeInfo.data(), tradeInfo.size());
+		p = appendFixed(append(p, "; PV:"), pv);
+		p = appendFixed(append(p, "; Delta:"), dv01);
+		p = appendFixed(append(p, "; Vega:"), vega);
+	}
+	else
+	{
+		p = reserve(2 * tradeInfo.size() + 3 * maxShortest + 32);
+		p = to_chars(p, p + 24, id).ptr;
+		*p++ = ',';
+		if (tradeInfo.find_first_of(",\"\r\n") == string_view::npos)
+			p = append(p, tradeInfo.data(), tradeInfo.size());
+		else
+		{
+			*p++ = '"';
+			for (char c : tradeInfo)
+			{
+				if (c == '"')
+					*p++ = '"';
+				*p++ = c;
+			}
+			*p++ = '"';
+		}
+		p = appendShortest(append(p, ","), pv);
+		p = appendShortest(append(p, ","), dv01);
+		p = appendShortest(append(p, ","), vega);
+	}
+	*p++ = '\n';
+	used = p - block.data();
+}
+
+void ResultWriter::flushGroup()
+{
+	if (ids.empty())
+		return;
+	GroupHeader header{ids.size(), infoChars.size()};
+	size_t bytes = sizeof(header) + 5 * ids.size() * sizeof(uint64_t) + padded(infoChars.size());
+	char *start = reserve(bytes);
+	char *p = append(start, reinterpret_cast<const char *>(&header), sizeof(header));
+	p = appendColumn(p, ids);
+	p = appendColumn(p, pvs);
+	p = appendColumn(p, dv01s);
+	p = appendColumn(p, vegas);
+	p = appendColumn(p, infoEnd);
+	p = appendColumn(p, infoChars);
+	memset(p, 0, start + bytes - p);
+	used += bytes;
+
+	ids.clear();
+	pvs.clear();
+	dv01s.clear();
+	vegas.clear();
+	infoEnd.clear();
+	infoChars.clear();
+}
+
+void ResultWriter::flushBlock()
+{
+	if (used == 0)
+		return;
+	unique_lock<mutex> lock(m);
+	cv.wait(lock, [&]
+			{ return full.size() < maxQueued; });
+	block.resize(used);
+	full.push_back(std::move(block));
+	if (!spare.empty())
+	{
+		block = std::move(spare.back());
+		spare.pop_back();
+	}
+	else
+		block = vector<char>();
+	block.resize(blockBytes);
+	used = 0;
+	cv.notify_all();
+}
+
+void ResultWriter::writerLoop()
+{
+	unique_lock<mutex> lock(m);
+	for (;;)
+	{
+		cv.wait(lock, [&]
+				{ return !full.empty() || closing; });
+		if (full.empty())
+			return;
+		vector<char> b = std::move(full.front());
+		full.pop_front();
+		lock.unlock();
+		bool ok = fwrite(b.data(), 1, b.size(), out) == b.size();
+		lock.lock();
+		failed = failed || !ok;
+		spare.push_back(std::move(b));
+		cv.notify_all();
+	}
+}
+
+void ResultWriter::close()
+{
+	if (!out)
+		return;
+	if (format == ResultFormat::Binary)
+		flushGroup();
+	flushBlock();
+	{
+		lock_guard<mutex> lock(m);
+		closing = true;
+	}
+	cv.notify_all();
+	writer.join();
+	bool ok = !failed;
+	ok = fclose(out) == 0 && ok;
+	out = nullptr;
+	if (!ok)
+		throw runtime_error("Error: Could not write file '" + fileName + "'");
+}
+
+vector<TradeResult> ResultWriter::readBinary(const string &fileName)
+{
+	MappedFile file(fileName);
+	const char *base = file.data();
+	size_t size = file.size();
+	FileHeader header;
+	if (size < sizeof(header) || (memcpy(&header, base, sizeof(header)), memcmp(header.magic, resultMagic, sizeof(resultMagic)) != 0) || header.version != version || header.byteOrder != byteOrderMark)
+		throw runtime_error("Error: '" + fileName + "' is not a result file of version " + to_string(version));
+	auto corrupt = [&]()
+	{ return runtime_error("Error: result file '" + fileName + "' is corrupt or truncated"); };
+
+	vector<TradeResult> rows;
+	vector<uint64_t> ids, infoEnd;
+	vector<double> pvs, dv01s, vegas;
+	auto column = [&](size_t &offset, auto &values, size_t count)
+	{
+		values.resize(count);
+		memcpy(values.data(), base + offset, count * sizeof(values[0]));
+		offset += count * sizeof(values[0]);
+	};
+	size_t offset = sizeof(header);
+	while (offset < size)
+	{
+		GroupHeader group;
+		if (size - offset < sizeof(group))
+			throw corrupt();
+		memcpy(&group, base + offset, sizeof(group));
+		offset += sizeof(group);
+		if (group.count > (size - offset) / (5 * sizeof(uint64_t)) || group.infoChars > size - offset - 5 * sizeof(uint64_t) * group.count)
+			throw corrupt();
+		column(offset, ids, group.count);
+		column(offset, pvs, group.count);
+		column(offset, dv01s, group.count);
+		column(offset, vegas, group.count);
+		column(offset, infoEnd, group.count);
+		const char *chars = base + offset;
+		offset += padded(group.infoChars);
+		uint64_t begin = 0;
+		for (size_t i = 0; i < group.count; i++)
+		{
+			if (infoEnd[i] < begin || infoEnd[i] > group.infoChars)
+				throw corrupt();
+			rows.push_back({ids[i], string(chars + begin, infoEnd[i] - begin), pvs[i], dv01s[i], vegas[i]});
+			begin = infoEnd[i];
+		}
+	}
+	return rows;
+}
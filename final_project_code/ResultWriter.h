@@ -0,0 +1,80 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct TradeResult
+{
+	size_t id;
+	string tradeInfo;
+	double PV = 0;
+	double DV01 = 0;
+	double Vega = 0;
+};
+
+enum class ResultFormat
+{
+	Text,	// the output.txt layout: "1; Swap USD-SOFR; PV:...; Delta:...; Vega:..." with to_string's 6 decimals
+	Csv,	// id,trade,pv,dv01,vega with the shortest decimal that reads back to the same double
+	Binary	// row groups of columns: ids, pv, dv01, vega, trade info, see readBinary
+};
+
+// streams result rows to a file: each row is formatted into a reusable block on the calling
+// thread, full blocks are written by a background thread, so the pricing threads never wait
+// on the disk unless it falls several blocks behind
+class ResultWriter
+{
+public:
+	static constexpr uint32_t version = 1;
+
+	// throws if the file cannot be created
+	ResultWriter(const string &fileName, ResultFormat format, size_t blockBytes = 1 << 20);
+	// close(), a write error is dropped here
+	~ResultWriter();
+	ResultWriter(const ResultWriter &) = delete;
+	ResultWriter &operator=(const ResultWriter &) = delete;
+
+	void write(size_t id, string_view tradeInfo, double pv, double dv01, double vega);
+	inline void write(const TradeResult &re) { write(re.id, re.tradeInfo, re.PV, re.DV01, re.Vega); }
+
+	// writes what is left and closes the file, throws if any block could not be written
+	void close();
+
+	// the rows of a file written in ResultFormat::Binary, throws if it is not one of this version
+	static vector<TradeResult> readBinary(const string &fileName);
+
+private:
+	char *reserve(size_t bytes); // room for bytes more in the current block
+	void flushGroup();			 // binary: the buffered rows as one group of columns
+	void flushBlock();			 // hands the current block to the writer thread
+	void writerLoop();
+
+	FILE *out = nullptr;
+	ResultFormat format;
+	size_t blockBytes;
+	vector<char> block;
+	size_t used = 0;
+
+	// binary rows wait here until a group is full
+	vector<uint64_t> ids;
+	vector<double> pvs, dv01s, vegas;
+	vector<uint64_t> infoEnd;
+	vector<char> infoChars;
+
+	mutex m;
+	condition_variable cv;
+	deque<vector<char>> full;	// written in order by writerLoop
+	vector<vector<char>> spare; // written blocks, reused
+	bool closing = false;
+	bool failed = false;
+	string fileName;
+	thread writer;
+};
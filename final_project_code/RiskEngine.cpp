@@ -1,102 +1,215 @@
+#include <algorithm>
 #include "RiskEngine.h"
+#include "Pricer.h"
+#include "TreeProduct.h"
+
+// delta and gamma of a tree product times its notional, from the one extended tree of
+// BinomialTreePricer::PriceGreeks with the pricer its Pv uses. false for other trades
+static bool treeGreeks(const Trade &trade, const Market &mkt, OptionGreeks &greeks)
+{
+	auto tree = trade.getType() == "TreeProduct" ? dynamic_cast<const TreeProduct *>(&trade) : nullptr;
+	if (!tree)
+		return false;
+	greeks = MakeTreePricer(DefaultTreeOptions())->PriceGreeks(mkt, *tree);
+	greeks.delta *= trade.getNotional();
+	greeks.gamma *= trade.getNotional();
+	return true;
+}
+
+// pv(spot + h) - pv(spot) to second order, 0 when the shocked stock is not the underlying
+static double spotMove(const Trade &trade, const OptionGreeks &greeks, const string &stock, double h)
+{
+	return trade.getUnderlying() == stock ? greeks.delta * h + 0.5 * greeks.gamma * h * h : 0.0;
+}
+
+vector<RiskEngine::ShockJob> RiskEngine::shockJobs(const string &riskType) const
+{
+	vector<ShockJob> jobs;
+	if (riskType == "dv01")
+		for (auto &kv : curveShocks)
+			jobs.push_back({kv.first, &kv.second.getMarketUp(), &kv.second.getMarketDown(), 0.5});
+	if (riskType == "vega")
+		for (auto &kv : volShocksUp)
+			jobs.push_back({kv.first, &kv.second.getMarket(), &volShocksDown.at(kv.first).getMarket(), 0.5});
+	if (riskType == "price")
+		for (auto &kv : priceShocks)
+			jobs.push_back({kv.first, &kv.second.getMarket(), &kv.second.getOriginMarket(), 1.0});
+	return jobs;
+}
 
 void RiskEngine::computeRisk(string riskType, shared_ptr<Trade> trade, bool singleThread)
 {
 	result.clear();
 	if (singleThread)
 	{
-		if (riskType == "dv01")
-		{
-			for (auto &kv : curveShocks)
-			{
-				string market_id = kv.first;
-				auto mkt_u = kv.second.getMarketUp();
-				auto mkt_d = kv.second.getMarketDown();
-				double pv_up = trade->Pv(mkt_u);
-				double pv_down = trade->Pv(mkt_d);
-				double dv01 = (pv_up - pv_down) / 2.0;
-				result.emplace(market_id, dv01);
-			}
-		}
+		OptionGreeks greeks;
+		bool fromGreeks = riskType == "price" && treeGreeks(*trade, baseMarket, greeks);
+		for (const auto &job : shockJobs(riskType))
+			result.emplace(job.id, fromGreeks ? spotMove(*trade, greeks, job.id, priceShock) : (trade->Pv(*job.up) - trade->Pv(*job.down)) * job.scale);
+	}
+	else
+	{
+		result = computeRiskBatch(riskType, {trade}, defaultThreadPool())[0];
+	}
+}
 
-		if (riskType == "vega")
-		{
-			for (auto &kv : volShocksUp)
-			{
-				string market_id = kv.first;
-				auto mkt_up = kv.second.getMarket();
-				auto mkt_down = volShocksDown.at(market_id).getMarket();
-				double pv_up = trade->Pv(mkt_up);
-				double pv_down = trade->Pv(mkt_down);
-				double vega = (pv_up - pv_down) / 2.0;
-				result.emplace(market_id, vega);
-			}
-		}
+vector<map<string, double>> RiskEngine::computeRiskBatch(const string &riskType, const vector<shared_ptr<Trade>> &trades, ThreadPool &pool) const
+{
+	// the scenario markets stay in the engine, tasks only carry pointers to them
+	const vector<ShockJob> jobs = shockJobs(riskType);
+	const size_t nJobs = jobs.size();
+	const size_t block = 64;
+	const size_t nBlocks = (trades.size() + block - 1) / block;
+
+	// spot risk of tree products from one tree each instead of two per shocked stock
+	vector<OptionGreeks> greeks;
+	vector<char> fromGreeks(trades.size(), 0);
+	if (riskType == "price")
+	{
+		greeks.resize(trades.size());
+		pool.parallel_for(0, trades.size(), [&](size_t i)
+						  { fromGreeks[i] = treeGreeks(*trades[i], baseMarket, greeks[i]); });
+	}
+
+	vector<double> risk(trades.size() * nJobs);
+	pool.parallel_for(0, nJobs * nBlocks, [&](size_t task)
+					  {
+		const ShockJob &job = jobs[task / nBlocks];
+		size_t begin = (task % nBlocks) * block, end = std::min(begin + block, trades.size());
+		for (size_t i = begin; i < end; i++)
+			risk[i * nJobs + task / nBlocks] = fromGreeks[i] ? spotMove(*trades[i], greeks[i], job.id, priceShock)
+															 : (trades[i]->Pv(*job.up) - trades[i]->Pv(*job.down)) * job.scale; }, 1);
+
+	vector<map<string, double>> out(trades.size());
+	for (size_t i = 0; i < trades.size(); i++)
+		for (size_t j = 0; j < nJobs; j++)
+			out[i].emplace(jobs[j].id, risk[i * nJobs + j]);
+	return out;
+}
 
-		if (riskType == "price")
+KeyRateRisk RiskEngine::computeKeyRateRisk(const vector<shared_ptr<Trade>> &portfolio, const vector<string> &curveIds, ThreadPool &pool) const
+{
+	KeyRateRisk risk;
+	risk.nTrades = portfolio.size();
+
+	// one scenario market per pillar, each only owns its bumped curve
+	vector<Market> scenarios;
+	for (const auto &id : curveIds)
+	{
+		for (const auto &pillar : baseMarket.getCurve(id)->getTenors())
 		{
-			for (auto &kv : priceShocks)
-			{
-				string market_id = kv.first;
-				auto mkt_orig = kv.second.getOriginMarket();
-				auto mkt_bumped = kv.second.getMarket();
-				double pv_orig = trade->Pv(mkt_orig);
-				double pv_bumped = trade->Pv(mkt_bumped);
-				double delta = pv_bumped - pv_orig;
-				result.emplace(market_id, delta);
-			}
+			risk.curveIds.push_back(id);
+			risk.pillars.push_back(pillar);
+			scenarios.push_back(baseMarket);
+			scenarios.back().shockCurve(id, pillar, curveShock);
 		}
 	}
-	else
+	risk.dv01.assign(risk.nTrades * risk.columns(), 0.0);
+
+	vector<double> basePv(risk.nTrades);
+	pool.parallel_for(0, risk.nTrades, [&](size_t i)
+					  { basePv[i] = portfolio[i]->Pv(baseMarket); });
+
+	// one job per (trade, pillar) cell of the row major result
+	const size_t nCols = risk.columns();
+	pool.parallel_for(0, risk.nTrades * nCols, [&](size_t cell)
+					  {
+		size_t i = cell / nCols;
+		risk.dv01[cell] = portfolio[i]->Pv(scenarios[cell % nCols]) - basePv[i]; });
+	return risk;
+}
+
+PortfolioRisk RiskEngine::computePortfolioRisk(const vector<shared_ptr<Trade>> &portfolio, ThreadPool &pool) const
+{
+	PortfolioRisk risk;
+	risk.nTrades = portfolio.size();
+
+	// scenario columns: base, then up/down pairs
+	vector<const Market *> markets{&baseMarket};
+	risk.scenarios.push_back("base");
+	auto addPair = [&](const string &name, const Market &up, const Market &down)
 	{
-		auto pv_task = [](shared_ptr<Trade> trade, string id, const Market &mkt_up, const Market &mkt_down)
-		{
-			double pv_up = trade->Pv(mkt_up);
-			double pv_down = trade->Pv(mkt_down);
-			double risk = (pv_up - pv_down) / 2.0;
-			return std::make_pair(id, risk);
-		};
+		markets.push_back(&up);
+		markets.push_back(&down);
+		risk.scenarios.push_back(name + ":up");
+		risk.scenarios.push_back(name + ":down");
+	};
 
-		vector<std::future<std::pair<string, double>>> _futures;
+	map<string, const CurveDecorator *> curves; // sorted, like the keys of computeRisk's result
+	for (auto &kv : curveShocks)
+		curves.emplace(kv.first, &kv.second);
+	for (auto &kv : curves)
+	{
+		risk.curveIds.push_back(kv.first);
+		addPair(kv.first, kv.second->getMarketUp(), kv.second->getMarketDown());
+	}
+	size_t volColumn = markets.size();
+	for (auto &kv : volShocksUp)
+		addPair(kv.first, kv.second.getMarket(), volShocksDown.at(kv.first).getMarket());
 
-		// For IR curve shocks (DV01)
-		for (auto &shock : curveShocks)
-		{
-			string market_id = shock.first;
-			auto mkt_u = shock.second.getMarketUp();
-			auto mkt_d = shock.second.getMarketDown();
-			_futures.push_back(std::async(std::launch::async, pv_task, trade, market_id, mkt_u, mkt_d));
-		}
+	// spot up/down for every option underlying
+	for (auto &trade : portfolio)
+		if (trade->getType() == "TreeProduct" && find(risk.underlyings.begin(), risk.underlyings.end(), trade->getUnderlying()) == risk.underlyings.end())
+			risk.underlyings.push_back(trade->getUnderlying());
+	size_t spotColumn = markets.size();
+	vector<Market> spotMarkets;
+	spotMarkets.reserve(2 * risk.underlyings.size()); // markets holds pointers into it
+	for (auto &name : risk.underlyings)
+	{
+		spotMarkets.push_back(baseMarket);
+		spotMarkets.back().shockPrice(name, priceShock);
+		spotMarkets.push_back(baseMarket);
+		spotMarkets.back().shockPrice(name, -priceShock);
+		addPair(name, spotMarkets[spotMarkets.size() - 2], spotMarkets.back());
+	}
 
-		// For vol shocks (Vega, central diff)
-		for (auto &shock : volShocksUp)
-		{
-			string market_id = shock.first;
-			auto mkt_up = shock.second.getMarket();
-			auto mkt_down = volShocksDown.at(market_id).getMarket();
-			_futures.push_back(std::async(std::launch::async, pv_task, trade, market_id, mkt_up, mkt_down));
-		}
+	// tree products get their spot columns from the delta and gamma of one tree rather than
+	// a tree per shocked market
+	vector<OptionGreeks> greeks(risk.nTrades);
+	vector<char> fromGreeks(risk.nTrades, 0);
+	if (!risk.underlyings.empty())
+		pool.parallel_for(0, risk.nTrades, [&](size_t i)
+						  { fromGreeks[i] = treeGreeks(*portfolio[i], baseMarket, greeks[i]); });
 
-		// For price shocks (Delta)
-		for (auto &shock : priceShocks)
+	// one task per (scenario, block of trades), scenario major: the trades of a block
+	// share that scenario's curve and vol tables while they are in cache
+	const size_t nScen = markets.size();
+	const size_t block = 256;
+	const size_t nBlocks = (risk.nTrades + block - 1) / block;
+	risk.pv.assign(risk.nTrades * nScen, 0.0);
+	pool.parallel_for(0, nScen * nBlocks, [&](size_t task)
+					  {
+		size_t s = task / nBlocks;
+		size_t begin = (task % nBlocks) * block, end = std::min(begin + block, risk.nTrades);
+		for (size_t i = begin; i < end; i++)
+			if (s < spotColumn || !fromGreeks[i])
+				risk.pv[i * nScen + s] = portfolio[i]->Pv(*markets[s]); }, 1);
+	for (size_t i = 0; i < risk.nTrades; i++)
+	{
+		if (!fromGreeks[i])
+			continue;
+		double *row = &risk.pv[i * nScen];
+		for (size_t u = 0; u < risk.underlyings.size(); u++)
 		{
-			string market_id = shock.first;
-			auto mkt_orig = shock.second.getOriginMarket();
-			auto mkt_bumped = shock.second.getMarket();
-			auto price_task = [trade, market_id, mkt_orig, mkt_bumped]()
-			{
-				double pv_orig = trade->Pv(mkt_orig);
-				double pv_bumped = trade->Pv(mkt_bumped);
-				double delta = pv_bumped - pv_orig;
-				return std::make_pair(market_id, delta);
-			};
-			_futures.push_back(std::async(std::launch::async, price_task));
+			row[spotColumn + 2 * u] = row[0] + spotMove(*portfolio[i], greeks[i], risk.underlyings[u], priceShock);
+			row[spotColumn + 2 * u + 1] = row[0] + spotMove(*portfolio[i], greeks[i], risk.underlyings[u], -priceShock);
 		}
+	}
 
-		for (auto &&fut : _futures)
-		{
-			auto rs = fut.get();
-			result.emplace(rs);
-		}
+	// sensitivities from the up/down columns
+	const size_t nCurves = risk.curveIds.size(), nSpots = risk.underlyings.size();
+	risk.dv01.resize(risk.nTrades * nCurves);
+	risk.vega.assign(risk.nTrades, 0.0);
+	risk.delta.resize(risk.nTrades * nSpots);
+	for (size_t i = 0; i < risk.nTrades; i++)
+	{
+		const double *row = &risk.pv[i * nScen];
+		for (size_t c = 0; c < nCurves; c++)
+			risk.dv01[i * nCurves + c] = (row[1 + 2 * c] - row[2 + 2 * c]) / 2.0;
+		for (size_t v = volColumn; v < spotColumn; v += 2)
+			risk.vega[i] += (row[v] - row[v + 1]) / 2.0;
+		for (size_t u = 0; u < nSpots; u++)
+			risk.delta[i * nSpots + u] = (row[spotColumn + 2 * u] - row[spotColumn + 2 * u + 1]) / 2.0;
 	}
+	return risk;
 }
@@ -8,6 +8,7 @@
 
 #include "Trade.h"
 #include "Market.h"
+#include "thread_pool.h"
 
 using namespace std;
 
@@ -17,6 +18,44 @@ struct MarketShock
 	pair<Date, double> shock; // tenor and value
 };
 
+// key rate (bucketed) dv01, one column per curve pillar, one row per trade
+struct KeyRateRisk
+{
+	vector<string> curveIds; // curve of each column
+	vector<Date> pillars;	 // pillar date of each column
+	size_t nTrades = 0;
+	vector<double> dv01;	 // row major, nTrades x columns
+
+	inline size_t columns() const { return pillars.size(); }
+	inline double at(size_t trade, size_t column) const { return dv01[trade * columns() + column]; }
+};
+
+// pv of every trade under every scenario, and the sensitivities derived from it.
+// all differences are central: (pv(up) - pv(down)) / 2
+struct PortfolioRisk
+{
+	vector<string> scenarios; // column names, 0 is the base market
+	size_t nTrades = 0;
+	vector<double> pv;		  // row major, nTrades x scenarios
+
+	vector<string> curveIds;	// one dv01 column per curve, parallel shift
+	vector<double> dv01;		// row major, nTrades x curveIds
+	vector<double> vega;		// per trade
+	vector<string> underlyings; // one delta column per underlying, spot shift
+	vector<double> delta;		// row major, nTrades x underlyings
+
+	inline double pvAt(size_t trade, size_t scenario) const { return pv[trade * scenarios.size() + scenario]; }
+	inline double dv01At(size_t trade, size_t curve) const { return dv01[trade * curveIds.size() + curve]; }
+	inline double deltaAt(size_t trade, size_t underlying) const { return delta[trade * underlyings.size() + underlying]; }
+	inline double totalDv01(size_t trade) const
+	{
+		double total = 0.0;
+		for (size_t c = 0; c < curveIds.size(); c++)
+			total += dv01At(trade, c);
+		return total;
+	}
+};
+
 // --- Curve Decorator ---
 class CurveDecorator : public Market
 {
@@ -25,12 +64,10 @@ public:
 		: thisMarketUp(mkt), thisMarketDown(mkt)
 	{
 		cout << "curve decorator is created" << endl;
-		auto curve_up = thisMarketUp.getCurve(curveShock.market_id);
-		curve_up->shock(curveShock.shock.first, curveShock.shock.second);
+		thisMarketUp.shockCurve(curveShock.market_id, curveShock.shock.first, curveShock.shock.second);
 		std::cout << "curve tenor " << curveShock.shock.first << "is shocked " << curveShock.shock.second << endl;
 
-		auto curve_down = thisMarketDown.getCurve(curveShock.market_id);
-		curve_down->shock(curveShock.shock.first, -1 * curveShock.shock.second);
+		thisMarketDown.shockCurve(curveShock.market_id, curveShock.shock.first, -1 * curveShock.shock.second);
 		std::cout << "curve tenor " << curveShock.shock.first << "is shocked " << curveShock.shock.second << endl;
 	}
 	inline const Market &getMarketUp() const { return thisMarketUp; }
@@ -48,8 +85,7 @@ public:
 	VolDecorator(const Market &mkt, const MarketShock &volShock) : originMarket(mkt), thisMarket(mkt)
 	{
 		cout << "vol decorator is created" << endl;
-		auto curve = thisMarket.getVolCurve(volShock.market_id);
-		curve->shock(volShock.shock.first, volShock.shock.second);
+		thisMarket.shockVolCurve(volShock.market_id, volShock.shock.first, volShock.shock.second);
 		cout << "vol curve " << volShock.shock.first << "is shocked" << volShock.shock.second << endl;
 	}
 	inline const Market &getOriginMarket() const { return originMarket; }
@@ -82,6 +118,7 @@ class RiskEngine
 {
 public:
 	RiskEngine(const Market &market, double curve_shock, double vol_shock, double price_shock)
+		: baseMarket(market), curveShock(curve_shock), priceShock(price_shock)
 	{
 		// --- AMENDED: Correct shocks for each curve ---
 		auto usdCurveShock = MarketShock();
@@ -127,8 +164,25 @@ public:
 		cout << " risk engine is created .. " << endl;
 	};
 
+	// riskType "dv01", "vega" or "price", one result per shocked market id, see getResult().
+	// price risk of a tree product is delta h + gamma h^2 / 2 from one tree, see
+	// BinomialTreePricer::PriceGreeks. multi threaded runs on defaultThreadPool()
 	void computeRisk(string riskType, std::shared_ptr<Trade> trade, bool singleThread);
 
+	// the same for many trades in one call, one result map per trade. tasks are (shock, block
+	// of trades) on the pool and reference the engine's scenario markets, nothing is copied
+	vector<map<string, double>> computeRiskBatch(const string &riskType, const vector<shared_ptr<Trade>> &trades, ThreadPool &pool) const;
+
+	// bump every pillar of each curve by curve_shock and reprice the portfolio on the pool,
+	// dv01 = pv(bumped) - pv(base) with one base pv per trade
+	KeyRateRisk computeKeyRateRisk(const vector<shared_ptr<Trade>> &portfolio, const vector<string> &curveIds, ThreadPool &pool) const;
+
+	// dv01 per curve, vega and delta per underlying for the whole portfolio in one pass: the
+	// scenario markets are the ones built by the constructor (plus spot up/down for each
+	// option underlying), the trades x scenarios grid is priced on the pool. the spot columns
+	// of tree products come from the delta and gamma of one tree per trade
+	PortfolioRisk computePortfolioRisk(const vector<shared_ptr<Trade>> &portfolio, ThreadPool &pool) const;
+
 	inline map<string, double> getResult() const
 	{
 		cout << " risk result: " << endl;
@@ -136,6 +190,19 @@ public:
 	};
 
 private:
+	// risk = (pv(up) - pv(down)) * scale, markets owned by the decorators below
+	struct ShockJob
+	{
+		string id;
+		const Market *up;
+		const Market *down;
+		double scale;
+	};
+	vector<ShockJob> shockJobs(const string &riskType) const;
+
+	Market baseMarket;
+	double curveShock;
+	double priceShock;
 	unordered_map<string, CurveDecorator> curveShocks; // e.g. USD-SOFR, SGD-SORA
 	unordered_map<string, VolDecorator> volShocks;	   // e.g. LOGVOL
 	unordered_map<string, PriceDecorator> priceShocks; // e.g. APPL (or any equity ticker)
@@ -0,0 +1,255 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <stdexcept>
+#include "ScenarioEngine.h"
+#include "helper.h"
+#include "Pricer.h"
+#include "TreeProduct.h"
+
+ScenarioReader::ScenarioReader(const string &fileName) : file(new ifstream(fileName)), in(file.get())
+{
+	if (!file->is_open())
+		throw runtime_error("Error: Could not open scenario file '" + fileName + "'");
+	readHeader();
+}
+
+ScenarioReader::ScenarioReader(istream &input) : in(&input)
+{
+	readHeader();
+}
+
+void ScenarioReader::readHeader()
+{
+	string header;
+	if (!getline(*in, header))
+		throw runtime_error("Error: empty scenario file");
+	vector<string> columns = split(header, ";");
+	for (size_t c = 1; c < columns.size(); c++)
+	{
+		string col = columns[c];
+		col.erase(remove_if(col.begin(), col.end(), ::isspace), col.end());
+		size_t colon = col.find(':');
+		string kind = colon == string::npos ? "" : to_lower(col.substr(0, colon));
+		string name = colon == string::npos ? col : col.substr(colon + 1);
+		if (kind == "curve")
+			factorIds.push_back({MarketDataId::Curve, name});
+		else if (kind == "vol")
+			factorIds.push_back({MarketDataId::Vol, name});
+		else if (kind == "spot")
+			factorIds.push_back({MarketDataId::Stock, name});
+		else
+			throw runtime_error("Error: scenario column '" + columns[c] + "' is not curve:, vol: or spot:");
+	}
+}
+
+size_t ScenarioReader::next(size_t maxRows, vector<Scenario> &out)
+{
+	out.clear();
+	string lineText;
+	while (out.size() < maxRows && getline(*in, lineText))
+	{
+		line++;
+		if (!lineText.empty() && lineText.back() == '\r')
+			lineText.pop_back();
+		if (lineText.empty())
+			continue;
+		vector<string> cells = split(lineText, ";");
+		if (cells.size() != factorIds.size() + 1)
+			throw runtime_error("Error: scenario line " + to_string(line) + " has " + to_string(cells.size()) + " columns, expected " + to_string(factorIds.size() + 1));
+		Scenario sc;
+		sc.label = cells[0];
+		sc.moves.resize(factorIds.size());
+		for (size_t f = 0; f < factorIds.size(); f++)
+			sc.moves[f] = stod(cells[f + 1]);
+		out.push_back(std::move(sc));
+	}
+	return out.size();
+}
+
+ScenarioEngine::ScenarioEngine(const Market &market, const vector<shared_ptr<Trade>> &portfolio, ThreadPool &pool)
+	: baseMarket(market), trades(portfolio), pool(pool)
+{
+}
+
+Market ScenarioEngine::scenarioMarket(const vector<MarketDataId> &factors, const Scenario &scenario) const
+{
+	Market mkt = baseMarket;
+	for (size_t f = 0; f < factors.size(); f++)
+	{
+		double move = scenario.moves[f];
+		if (move == 0.0)
+			continue;
+		switch (factors[f].kind)
+		{
+		case MarketDataId::Curve:
+			mkt.shockCurve(factors[f].name, Date(), move);
+			break;
+		case MarketDataId::Vol:
+			mkt.shockVolCurve(factors[f].name, Date(), move);
+			break;
+		case MarketDataId::Stock:
+			mkt.shockPrice(factors[f].name, baseMarket.getStockPrice(factors[f].name) * move);
+			break;
+		}
+	}
+	return mkt;
+}
+
+size_t ScenarioEngine::bytesPerScenario(const vector<MarketDataId> &factors, size_t nBlocks) const
+{
+	// the market and its cloned tables, every shocked curve with its day table, the
+	// scenario row and the partial sums of its tasks
+	size_t bytes = sizeof(Market) + sizeof(Scenario) + 3 * 256 + factors.size() * sizeof(double) + nBlocks * sizeof(double);
+	const long asOf = baseMarket.asOf.getSerialDate();
+	for (const auto &id : factors)
+	{
+		if (id.kind == MarketDataId::Curve)
+		{
+			const auto &tenors = baseMarket.getCurve(id.name)->getTenors();
+			bytes += sizeof(RateCurve) + tenors.size() * (sizeof(Date) + sizeof(double));
+			if (!tenors.empty() && tenors.back().getSerialDate() >= asOf)
+				bytes += (tenors.back().getSerialDate() - asOf + 1) * 2 * sizeof(double);
+		}
+		else if (id.kind == MarketDataId::Vol)
+			bytes += sizeof(VolCurve) + 16 * (sizeof(Date) + sizeof(double));
+	}
+	return bytes;
+}
+
+void ScenarioEngine::varEs(const vector<double> &pnl, double confidence, double &var, double &es)
+{
+	var = es = 0.0;
+	if (pnl.empty())
+		return;
+	size_t nTail = std::max<size_t>(1, (size_t)std::floor((1.0 - confidence) * pnl.size() + 1e-9));
+	nTail = std::min(nTail, pnl.size());
+	vector<double> worst(pnl);
+	std::partial_sort(worst.begin(), worst.begin() + nTail, worst.end());
+	var = -worst[nTail - 1];
+	double tail = 0.0;
+	for (size_t k = 0; k < nTail; k++)
+		tail += worst[k];
+	es = -tail / nTail;
+}
+
+VarResult ScenarioEngine::run(const string &fileName, const VarConfig &config) const
+{
+	ScenarioReader reader(fileName);
+	return run(reader, config);
+}
+
+VarResult ScenarioEngine::run(ScenarioReader &reader, const VarConfig &config) const
+{
+	const vector<MarketDataId> &factors = reader.factors();
+	for (const auto &id : factors)
+	{
+		bool known = true;
+		try
+		{
+			if (id.kind == MarketDataId::Curve)
+				baseMarket.getCurve(id.name);
+			else if (id.kind == MarketDataId::Vol)
+				baseMarket.getVolCurve(id.name);
+			else
+				baseMarket.getStockPrice(id.name);
+		}
+		catch (const exception &)
+		{
+			known = false;
+		}
+		if (!known)
+			throw runtime_error("Error: scenario factor '" + id.name + "' is not in the base market");
+	}
+
+	// trades that read none of the factors have 0 P&L in every scenario
+	vector<size_t> moved, unmoved;
+	vector<MarketDataId> deps;
+	for (size_t i = 0; i < trades.size(); i++)
+	{
+		deps.clear();
+		bool depends = !trades[i]->getMarketDependencies(deps);
+		for (const auto &d : deps)
+			depends = depends || find(factors.begin(), factors.end(), d) != factors.end();
+		(depends ? moved : unmoved).push_back(i);
+	}
+	// options on one underlying and expiry next to each other, so a block prices each such
+	// group on one shared lattice (BinomialTreePricer::PricePortfolio)
+	auto groupKey = [&](size_t i)
+	{
+		auto tree = trades[i]->getType() == "TreeProduct" ? dynamic_cast<const TreeProduct *>(trades[i].get()) : nullptr;
+		return tree ? make_tuple(1, tree->getUnderlying(), tree->GetExpiry().getSerialDate()) : make_tuple(0, string(), 0L);
+	};
+	stable_sort(moved.begin(), moved.end(), [&](size_t a, size_t b)
+				{ return groupKey(a) < groupKey(b); });
+
+	VarResult result;
+	result.confidence = config.confidence;
+	result.repricedTrades = moved.size();
+
+	const size_t block = std::max<size_t>(1, config.tradeBlock);
+	const size_t nBlocks = (moved.size() + block - 1) / block;
+	vector<vector<shared_ptr<Trade>>> blocks(nBlocks);
+	for (size_t k = 0; k < moved.size(); k++)
+		blocks[k / block].push_back(trades[moved[k]]);
+
+	// base pv per block, priced the same way as the scenarios so the P&L has no method noise
+	auto blockPv = [&](const Market &mkt, size_t b)
+	{
+		vector<double> pvs;
+		MakeTreePricer(DefaultTreeOptions())->PricePortfolio(mkt, blocks[b], pvs);
+		double sum = 0.0;
+		for (double pv : pvs)
+			sum += pv;
+		return sum;
+	};
+	// the book's base pv is those block sums plus the trades no scenario moves, priced once
+	vector<double> basePv(nBlocks);
+	pool.parallel_for(0, nBlocks, [&](size_t b)
+					  { basePv[b] = blockPv(baseMarket, b); }, 1);
+	vector<double> unmovedPv(unmoved.size());
+	pool.parallel_for(0, unmoved.size(), [&](size_t k)
+					  { unmovedPv[k] = trades[unmoved[k]]->Pv(baseMarket); });
+	for (double pv : basePv)
+		result.basePv += pv;
+	for (double pv : unmovedPv)
+		result.basePv += pv;
+	result.batchSize = std::max<size_t>(1, config.memoryBudget / bytesPerScenario(factors, nBlocks));
+
+	vector<Scenario> batch;
+	vector<Market> markets;
+	vector<double> partial;
+	while (reader.next(result.batchSize, batch) > 0)
+	{
+		const size_t nScen = batch.size();
+		markets.assign(nScen, baseMarket);
+		pool.parallel_for(0, nScen, [&](size_t s)
+						  {
+			markets[s] = scenarioMarket(factors, batch[s]);
+			// build the day tables here rather than racing for them in the pricing tasks
+			for (const auto &id : factors)
+				if (id.kind == MarketDataId::Curve)
+					markets[s].getCurve(id.name)->getDf(baseMarket.asOf); }, 1);
+
+		// scenario major (scenario, block of trades) tasks, each writes its own partial sum
+		partial.assign(nScen * nBlocks, 0.0);
+		pool.parallel_for(0, nScen * nBlocks, [&](size_t task)
+						  {
+			size_t s = task / nBlocks, b = task % nBlocks;
+			partial[task] = blockPv(markets[s], b) - basePv[b]; }, 1);
+
+		// fixed summation order, the result does not depend on the thread count
+		for (size_t s = 0; s < nScen; s++)
+		{
+			double pnl = 0.0;
+			for (size_t b = 0; b < nBlocks; b++)
+				pnl += partial[s * nBlocks + b];
+			result.labels.push_back(std::move(batch[s].label));
+			result.pnl.push_back(pnl);
+		}
+		markets.clear();
+	}
+
+	varEs(result.pnl, config.confidence, result.var, result.es);
+	return result;
+}
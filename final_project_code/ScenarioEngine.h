@@ -0,0 +1,91 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <istream>
+
+#include "Trade.h"
+#include "Market.h"
+#include "Types.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// one historical day of market moves, applied on top of the base market
+struct Scenario
+{
+	string label;		  // first column, eg. the date
+	vector<double> moves; // one per factor of the reader
+};
+
+// reads a scenario file row by row, ';' separated like trade.txt:
+//   date;curve:USD-SOFR;curve:SGD-SORA;vol:LOGVOL;spot:APPL
+//   2024-01-02;0.0003;-0.0001;0.004;-0.012
+// curve and vol moves are absolute parallel shifts, spot moves are relative returns
+class ScenarioReader
+{
+public:
+	explicit ScenarioReader(const string &fileName);
+	explicit ScenarioReader(istream &input);
+
+	inline const vector<MarketDataId> &factors() const { return factorIds; }
+
+	// up to maxRows more scenarios into out (cleared first), returns how many were read
+	size_t next(size_t maxRows, vector<Scenario> &out);
+
+private:
+	void readHeader();
+
+	unique_ptr<ifstream> file;
+	istream *in;
+	vector<MarketDataId> factorIds;
+	size_t line = 1;
+};
+
+struct VarConfig
+{
+	double confidence = 0.99;
+	size_t memoryBudget = 256 << 20; // bytes of scenario markets and partial sums alive at once
+	size_t tradeBlock = 256;		 // trades per task
+};
+
+// portfolio P&L of every scenario against the base market, and VaR / ES of it.
+// var and es are losses, positive when the portfolio loses money
+struct VarResult
+{
+	double confidence = 0;
+	double basePv = 0;
+	vector<string> labels;
+	vector<double> pnl; // per scenario, in file order
+	double var = 0;
+	double es = 0;
+	size_t batchSize = 0; // scenarios revalued per batch under the memory budget
+	size_t repricedTrades = 0; // trades that read a factor of the file, the others have 0 P&L
+};
+
+// historical simulation: scenarios are streamed from a reader in batches sized by the memory
+// budget. each scenario market is a copy of the base market (shared data, only the bumped
+// curves are cloned), the batch's trades x scenarios grid is priced on the pool and summed
+// into one P&L per scenario, then the batch's markets are dropped
+class ScenarioEngine
+{
+public:
+	ScenarioEngine(const Market &market, const vector<shared_ptr<Trade>> &portfolio, ThreadPool &pool = defaultThreadPool());
+
+	VarResult run(ScenarioReader &reader, const VarConfig &config = VarConfig()) const;
+	VarResult run(const string &fileName, const VarConfig &config = VarConfig()) const;
+
+	// the base market with one scenario applied
+	Market scenarioMarket(const vector<MarketDataId> &factors, const Scenario &scenario) const;
+
+	// loss quantile and mean loss beyond it, over the worst floor((1 - confidence) * n) scenarios
+	static void varEs(const vector<double> &pnl, double confidence, double &var, double &es);
+
+private:
+	size_t bytesPerScenario(const vector<MarketDataId> &factors, size_t nBlocks) const;
+
+	Market baseMarket;
+	vector<shared_ptr<Trade>> trades;
+	ThreadPool &pool;
+};
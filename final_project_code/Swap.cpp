@@ -1,29 +1,18 @@
 #include <cmath>
 #include "Swap.h"
 #include "Market.h"
+#include "MathKernels.h"
 
 void Swap::generateSchedule()
 {
-	if (startDate == maturityDate || frequency <= 0 || frequency > 1)
-		throw std::runtime_error("Error: start date is later than end date, or invalid frequency!");
-
-	string tenorStr;
-	if (frequency == 0.25)
-		tenorStr = "3M";
-	else if (frequency == 0.5)
-		tenorStr = "6M";
-	else
-		tenorStr = "1Y";
-
-	Date seed = startDate;
-	while (seed < maturityDate)
-	{
-		swapSchedule.push_back(seed);
-		seed = dateAddTenor(seed, tenorStr);
-	}
-	swapSchedule.push_back(maturityDate);
-	if (swapSchedule.size() < 2)
-		throw std::runtime_error("Error: invalid schedule, check input!");
+	couponSchedule(startDate, maturityDate, frequency, swapSchedule);
+}
+
+size_t Swap::firstPayment(const Date& valueDate) const
+{
+	// schedule is ascending, payments start from index 1
+	auto it = std::lower_bound(swapSchedule.begin() + 1, swapSchedule.end(), valueDate);
+	return it - swapSchedule.begin();
 }
 
 double Swap::Payoff(double s) const
@@ -37,17 +26,21 @@ double Swap::getAnnuity(const Market &mkt) const
 	double annuity = 0;
 	Date valueDate = mkt.asOf;
 	auto rc = mkt.getCurve(rateCurve);
-	for (size_t i = 1; i < swapSchedule.size(); i++)
+
+	// Correct discount factor using zero rate interpolation, all dates in one batch:
+	size_t first = firstPayment(valueDate);
+	size_t nPay = swapSchedule.size() - first;
+	thread_local vector<double> dfs;
+	dfs.resize(nPay);
+	rc->getRates(swapSchedule.data() + first, nPay, dfs.data());
+	for (size_t k = 0; k < nPay; k++)
+		dfs[k] = -dfs[k] * ((swapSchedule[first + k] - valueDate) / 360.0);
+	imp::expBatch(dfs.data(), dfs.data(), nPay);
+
+	for (size_t i = first; i < swapSchedule.size(); i++)
 	{
-		auto dt = swapSchedule[i];
-		if (dt < valueDate)
-			continue;
 		double tau = (swapSchedule[i] - swapSchedule[i - 1]) / 360.0;
-		// Correct discount factor using zero rate interpolation:
-		double zr = rc->getRate(dt);
-		double T = (dt - valueDate) / 360.0;
-		double df = exp(-zr * T);
-		annuity += notional * tau * df;
+		annuity += notional * tau * dfs[i - first];
 	}
 	return annuity;
 }
@@ -64,14 +57,16 @@ double Swap::Pv(const Market& mkt) const
 	double absNotional = std::abs(notional);
 
 	// --- 1. Calculate the value of the Fixed Leg ---
-	for (size_t i = 1; i < swapSchedule.size(); ++i)
+	// discount every remaining payment date in one batch call
+	size_t first = firstPayment(valueDate);
+	size_t nPay = swapSchedule.size() - first;
+	thread_local vector<double> dfs;
+	dfs.resize(nPay);
+	rc->getDfs(swapSchedule.data() + first, nPay, dfs.data());
+	for (size_t i = first; i < swapSchedule.size(); ++i)
 	{
-		Date payDate = swapSchedule[i];
-		if (payDate < valueDate)
-			continue;
 		double tau = (swapSchedule[i] - swapSchedule[i - 1]) / 365.0; // Using consistent 365 day count
-		double df = rc->getDf(payDate);
-		pvFix += absNotional * tradeRate * tau * df;
+		pvFix += absNotional * tradeRate * tau * dfs[i - first];
 	}
 
 	// --- 2. Calculate the value of the Floating Leg ---
@@ -94,3 +89,54 @@ double Swap::Pv(const Market& mkt) const
 	}
 	return pvFix - pvFloat;
 }
+
+double Swap::PvAdjoint(const Market& mkt, vector<double>& curveSens) const
+{
+	Date valueDate = mkt.asOf;
+	auto rc = mkt.getCurve(rateCurve);
+	curveSens.assign(rc->getTenors().size(), 0.0);
+	double absNotional = std::abs(notional);
+	double sign = notional > 0 ? 1.0 : -1.0; // payer: float - fix
+
+	// forward sweep, same numbers as Pv, keep df and t of every discounted date
+	size_t first = firstPayment(valueDate);
+	size_t nPay = swapSchedule.size() - first;
+	thread_local vector<double> dfs;
+	dfs.resize(nPay);
+	rc->getDfs(swapSchedule.data() + first, nPay, dfs.data());
+	double pvFix = 0.0;
+	for (size_t i = first; i < swapSchedule.size(); ++i)
+	{
+		double tau = (swapSchedule[i] - swapSchedule[i - 1]) / 365.0;
+		pvFix += absNotional * tradeRate * tau * dfs[i - first];
+	}
+	bool hasFloat = maturityDate >= valueDate;
+	bool discountStart = hasFloat && !(startDate < valueDate);
+	double dfStart = discountStart ? rc->getDf(startDate) : 1.0;
+	double dfMaturity = hasFloat ? rc->getDf(maturityDate) : 0.0;
+	double pvFloat = hasFloat ? absNotional * (dfStart - dfMaturity) : 0.0;
+
+	// backward sweep: pv_bar = 1 -> leg bars -> df bars -> zero rate bars -> pillar bars
+	auto addRateBar = [&](const Date& dt, double df, double dfBar)
+	{
+		double t = (dt - rc->_asOf) / 365.0;
+		double rateBar = -t * df * dfBar;
+		RateWeights w = rc->getRateWeights(dt);
+		curveSens[w.i0] += w.w0 * rateBar;
+		curveSens[w.i1] += w.w1 * rateBar;
+	};
+	double pvFixBar = -sign;
+	double pvFloatBar = sign;
+	for (size_t i = swapSchedule.size(); i-- > first;)
+	{
+		double tau = (swapSchedule[i] - swapSchedule[i - 1]) / 365.0;
+		addRateBar(swapSchedule[i], dfs[i - first], pvFixBar * absNotional * tradeRate * tau);
+	}
+	if (hasFloat)
+	{
+		addRateBar(maturityDate, dfMaturity, -pvFloatBar * absNotional);
+		if (discountStart)
+			addRateBar(startDate, dfStart, pvFloatBar * absNotional);
+	}
+	return sign * (pvFloat - pvFix);
+}
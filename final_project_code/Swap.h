@@ -18,6 +18,20 @@ public:
 		rateCurve = to_upper(name).substr(0, 3) == "SGD" ? "SGD-SORA" : "USD-SOFR";
 		generateSchedule();
 	}
+	// with a schedule generated before, eg. read from a PortfolioSnapshot
+	Swap(string name, Date start, Date end, double _notional, double _rate, double _freq, vector<Date> schedule)
+	{
+		tradeType = "Swap";
+		underlying = to_upper(name);
+		startDate = start;
+		maturityDate = end;
+		tradeDate = start;
+		notional = _notional;
+		tradeRate = _rate;
+		frequency = _freq;
+		rateCurve = to_upper(name).substr(0, 3) == "SGD" ? "SGD-SORA" : "USD-SOFR";
+		swapSchedule = std::move(schedule);
+	}
 
 	/*
 	implement this, using npv = discounted cash flow from both leg;
@@ -28,10 +42,18 @@ public:
 	double Payoff(double r) const;
 	double Pv(const Market& mkt) const;
 	double getAnnuity(const Market& mkt) const; //implement this in a cpp file
+	// pv plus d(pv)/d(pillar zero rate) of the discount curve, by one adjoint (reverse) sweep
+	double PvAdjoint(const Market& mkt, vector<double>& curveSens) const;
+	inline const string& getRateCurve() const { return rateCurve; }
+	inline double getRate() const { return tradeRate; }
+	inline const vector<Date>& getSchedule() const { return swapSchedule; } // start date, then the payment dates
+	bool getMarketDependencies(vector<MarketDataId>& deps) const { deps.push_back({MarketDataId::Curve, rateCurve}); return true; }
 	void generateSchedule();
 	
 
 private:
+	size_t firstPayment(const Date& valueDate) const; // index of the first payment on or after valueDate
+
 	Date startDate;
 	Date maturityDate;
 	double tradeRate; // fixed leg rate
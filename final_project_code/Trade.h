@@ -1,6 +1,8 @@
 #pragma once
 #include<string>
+#include<vector>
 #include "Date.h"
+#include "Types.h"
 
 using namespace std;
 
@@ -20,6 +22,8 @@ public:
     virtual double getNotional() const = 0;
     virtual double Pv(const Market& mkt) const = 0;
     virtual double Payoff(double s) const = 0;
+    // market data Pv reads. false means unknown, the trade then follows every market change
+    virtual bool getMarketDependencies(vector<MarketDataId>& /*deps*/) const { return false; }
     
     virtual ~Trade()
     {
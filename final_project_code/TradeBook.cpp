@@ -0,0 +1,353 @@
+#include <algorithm>
+#include <cmath>
+#include "TradeBook.h"
+#include "TreeProduct.h"
+#include "Payoff.h"
+#include "Pricer.h"
+#include "MathKernels.h"
+
+namespace
+{
+	constexpr size_t bookBlock = 1024; // rows per PvAll task
+
+	class SwapView : public Trade
+	{
+	public:
+		SwapView(const SwapBook &_book, size_t _row) : book(_book), row(_row) {}
+		string getType() const override { return "Swap"; }
+		string getUnderlying() const override { return book.getUnderlying(row); }
+		double getNotional() const override { return book.getNotional(row); }
+		double Pv(const Market &mkt) const override { return book.Pv(mkt, row); }
+		double Payoff(double s) const override { return (s - book.getRate(row)) * book.getNotional(row); }
+		bool getMarketDependencies(vector<MarketDataId> &deps) const override
+		{
+			deps.push_back({MarketDataId::Curve, book.getRateCurve(row)});
+			return true;
+		}
+
+	private:
+		const SwapBook &book;
+		size_t row;
+	};
+
+	class BondView : public Trade
+	{
+	public:
+		BondView(const BondBook &_book, size_t _row) : book(_book), row(_row) {}
+		string getType() const override { return "Bond"; }
+		string getUnderlying() const override { return book.getUnderlying(row); }
+		double getNotional() const override { return book.getNotional(row); }
+		double Pv(const Market &mkt) const override { return book.Pv(mkt, row); }
+		double Payoff(double s) const override { return 0; } // the book keeps no trade price
+		bool getMarketDependencies(vector<MarketDataId> &deps) const override
+		{
+			deps.push_back({MarketDataId::Curve, book.getRateCurve(row)});
+			return true;
+		}
+
+	private:
+		const BondBook &book;
+		size_t row;
+	};
+
+	// a vanilla option row, priced like EuropeanOption / AmericanOption
+	class OptionView : public TreeProduct
+	{
+	public:
+		OptionView(const OptionBook &_book, size_t _row) : book(_book), row(_row), expiry(_book.getExpiry(_row)) {}
+		string getType() const override { return "TreeProduct"; }
+		string getUnderlying() const override { return book.getUnderlying(row); }
+		double getNotional() const override { return book.getNotional(row); }
+		double Payoff(double S) const override { return PAYOFF::VanillaOption(book.getOptionType(row), book.getStrike(row), S); }
+		const Date &GetExpiry() const override { return expiry; }
+		double ValueAtNode(double S, double t, double continuation) const override
+		{
+			return book.isAmerican() ? std::max(Payoff(S), continuation) : continuation;
+		}
+		TreeTerms GetTreeTerms() const override { return TreeTerms{book.isAmerican(), book.getOptionType(row), book.getStrike(row)}; }
+		double Pv(const Market &mkt) const override
+		{
+			auto pricer = MakeTreePricer(DefaultTreeOptions());
+			return pricer->PriceTree(mkt, *this) * book.getNotional(row);
+		}
+
+	private:
+		const OptionBook &book;
+		size_t row;
+		Date expiry;
+	};
+}
+
+uint32_t NameTable::index(const string &name)
+{
+	auto it = lookup.emplace(name, (uint32_t)names.size());
+	if (it.second)
+		names.push_back(name);
+	return it.first->second;
+}
+
+void ScheduledBook::add(const string &underlying, const Date &start, const Date &end, double notional, double rate, double freq)
+{
+	vector<Date> dates;
+	couponSchedule(start, end, freq, dates);
+	add(underlying, start, end, notional, rate, freq, dates.data(), dates.size());
+}
+
+void ScheduledBook::add(const string &name, const Date &start, const Date &end, double _notional, double _rate, double _freq, const Date *dates, size_t n)
+{
+	string upper = to_upper(name);
+	underlying.push_back(names.index(upper));
+	curve.push_back(curves.index(upper.substr(0, 3) == "SGD" ? "SGD-SORA" : "USD-SOFR"));
+	startDate.push_back(start);
+	maturityDate.push_back(end);
+	notional.push_back(_notional);
+	rate.push_back(_rate);
+	freq.push_back(_freq);
+	for (size_t k = 0; k < n; k++)
+	{
+		schedule.push_back(dates[k]);
+		accrual.push_back(k ? (dates[k] - dates[k - 1]) / dayCount : 0.0);
+	}
+	scheduleBegin.push_back(schedule.size());
+}
+
+double ScheduledBook::Pv(const Market &mkt, size_t i) const
+{
+	double pv;
+	PvRange(mkt, i, i + 1, &pv);
+	return pv;
+}
+
+void ScheduledBook::PvAll(const Market &mkt, double *pv, ThreadPool &pool) const
+{
+	size_t nBlocks = (size() + bookBlock - 1) / bookBlock;
+	pool.parallel_for(0, nBlocks, [&](size_t b)
+					  {
+		size_t lo = b * bookBlock, hi = std::min(size(), lo + bookBlock);
+		PvRange(mkt, lo, hi, pv + lo); }, 1);
+}
+
+void SwapBook::PvRange(const Market &mkt, size_t lo, size_t hi, double *pv) const
+{
+	// per curve: the remaining payment dates of every row on it (and the start dates still to
+	// come) are discounted in one getDfs call, then each row sums its own slice
+	const Date valueDate = mkt.asOf;
+	thread_local vector<Date> dates;
+	thread_local vector<double> dfs;
+	thread_local vector<size_t> first;
+	for (uint32_t c = 0; c < curves.size(); c++)
+	{
+		dates.clear();
+		first.clear();
+		for (size_t i = lo; i < hi; i++)
+		{
+			if (curve[i] != c)
+				continue;
+			size_t b = scheduleBegin[i], e = scheduleBegin[i + 1];
+			size_t f = std::lower_bound(schedule.begin() + b + 1, schedule.begin() + e, valueDate) - schedule.begin();
+			first.push_back(f);
+			dates.insert(dates.end(), schedule.begin() + f, schedule.begin() + e);
+			if (maturityDate[i] >= valueDate && !(startDate[i] < valueDate))
+				dates.push_back(startDate[i]);
+		}
+		if (first.empty())
+			continue;
+		auto rc = mkt.getCurve(curves[c]);
+		dfs.resize(dates.size());
+		rc->getDfs(dates.data(), dates.size(), dfs.data());
+
+		const double *df = dfs.data();
+		size_t row = 0;
+		for (size_t i = lo; i < hi; i++)
+		{
+			if (curve[i] != c)
+				continue;
+			size_t f = first[row++], e = scheduleBegin[i + 1];
+			double absNotional = std::abs(notional[i]);
+			double pvFix = 0.0;
+			for (size_t k = f; k < e; k++)
+				pvFix += absNotional * rate[i] * accrual[k] * df[k - f];
+			double pvFloat = 0.0;
+			if (maturityDate[i] >= valueDate)
+			{
+				// the maturity is the last payment
+				double dfMaturity = df[e - f - 1];
+				double dfStart = startDate[i] < valueDate ? 1.0 : df[e - f];
+				pvFloat = absNotional * (dfStart - dfMaturity);
+			}
+			df += e - f + (maturityDate[i] >= valueDate && !(startDate[i] < valueDate));
+			// payer (notional > 0) receives float
+			pv[i - lo] = notional[i] > 0 ? pvFloat - pvFix : pvFix - pvFloat;
+		}
+	}
+}
+
+void BondBook::PvRange(const Market &mkt, size_t lo, size_t hi, double *pv) const
+{
+	// like Bond::Pv: zero rates of the remaining coupon dates in one getRates call per curve,
+	// df = exp(-r t) with t on 360 days, exponentiated in one batch
+	const Date valueDate = mkt.asOf;
+	thread_local vector<Date> dates;
+	thread_local vector<double> dfs;
+	thread_local vector<size_t> first;
+	for (uint32_t c = 0; c < curves.size(); c++)
+	{
+		dates.clear();
+		first.clear();
+		for (size_t i = lo; i < hi; i++)
+		{
+			if (curve[i] != c)
+				continue;
+			size_t b = scheduleBegin[i], e = scheduleBegin[i + 1];
+			size_t f = std::lower_bound(schedule.begin() + b + 1, schedule.begin() + e, valueDate) - schedule.begin();
+			first.push_back(f);
+			dates.insert(dates.end(), schedule.begin() + f, schedule.begin() + e);
+		}
+		if (first.empty())
+			continue;
+		auto rc = mkt.getCurve(curves[c]);
+		dfs.resize(dates.size());
+		rc->getRates(dates.data(), dates.size(), dfs.data());
+		for (size_t k = 0; k < dates.size(); k++)
+			dfs[k] = -dfs[k] * ((dates[k] - valueDate) / 360.0);
+		imp::expBatch(dfs.data(), dfs.data(), dfs.size());
+
+		const double *df = dfs.data();
+		size_t row = 0;
+		for (size_t i = lo; i < hi; i++)
+		{
+			if (curve[i] != c)
+				continue;
+			size_t f = first[row++], e = scheduleBegin[i + 1];
+			double value = 0.0;
+			for (size_t k = f; k < e; k++)
+				value += rate[i] * notional[i] * accrual[k] * df[k - f];
+			if (maturityDate[i] >= valueDate)
+				value += notional[i] * df[e - f - 1]; // redemption at the last schedule date
+			df += e - f;
+			pv[i - lo] = value;
+		}
+	}
+}
+
+shared_ptr<Trade> SwapBook::view(size_t i) const
+{
+	return make_shared<SwapView>(*this, i);
+}
+
+shared_ptr<Trade> BondBook::view(size_t i) const
+{
+	return make_shared<BondView>(*this, i);
+}
+
+void OptionBook::add(const string &name, OptionType _optType, double _strike, const Date &_expiry, double _notional)
+{
+	underlying.push_back(names.index(to_upper(name)));
+	optType.push_back(_optType);
+	strike.push_back(_strike);
+	expiry.push_back(_expiry);
+	notional.push_back(_notional);
+}
+
+void OptionBook::PvAll(const Market &mkt, double *pv, ThreadPool &pool) const
+{
+	// rows of one underlying and expiry share a lattice
+	unordered_map<uint64_t, vector<size_t>> byKey;
+	for (size_t i = 0; i < size(); i++)
+		byKey[(uint64_t)underlying[i] << 32 | (uint32_t)expiry[i].getSerialDate()].push_back(i);
+	vector<const vector<size_t> *> groups;
+	for (const auto &g : byKey)
+		groups.push_back(&g.second);
+
+	// a pricer per task, it keeps its lattice buffers between groups
+	size_t nTasks = std::min(groups.size(), 4 * pool.size());
+	pool.parallel_for(0, nTasks, [&](size_t t)
+					  {
+		auto pricer = MakeTreePricer(DefaultTreeOptions());
+		vector<OptionType> types;
+		vector<double> strikes, out;
+		for (size_t g = t; g < groups.size(); g += nTasks)
+		{
+			const vector<size_t> &rows = *groups[g];
+			types.resize(rows.size());
+			strikes.resize(rows.size());
+			out.resize(rows.size());
+			for (size_t j = 0; j < rows.size(); j++)
+			{
+				types[j] = optType[rows[j]];
+				strikes[j] = strike[rows[j]];
+			}
+			pricer->PriceVanillaBatch(mkt, names[underlying[rows[0]]], expiry[rows[0]], american, types.data(), strikes.data(), rows.size(), out.data());
+			for (size_t j = 0; j < rows.size(); j++)
+				pv[rows[j]] = out[j] * notional[rows[j]];
+		} }, 1);
+}
+
+shared_ptr<Trade> OptionBook::view(size_t i) const
+{
+	return make_shared<OptionView>(*this, i);
+}
+
+void TradeBooks::add(const TradeRow &row)
+{
+	string name(row.underlying);
+	kinds.push_back(row.kind);
+	switch (row.kind)
+	{
+	case TradeRow::Swap:
+		rows.push_back(swaps.size());
+		swaps.add(name, row.startDate, row.endDate, row.notional, row.rate, row.freq);
+		break;
+	case TradeRow::Bond:
+		rows.push_back(bonds.size());
+		bonds.add(name, row.startDate, row.endDate, row.notional, row.rate, row.freq);
+		break;
+	case TradeRow::European:
+		rows.push_back(europeans.size());
+		europeans.add(name, row.optionType, row.strike, row.endDate, row.notional);
+		break;
+	case TradeRow::American:
+		rows.push_back(americans.size());
+		americans.add(name, row.optionType, row.strike, row.endDate, row.notional);
+		break;
+	}
+}
+
+void TradeBooks::PvAll(const Market &mkt, double *pv, ThreadPool &pool) const
+{
+	vector<double> bookPv[4];
+	bookPv[TradeRow::Swap].resize(swaps.size());
+	bookPv[TradeRow::Bond].resize(bonds.size());
+	bookPv[TradeRow::European].resize(europeans.size());
+	bookPv[TradeRow::American].resize(americans.size());
+	swaps.PvAll(mkt, bookPv[TradeRow::Swap].data(), pool);
+	bonds.PvAll(mkt, bookPv[TradeRow::Bond].data(), pool);
+	europeans.PvAll(mkt, bookPv[TradeRow::European].data(), pool);
+	americans.PvAll(mkt, bookPv[TradeRow::American].data(), pool);
+	for (size_t i = 0; i < kinds.size(); i++)
+		pv[i] = bookPv[kinds[i]][rows[i]];
+}
+
+vector<shared_ptr<Trade>> TradeBooks::views() const
+{
+	vector<shared_ptr<Trade>> out(kinds.size());
+	for (size_t i = 0; i < kinds.size(); i++)
+	{
+		switch (kinds[i])
+		{
+		case TradeRow::Swap:
+			out[i] = swaps.view(rows[i]);
+			break;
+		case TradeRow::Bond:
+			out[i] = bonds.view(rows[i]);
+			break;
+		case TradeRow::European:
+			out[i] = europeans.view(rows[i]);
+			break;
+		case TradeRow::American:
+			out[i] = americans.view(rows[i]);
+			break;
+		}
+	}
+	return out;
+}
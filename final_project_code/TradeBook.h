@@ -0,0 +1,159 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Date.h"
+#include "Market.h"
+#include "Trade.h"
+#include "TradeLoader.h"
+#include "Types.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// typed trade books: one contiguous column per field instead of one heap object per trade.
+// PvAll prices the whole book a block of rows at a time, with one batched curve lookup per
+// block and curve. view(i) is a Trade reading row i of the book, for code that still takes
+// the Trade interface: it points into the book and must not outlive it
+
+// the distinct names of a book (underlyings, curves), rows store the index
+class NameTable
+{
+public:
+	uint32_t index(const string &name);
+	inline const string &operator[](uint32_t i) const { return names[i]; }
+	inline size_t size() const { return names.size(); }
+
+private:
+	vector<string> names;
+	unordered_map<string, uint32_t> lookup;
+};
+
+// the columns swaps and bonds share, coupon schedules stored back to back
+class ScheduledBook
+{
+public:
+	// same arguments as the Swap / Bond constructors, the schedule is generated here
+	void add(const string &underlying, const Date &start, const Date &end, double notional, double rate, double freq);
+	// with a schedule generated before, start date first (eg. from a PortfolioSnapshot)
+	void add(const string &underlying, const Date &start, const Date &end, double notional, double rate, double freq, const Date *schedule, size_t n);
+
+	inline size_t size() const { return notional.size(); }
+	inline const string &getUnderlying(size_t i) const { return names[underlying[i]]; }
+	inline const string &getRateCurve(size_t i) const { return curves[curve[i]]; }
+	inline double getNotional(size_t i) const { return notional[i]; }
+	inline double getRate(size_t i) const { return rate[i]; }
+
+	// pv of row i alone, same numbers as the row in PvAll
+	double Pv(const Market &mkt, size_t i) const;
+	// pv[i] for every row, blocks of rows on the pool
+	void PvAll(const Market &mkt, double *pv, ThreadPool &pool = defaultThreadPool()) const;
+
+protected:
+	explicit ScheduledBook(double _dayCount) : dayCount(_dayCount) {}
+	virtual void PvRange(const Market &mkt, size_t lo, size_t hi, double *pv) const = 0;
+
+	double dayCount; // of the accruals, 365 for swaps and 360 for bonds like Swap::Pv / Bond::Pv
+	NameTable names;
+	NameTable curves;
+	vector<uint32_t> underlying;
+	vector<uint32_t> curve; // SGD-SORA or USD-SOFR from the underlying, like Swap and Bond
+	vector<Date> startDate;
+	vector<Date> maturityDate;
+	vector<double> notional;
+	vector<double> rate; // fixed rate or coupon
+	vector<double> freq;
+	vector<size_t> scheduleBegin{0}; // row i owns schedule[scheduleBegin[i], scheduleBegin[i + 1])
+	vector<Date> schedule;
+	vector<double> accrual; // (schedule[k] - schedule[k - 1]) / dayCount, 0 for a start date
+};
+
+class SwapBook : public ScheduledBook
+{
+public:
+	SwapBook() : ScheduledBook(365.0) {}
+	shared_ptr<Trade> view(size_t i) const;
+
+private:
+	void PvRange(const Market &mkt, size_t lo, size_t hi, double *pv) const override;
+};
+
+// the direction of a bond is in the sign of its notional, like the trade loader's rows
+class BondBook : public ScheduledBook
+{
+public:
+	BondBook() : ScheduledBook(360.0) {}
+	shared_ptr<Trade> view(size_t i) const;
+
+private:
+	void PvRange(const Market &mkt, size_t lo, size_t hi, double *pv) const override;
+};
+
+// vanilla options of one exercise style. PvAll groups the rows by underlying and expiry and
+// prices each group with the DefaultTreeOptions() pricer's PriceVanillaBatch, one lattice for
+// all strikes of a group, where EuropeanOption::Pv would build one tree per trade
+class OptionBook
+{
+public:
+	void add(const string &underlying, OptionType optType, double strike, const Date &expiry, double notional);
+
+	inline size_t size() const { return notional.size(); }
+	inline bool isAmerican() const { return american; }
+	inline const string &getUnderlying(size_t i) const { return names[underlying[i]]; }
+	inline OptionType getOptionType(size_t i) const { return optType[i]; }
+	inline double getStrike(size_t i) const { return strike[i]; }
+	inline const Date &getExpiry(size_t i) const { return expiry[i]; }
+	inline double getNotional(size_t i) const { return notional[i]; }
+
+	void PvAll(const Market &mkt, double *pv, ThreadPool &pool = defaultThreadPool()) const;
+	shared_ptr<Trade> view(size_t i) const;
+
+protected:
+	explicit OptionBook(bool _american) : american(_american) {}
+
+private:
+	bool american;
+	NameTable names;
+	vector<uint32_t> underlying;
+	vector<OptionType> optType;
+	vector<double> strike;
+	vector<Date> expiry;
+	vector<double> notional;
+};
+
+class EuropeanBook : public OptionBook
+{
+public:
+	EuropeanBook() : OptionBook(false) {}
+};
+
+class AmericanBook : public OptionBook
+{
+public:
+	AmericanBook() : OptionBook(true) {}
+};
+
+// a whole portfolio as four books, rows keep the order they were added in
+class TradeBooks
+{
+public:
+	void add(const TradeRow &row);
+	inline size_t size() const { return kinds.size(); }
+
+	// pv[i] of the i-th added row
+	void PvAll(const Market &mkt, double *pv, ThreadPool &pool = defaultThreadPool()) const;
+	// views of every row in add order
+	vector<shared_ptr<Trade>> views() const;
+
+	SwapBook swaps;
+	BondBook bonds;
+	EuropeanBook europeans;
+	AmericanBook americans;
+
+private:
+	vector<TradeRow::Kind> kinds;
+	vector<size_t> rows; // index of the i-th added row in its book
+};
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include "TradeLoader.h"
+#include "Factory.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const string &fileName)
+{
+#ifndef _WIN32
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw runtime_error("Error: Could not open file '" + fileName + "'");
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		throw runtime_error("Error: Could not read file '" + fileName + "'");
+	}
+	length = (size_t)st.st_size;
+	if (length > 0)
+	{
+		void *p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (p == MAP_FAILED)
+		{
+			close(fd);
+			throw runtime_error("Error: Could not map file '" + fileName + "'");
+		}
+		madvise(p, length, MADV_SEQUENTIAL);
+		bytes = static_cast<const char *>(p);
+		mapped = true;
+	}
+	close(fd); // the mapping keeps its own reference
+#else
+	ifstream in(fileName, ios::binary);
+	if (!in.is_open())
+		throw runtime_error("Error: Could not open file '" + fileName + "'");
+	ostringstream ss;
+	ss << in.rdbuf();
+	buffer = ss.str();
+	bytes = buffer.data();
+	length = buffer.size();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+	if (mapped)
+		munmap(const_cast<char *>(bytes), length);
+#endif
+}
+
+namespace
+{
+	constexpr size_t tradeFields = 12;
+	constexpr size_t minChunkBytes = 256 << 10;
+
+	inline string_view trimField(string_view s)
+	{
+		while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+			s.remove_prefix(1);
+		while (!s.empty() && (s.back() == ' ' || s.back() == '\t'))
+			s.remove_suffix(1);
+		return s;
+	}
+
+	inline bool equalsNoCase(string_view s, const char *lower)
+	{
+		size_t n = strlen(lower);
+		if (s.size() != n)
+			return false;
+		for (size_t i = 0; i < n; i++)
+			if (tolower((unsigned char)s[i]) != lower[i])
+				return false;
+		return true;
+	}
+
+	template <class T>
+	inline bool parseNumber(string_view s, T &value)
+	{
+		const char *first = s.data(), *last = s.data() + s.size();
+		if (first != last && *first == '+')
+			first++;
+		auto [end, ec] = from_chars(first, last, value);
+		return ec == errc() && end == last && first != last;
+	}
+
+	// "yyyy-mm-dd", the day may overflow the month like Date(string)
+	inline bool parseDate(string_view s, Date &dt)
+	{
+		if (s.size() != 10 || s[4] != '-' || s[7] != '-')
+			return false;
+		int v[8];
+		const int at[8] = {0, 1, 2, 3, 5, 6, 8, 9};
+		for (int i = 0; i < 8; i++)
+		{
+			unsigned digit = (unsigned)(s[at[i]] - '0');
+			if (digit > 9)
+				return false;
+			v[i] = (int)digit;
+		}
+		int y = v[0] * 1000 + v[1] * 100 + v[2] * 10 + v[3];
+		int m = v[4] * 10 + v[5];
+		int d = v[6] * 10 + v[7];
+		if (y < 1900 || m < 1 || m > 12 || d < 1 || d > 31)
+			return false;
+		dt = Date::fromSerial(civil::serialFromCivil(y, m, d));
+		return true;
+	}
+
+	// one body line without its line break, false with the reason if it is malformed
+	bool parseRow(string_view text, TradeRow &row, string &message)
+	{
+		string_view f[tradeFields];
+		size_t count = 0;
+		while (true)
+		{
+			size_t semi = text.find(';');
+			if (count < tradeFields)
+				f[count] = trimField(text.substr(0, semi));
+			count++;
+			if (semi == string_view::npos)
+				break;
+			text.remove_prefix(semi + 1);
+		}
+		if (count != tradeFields)
+		{
+			message = "expected " + to_string(tradeFields) + " fields, found " + to_string(count);
+			return false;
+		}
+
+		auto bad = [&](const char *name, string_view value)
+		{
+			message = string("bad ") + name + " '" + string(value) + "'";
+			return false;
+		};
+		if (!parseNumber(f[0], row.id))
+			return bad("id", f[0]);
+		if (f[1] == "bond")
+			row.kind = TradeRow::Bond;
+		else if (f[1] == "swap")
+			row.kind = TradeRow::Swap;
+		else if (f[1] == "european")
+			row.kind = TradeRow::European;
+		else if (f[1] == "american")
+			row.kind = TradeRow::American;
+		else
+			return bad("type", f[1]);
+		if (!parseDate(f[2], row.tradeDate))
+			return bad("trade_dt", f[2]);
+		if (!parseDate(f[3], row.startDate))
+			return bad("start_dt", f[3]);
+		if (!parseDate(f[4], row.endDate))
+			return bad("end_dt", f[4]);
+		if (!parseNumber(f[5], row.notional))
+			return bad("notional", f[5]);
+		if (f[6].empty())
+			return bad("instrument", f[6]);
+		row.underlying = f[6];
+		if (!parseNumber(f[7], row.rate))
+			return bad("rate", f[7]);
+		if (!parseNumber(f[8], row.strike))
+			return bad("strike", f[8]);
+		if (!parseNumber(f[9], row.freq))
+			return bad("freq", f[9]);
+		row.optionType = f[10] == "call" ? OptionType::Call : f[10] == "put" ? OptionType::Put
+																			 : OptionType::None;
+		// the sign of the notional follows the direction, so the pv has the right sign
+		if (equalsNoCase(f[11], "receive") || equalsNoCase(f[11], "short"))
+			row.notional = -row.notional;
+		return true;
+	}
+
+	struct Chunk
+	{
+		const char *begin;
+		const char *end;
+		size_t firstLine; // line number of begin
+		size_t firstRow;  // slot of the first line in the row buffer, one slot per line
+		size_t rows = 0;  // parsed rows, packed from firstRow on
+		vector<TradeLoadError> errors;
+	};
+
+	void parseChunk(Chunk &chunk, TradeRow *out)
+	{
+		string message;
+		size_t line = chunk.firstLine;
+		const char *p = chunk.begin;
+		while (p < chunk.end)
+		{
+			const char *nl = static_cast<const char *>(memchr(p, '\n', chunk.end - p));
+			const char *lineEnd = nl ? nl : chunk.end;
+			string_view text(p, lineEnd - p);
+			if (!text.empty() && text.back() == '\r')
+				text.remove_suffix(1);
+			if (!trimField(text).empty())
+			{
+				if (parseRow(text, out[chunk.rows], message))
+					chunk.rows++;
+				else
+					chunk.errors.push_back({line, message});
+			}
+			line++;
+			p = nl ? nl + 1 : chunk.end;
+		}
+	}
+
+	size_t countLines(const char *p, const char *end)
+	{
+		size_t n = 0;
+		while (p < end)
+		{
+			const char *nl = static_cast<const char *>(memchr(p, '\n', end - p));
+			n++;
+			p = nl ? nl + 1 : end;
+		}
+		return n;
+	}
+}
+
+void parseTradeRows(const char *data, size_t size, vector<TradeRow> &rows, vector<TradeLoadError> &errors, ThreadPool &pool)
+{
+	rows.clear();
+	errors.clear();
+	const char *end = data + size;
+	const char *headerEnd = static_cast<const char *>(memchr(data, '\n', size));
+	if (!headerEnd)
+		return;
+	const char *body = headerEnd + 1;
+
+	// chunk boundaries sit just after a line break, so every chunk holds whole lines
+	size_t bodySize = end - body;
+	size_t nChunks = std::max<size_t>(1, std::min<size_t>(4 * pool.size(), bodySize / minChunkBytes));
+	vector<const char *> bounds{body};
+	for (size_t c = 1; c < nChunks; c++)
+	{
+		const char *target = body + bodySize * c / nChunks;
+		if (target <= bounds.back())
+			continue;
+		const char *nl = static_cast<const char *>(memchr(target - 1, '\n', end - target + 1));
+		const char *next = nl ? nl + 1 : end;
+		if (next > bounds.back() && next < end)
+			bounds.push_back(next);
+	}
+	bounds.push_back(end);
+
+	// lines are counted first so each chunk parses straight into its slots of rows, the
+	// slots of malformed and blank lines are squeezed out afterwards
+	vector<Chunk> chunks(bounds.size() - 1);
+	vector<size_t> lines(chunks.size());
+	pool.parallel_for(0, chunks.size(), [&](size_t c)
+					  { lines[c] = countLines(bounds[c], bounds[c + 1]); }, 1);
+	size_t line = 2, slot = 0; // the header is line 1
+	for (size_t c = 0; c < chunks.size(); c++)
+	{
+		chunks[c].begin = bounds[c];
+		chunks[c].end = bounds[c + 1];
+		chunks[c].firstLine = line;
+		chunks[c].firstRow = slot;
+		line += lines[c];
+		slot += lines[c];
+	}
+	rows.resize(slot);
+	pool.parallel_for(0, chunks.size(), [&](size_t c)
+					  { parseChunk(chunks[c], rows.data() + chunks[c].firstRow); }, 1);
+
+	size_t packed = 0;
+	for (auto &chunk : chunks)
+	{
+		if (packed != chunk.firstRow)
+			std::move(rows.begin() + chunk.firstRow, rows.begin() + chunk.firstRow + chunk.rows, rows.begin() + packed);
+		packed += chunk.rows;
+		for (auto &err : chunk.errors)
+			errors.push_back(std::move(err));
+	}
+	rows.resize(packed);
+}
+
+vector<shared_ptr<Trade>> createTrades(const vector<TradeRow> &rows, ThreadPool &pool)
+{
+	static SwapFactory swapFactory;
+	static BondFactory bondFactory;
+	static EurOptFactory eurFactory;
+	static AmericanOptFactory amerFactory;
+
+	vector<shared_ptr<Trade>> trades(rows.size());
+	pool.parallel_for(0, rows.size(), [&](size_t i)
+					  {
+		const TradeRow &r = rows[i];
+		string underlying(r.underlying);
+		switch (r.kind)
+		{
+		case TradeRow::Bond:
+			trades[i] = bondFactory.createTrade(underlying, r.startDate, r.endDate, r.notional, r.rate, r.freq, r.optionType);
+			break;
+		case TradeRow::Swap:
+			trades[i] = swapFactory.createTrade(underlying, r.startDate, r.endDate, r.notional, r.rate, r.freq, r.optionType);
+			break;
+		case TradeRow::European:
+			trades[i] = eurFactory.createTrade(underlying, r.startDate, r.endDate, r.notional, r.strike, r.freq, r.optionType);
+			break;
+		case TradeRow::American:
+			trades[i] = amerFactory.createTrade(underlying, r.startDate, r.endDate, r.notional, r.strike, r.freq, r.optionType);
+			break;
+		} });
+	return trades;
+}
+
+vector<shared_ptr<Trade>> loadTrades(const string &fileName, vector<TradeLoadError> &errors, ThreadPool &pool)
+{
+	MappedFile file(fileName);
+	vector<TradeRow> rows;
+	parseTradeRows(file.data(), file.size(), rows, errors, pool);
+	return createTrades(rows, pool); // copies the underlyings out before the file is unmapped
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Date.h"
+#include "Trade.h"
+#include "Types.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// a read only view of a whole file: memory mapped where the platform has mmap, read into a
+// buffer otherwise. views into it stay valid while the MappedFile lives
+class MappedFile
+{
+public:
+	explicit MappedFile(const string &fileName);
+	~MappedFile();
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	inline const char *data() const { return bytes; }
+	inline size_t size() const { return length; }
+
+private:
+	const char *bytes = nullptr;
+	size_t length = 0;
+	string buffer; // the copy when the file is not mapped
+	bool mapped = false;
+};
+
+// one parsed row of trade.txt:
+//   id;type;trade_dt;start_dt;end_dt;notional;instrument;rate;strike;freq;option;direction
+// the notional is signed, negative for receive / short
+struct TradeRow
+{
+	enum Kind
+	{
+		Bond,
+		Swap,
+		European,
+		American
+	};
+	Kind kind;
+	int id;
+	Date tradeDate;
+	Date startDate;
+	Date endDate;
+	double notional;
+	string_view underlying; // points into the parsed buffer
+	double rate;
+	double strike;
+	double freq;
+	OptionType optionType;
+};
+
+// a row that could not be parsed, line is 1 based and counts the header
+struct TradeLoadError
+{
+	size_t line;
+	string message;
+};
+
+// parses the rows of a trade file held in memory (header included) in place, chunks split at
+// line boundaries run on the pool. rows and errors come out in file order, a malformed row
+// is reported and skipped
+void parseTradeRows(const char *data, size_t size, vector<TradeRow> &rows, vector<TradeLoadError> &errors, ThreadPool &pool = defaultThreadPool());
+
+// the trade of each row through the factory of its type
+vector<shared_ptr<Trade>> createTrades(const vector<TradeRow> &rows, ThreadPool &pool = defaultThreadPool());
+
+// maps the file, parses it and creates the trades. throws if the file cannot be opened
+vector<shared_ptr<Trade>> loadTrades(const string &fileName, vector<TradeLoadError> &errors, ThreadPool &pool = defaultThreadPool());
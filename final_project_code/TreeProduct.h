@@ -2,6 +2,16 @@
 #define _TREE_PRODUCT_H
 #include "Date.h"
 #include "Trade.h"
+#include "Types.h"
+
+// what a lattice pricer may know about the payoff, so it can inline it instead of
+// calling Payoff / ValueAtNode per node. optType None means "only through the virtuals"
+struct TreeTerms
+{
+    bool american = false;
+    OptionType optType = None;
+    double strike = 0;
+};
 
 //option type of trade, will be priced using tree model
 class TreeProduct: public Trade
@@ -10,6 +20,17 @@ public:
     TreeProduct(): Trade() { tradeType = "TreeProduct";};
     virtual const Date& GetExpiry() const = 0;
     virtual double ValueAtNode(double stockPrice, double t, double continuationValue) const = 0;
+    virtual TreeTerms GetTreeTerms() const { return TreeTerms(); }
+    // payoff of one simulated path for MonteCarloPricer, path[k] is the spot after k + 1 of the
+    // nSteps equal time steps to expiry. override for path dependent payoffs
+    virtual double PathPayoff(const double* path, int nSteps) const { return Payoff(path[nSteps - 1]); }
+    // what BinomialTreePricer reads: spot, LOGVOL and USD-SOFR
+    virtual bool getMarketDependencies(vector<MarketDataId>& deps) const {
+        deps.push_back({MarketDataId::Stock, getUnderlying()});
+        deps.push_back({MarketDataId::Vol, "LOGVOL"});
+        deps.push_back({MarketDataId::Curve, "USD-SOFR"});
+        return true;
+    }
     double Pv(const Market& mkt) const { return 0; }; //provide behaviour but not use this
 };
 
@@ -1,6 +1,8 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <string>
+
 enum OptionType 
 {   
     Call, 
@@ -10,4 +12,20 @@ enum OptionType
     None
 };
 
+// names one piece of market data: a rate curve, a vol curve or a stock price
+struct MarketDataId
+{
+    enum Kind
+    {
+        Curve,
+        Vol,
+        Stock
+    };
+    Kind kind;
+    std::string name;
+
+    bool operator<(const MarketDataId &other) const { return kind != other.kind ? kind < other.kind : name < other.name; }
+    bool operator==(const MarketDataId &other) const { return kind == other.kind && name == other.name; }
+};
+
 #endif
@@ -1,88 +1,396 @@
-// C++ Program to demonstrate thread pooling
+// Work stealing thread pool shared by pricing and risk
+#pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
-#include <functional>
-#include <iostream>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 using namespace std;
 
-// Class that represents a simple thread pool
+// Move only void() callable that keeps small closures inline instead of on the heap.
+// Enqueueing a lambda capturing a few pointers or a packaged_task allocates nothing
+class SmallTask
+{
+public:
+    SmallTask() = default;
+
+    template <class F, class Fn = decay_t<F>, class = enable_if_t<!is_same<Fn, SmallTask>::value>>
+    SmallTask(F &&f)
+    {
+        if constexpr (sizeof(Fn) <= capacity && alignof(Fn) <= alignof(max_align_t) && is_nothrow_move_constructible<Fn>::value)
+        {
+            ::new (static_cast<void *>(buffer_)) Fn(std::forward<F>(f));
+            ops_ = &inlineOps<Fn>;
+        }
+        else
+        {
+            *reinterpret_cast<Fn **>(buffer_) = new Fn(std::forward<F>(f));
+            ops_ = &heapOps<Fn>;
+        }
+    }
+
+    SmallTask(SmallTask &&other) noexcept { moveFrom(other); }
+    SmallTask &operator=(SmallTask &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+    SmallTask(const SmallTask &) = delete;
+    SmallTask &operator=(const SmallTask &) = delete;
+    ~SmallTask() { reset(); }
+
+    explicit operator bool() const { return ops_ != nullptr; }
+    void operator()() { ops_->call(buffer_); }
+
+private:
+    static constexpr size_t capacity = 48;
+
+    struct Ops
+    {
+        void (*call)(void *);
+        void (*move)(void *dst, void *src); // move constructs dst, destroys src
+        void (*destroy)(void *);
+    };
+
+    template <class Fn>
+    static void callInline(void *p) { (*static_cast<Fn *>(p))(); }
+    template <class Fn>
+    static void moveInline(void *dst, void *src)
+    {
+        ::new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+        static_cast<Fn *>(src)->~Fn();
+    }
+    template <class Fn>
+    static void destroyInline(void *p) { static_cast<Fn *>(p)->~Fn(); }
+
+    template <class Fn>
+    static void callHeap(void *p) { (**static_cast<Fn **>(p))(); }
+    static void moveHeap(void *dst, void *src) { *static_cast<void **>(dst) = *static_cast<void **>(src); }
+    template <class Fn>
+    static void destroyHeap(void *p) { delete *static_cast<Fn **>(p); }
+
+    template <class Fn>
+    static constexpr Ops inlineOps = {&callInline<Fn>, &moveInline<Fn>, &destroyInline<Fn>};
+    template <class Fn>
+    static constexpr Ops heapOps = {&callHeap<Fn>, &moveHeap, &destroyHeap<Fn>};
+
+    void moveFrom(SmallTask &other)
+    {
+        ops_ = other.ops_;
+        if (ops_)
+            ops_->move(buffer_, other.buffer_);
+        other.ops_ = nullptr;
+    }
+    void reset()
+    {
+        if (ops_)
+            ops_->destroy(buffer_);
+        ops_ = nullptr;
+    }
+
+    alignas(max_align_t) unsigned char buffer_[capacity];
+    const Ops *ops_ = nullptr;
+};
+
+// Counts outstanding jobs, wait() returns once done() was called for each add()
+class WaitGroup
+{
+public:
+    explicit WaitGroup(size_t count = 0) : count_(count) {}
+
+    void add(size_t n = 1)
+    {
+        lock_guard<mutex> lock(mutex_);
+        count_ += n;
+    }
+    // everything happens under the lock, so a waiter that sees 0 may destroy the group
+    void done()
+    {
+        lock_guard<mutex> lock(mutex_);
+        if (--count_ == 0)
+            cv_.notify_all();
+    }
+    bool finished()
+    {
+        lock_guard<mutex> lock(mutex_);
+        return count_ == 0;
+    }
+    void wait()
+    {
+        unique_lock<mutex> lock(mutex_);
+        cv_.wait(lock, [this]
+                 { return count_ == 0; });
+    }
+    template <class Rep, class Period>
+    bool waitFor(const chrono::duration<Rep, Period> &timeout)
+    {
+        unique_lock<mutex> lock(mutex_);
+        return cv_.wait_for(lock, timeout, [this]
+                            { return count_ == 0; });
+    }
+
+private:
+    mutex mutex_;
+    condition_variable cv_;
+    size_t count_;
+};
+
+// Each worker owns a deque: it pushes and pops its own tasks at the back and, when it runs
+// dry, steals from the front of the others. Tasks submitted from outside the pool are dealt
+// round robin, so there is no single queue and lock that every thread fights over.
+// Idle workers sleep on one condition variable, a push signals it only while some sleeper has
+// not been signalled yet
 class ThreadPool
 {
 public:
     // Constructor to creates a thread pool with given number of threads
     ThreadPool(size_t num_threads = thread::hardware_concurrency())
     {
-        // Creating worker threads
+        num_threads = std::max<size_t>(num_threads, 1);
         for (size_t i = 0; i < num_threads; ++i)
-        {
-            threads_.emplace_back([this]
-                                  { 
-				while (true) { 
-					function<void()> task; 
-					// The reason for putting the below  here is to unlock the queue before executing the task so that other 
-					// threads can perform enqueue tasks 
-					{ 
-						// Locking the queue so that data can be shared safely 
-						unique_lock<mutex> lock(queue_mutex_); 
-						// Waiting until there is a task to execute or the pool is stopped 
-						cv_.wait(lock, [this] { 
-							return !tasks_.empty() || stop_; 
-						}); 
-						// exit the thread in case the pool is stopped and there are no tasks 
-						if (stop_ && tasks_.empty()) { 
-							return; 
-						} 
-						// Get the next task from the queue 
-						task = std::move(tasks_.front());
-						tasks_.pop(); 
-					} 
-					task(); 
-				} });
-        }
+            queues_.emplace_back(new WorkQueue);
+        for (size_t i = 0; i < num_threads; ++i)
+            threads_.emplace_back([this, i]
+                                  { workerLoop(i); });
     }
 
+    // Runs what is still queued, then joins the workers
     ~ThreadPool()
     {
         {
-            // Lock the queue to update the stop flag safely
-            unique_lock<mutex> lock(queue_mutex_);
+            lock_guard<mutex> lock(sleepMutex_);
             stop_ = true;
         }
+        sleepCv_.notify_all();
+        for (auto &thread : threads_)
+            thread.join();
+    }
 
-        // Notify all threads
-        cv_.notify_all();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
 
-        // Joining all worker threads to ensure they have completed their tasks
-        for (auto &thread : threads_)
+    size_t size() const { return threads_.size(); }
+
+    // Fire and forget. an exception escaping the task terminates the program
+    template <class F>
+    void enqueue(F &&task)
+    {
+        push(SmallTask(std::forward<F>(task)));
+    }
+
+    // Runs f(args...) on the pool, the future carries the result or the exception
+    template <class F, class... Args>
+    auto submit(F &&f, Args &&...args) -> future<invoke_result_t<decay_t<F>, decay_t<Args>...>>
+    {
+        using R = invoke_result_t<decay_t<F>, decay_t<Args>...>;
+        packaged_task<R()> task([fn = std::forward<F>(f), tup = make_tuple(std::forward<Args>(args)...)]() mutable
+                                { return std::apply(std::move(fn), std::move(tup)); });
+        future<R> result = task.get_future();
+        push(SmallTask(std::move(task)));
+        return result;
+    }
+
+    // Blocks until the group is finished. the calling thread runs queued tasks meanwhile, so
+    // waiting from inside a task (nested parallel_for) cannot starve the pool
+    void wait(WaitGroup &group)
+    {
+        // once no task is queued the group's last tasks are running on other threads: block
+        // on the group instead of polling. tasks they push go to their own queues and are
+        // run by them or by woken sleepers
+        while (!group.finished())
         {
-            thread.join();
+            if (!runOne(self().pool == this ? self().index : nextQueue_.load(memory_order_relaxed) % queues_.size()))
+            {
+                group.wait();
+                return;
+            }
         }
     }
 
-    // Enqueue task for execution by the thread pool
-    void enqueue(function<void()> task)
+    // body(i) for i in [begin, end), in chunks of `grain` (default: ~4 chunks per worker).
+    // the caller works on the first chunk and helps until all are done. the first
+    // exception thrown by body is rethrown here
+    template <class F>
+    void parallel_for(size_t begin, size_t end, F &&body, size_t grain = 0)
     {
+        if (begin >= end)
+            return;
+        size_t n = end - begin;
+        if (grain == 0)
+            grain = std::max<size_t>(1, n / (4 * size()));
+        size_t chunks = (n + grain - 1) / grain;
+
+        WaitGroup group(chunks);
+        exception_ptr error;
+        mutex errorMutex;
+        auto runChunk = [&](size_t c)
         {
-            unique_lock<std::mutex> lock(queue_mutex_);
-            tasks_.push(std::move(task));
-        }
-        cv_.notify_one();
+            size_t lo = begin + c * grain, hi = std::min(end, lo + grain);
+            try
+            {
+                for (size_t i = lo; i < hi; i++)
+                    body(i);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> lock(errorMutex);
+                if (!error)
+                    error = current_exception();
+            }
+            group.done();
+        };
+        for (size_t c = 1; c < chunks; c++)
+            enqueue([&runChunk, c]
+                    { runChunk(c); });
+        runChunk(0);
+        wait(group);
+        if (error)
+            rethrow_exception(error);
     }
 
 private:
-    // Vector to store worker threads
-    vector<thread> threads_;
-    // Queue of tasks
-    queue<function<void()>> tasks_;
-    // Mutex to synchronize access to shared data
-    mutex queue_mutex_;
-    // Condition variable to signal changes in the state of the tasks queue
-    condition_variable cv_;
+    struct alignas(64) WorkQueue
+    {
+        mutex m;
+        deque<SmallTask> tasks;
+    };
 
-    // Flag to indicate whether the thread pool should stop or not
+    // which pool and queue the current thread works for
+    struct WorkerId
+    {
+        ThreadPool *pool = nullptr;
+        size_t index = 0;
+    };
+    static WorkerId &self()
+    {
+        static thread_local WorkerId id;
+        return id;
+    }
+
+    void push(SmallTask task)
+    {
+        // own queue from a worker (LIFO, cache warm), round robin from outside
+        size_t q = self().pool == this ? self().index : nextQueue_.fetch_add(1, memory_order_relaxed) % queues_.size();
+        pending_.fetch_add(1);
+        {
+            lock_guard<mutex> lock(queues_[q]->m);
+            queues_[q]->tasks.push_back(std::move(task));
+        }
+        // pending_ is raised before idle_ is read and a worker raises idle_ before it reads
+        // pending_, so one of the two always sees the other. a wakeup takes its sleeper out of
+        // idle_, so a burst of pushes signals each sleeper once and then takes no lock at all
+        if (idle_.load() > 0)
+        {
+            lock_guard<mutex> lock(sleepMutex_);
+            if (idle_.load() > 0)
+            {
+                idle_.fetch_sub(1);
+                wakeups_++;
+                sleepCv_.notify_one();
+            }
+        }
+    }
+
+    // own queue from the back, then steal from the front of the others
+    bool runOne(size_t home)
+    {
+        if (pending_.load() == 0) // nothing queued anywhere, skip locking every queue
+            return false;
+        SmallTask task;
+        const size_t n = queues_.size();
+        for (size_t k = 0; k < n && !task; k++)
+        {
+            WorkQueue &q = *queues_[(home + k) % n];
+            lock_guard<mutex> lock(q.m);
+            if (q.tasks.empty())
+                continue;
+            if (k == 0 && self().pool == this)
+            {
+                task = std::move(q.tasks.back());
+                q.tasks.pop_back();
+            }
+            else
+            {
+                task = std::move(q.tasks.front());
+                q.tasks.pop_front();
+            }
+        }
+        if (!task)
+            return false;
+        pending_.fetch_sub(1);
+        task();
+        return true;
+    }
+
+    void workerLoop(size_t index)
+    {
+        self() = WorkerId{this, index};
+        while (true)
+        {
+            if (runOne(index))
+                continue;
+            // a producer is usually mid burst: give it the core a few times before paying
+            // for a sleep and a wakeup
+            bool found = false;
+            for (int spin = 0; spin < 8 && !found; spin++)
+            {
+                this_thread::yield();
+                found = pending_.load() > 0;
+            }
+            if (found)
+                continue;
+            unique_lock<mutex> lock(sleepMutex_);
+            idle_.fetch_add(1);
+            if (pending_.load() > 0 || stop_)
+            {
+                // work arrived (or shutdown) before we slept, nobody could have woken us yet
+                idle_.fetch_sub(1);
+                if (stop_ && pending_.load() == 0)
+                    return;
+                continue;
+            }
+            sleepCv_.wait(lock, [this]
+                          { return wakeups_ > 0 || stop_; });
+            if (wakeups_ > 0)
+                wakeups_--;
+            else
+                idle_.fetch_sub(1); // stopping, not woken by a push
+            if (stop_ && pending_.load() == 0)
+                return;
+        }
+    }
+
+    vector<unique_ptr<WorkQueue>> queues_;
+    vector<thread> threads_;
+    atomic<size_t> nextQueue_{0};
+    atomic<long long> pending_{0}; // queued, not yet taken
+    atomic<int> idle_{0}; // asleep and not yet signalled
+    int wakeups_ = 0;     // signalled, not yet woken, under sleepMutex_
+    mutex sleepMutex_;
+    condition_variable sleepCv_;
     bool stop_ = false;
 };
+
+// The pool used by pricing and risk, one worker per hardware thread
+inline ThreadPool &defaultThreadPool()
+{
+    static ThreadPool pool;
+    return pool;
+}